@@ -0,0 +1,185 @@
+// SRG_BudgetController.cpp
+
+#include "SRG_BudgetController.h"
+
+namespace
+{
+	constexpr double MinRTTWindowSec = 10.0;
+
+	/** Аддитивный рост / мультипликативный спад (прежний регулятор графа, теперь по сигналам канала) */
+	class FAIMDController final : public FSRGBudgetController
+	{
+	public:
+		using FSRGBudgetController::FSRGBudgetController;
+
+		virtual ESRGBudgetController GetType() const override { return ESRGBudgetController::AIMD; }
+		virtual const TCHAR*         GetName() const override { return TEXT("AIMD"); }
+		virtual FString Describe() const override
+		{
+			return FString::Printf(TEXT("ok=%.1fs"), OkSec);
+		}
+
+		virtual float Update(const FSRGLinkSample& S) override
+		{
+			TrackMinRTT(S);
+			if (IsCongested(S))
+			{
+				Rate *= FMath::Clamp(Params.AIMDBeta, 0.5f, 0.98f);
+				OkSec = 0.f;
+			}
+			else if (!IsAppLimited(S))
+			{
+				OkSec += S.DtSec;
+				if (OkSec >= 1.f)
+				{
+					Rate += Params.AIMDAlpha;
+					OkSec = 0.f;
+				}
+			}
+			Rate = ClampRate(Rate, S);
+			return Rate;
+		}
+
+	private:
+		float OkSec = 0.f;
+	};
+
+	/**
+	 * BBR-подобный: пропускная — максимум скорости доставки за последние 10 отсчётов,
+	 * скорость = усиление × пропускная. Старт — ×2, пока доставка растёт; затем цикл
+	 * 1.25 (проба) / 0.75 (слив очереди) / 1 ×6. Рост RTT выше minRTT — проба отменяется.
+	 */
+	class FBBRController final : public FSRGBudgetController
+	{
+	public:
+		using FSRGBudgetController::FSRGBudgetController;
+
+		virtual ESRGBudgetController GetType() const override { return ESRGBudgetController::BBR; }
+		virtual const TCHAR*         GetName() const override { return TEXT("BBR"); }
+		virtual FString Describe() const override
+		{
+			return FString::Printf(TEXT("%s btlbw=%.1fKB/s gain=%.2f"),
+				bStartup ? TEXT("startup") : TEXT("probe"), GetBtlBw() / 1024.f, LastGain);
+		}
+
+		virtual float Update(const FSRGLinkSample& S) override
+		{
+			TrackMinRTT(S);
+
+			const float Delivery = S.DtSec > 0.f ? S.SentBytes / S.DtSec : 0.f;
+			if (!IsAppLimited(S) || Delivery > GetBtlBw())
+			{
+				Samples[Head] = Delivery;
+				Head = (Head + 1) % NumSamples;
+			}
+			float BtlBw = FMath::Max(GetBtlBw(), Params.MinBytesPerSec);
+			if (S.LossFrac > 2.f * Params.LossThreshold)
+			{
+				// Сильные потери: оценка завышена (BBRv2 — снижение по потерям)
+				BtlBw *= 0.85f;
+				for (float& V : Samples) V = FMath::Min(V, BtlBw);
+			}
+
+			const bool bRTTInflated = MinRTTms > 0.f && S.RTTms > MinRTTms * 1.25f + 10.f;
+
+			if (bStartup)
+			{
+				if (BtlBw > FullBw * 1.25f) { FullBw = BtlBw; FullBwCount = 0; }
+				else if (++FullBwCount >= 3 || IsCongested(S) || bRTTInflated) bStartup = false;
+			}
+
+			static constexpr float Gains[8] = { 1.25f, 0.75f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f };
+			LastGain = bStartup ? 2.f : Gains[Cycle];
+			Cycle    = (Cycle + 1) % UE_ARRAY_COUNT(Gains);
+			if (LastGain > 1.f && (bRTTInflated || IsCongested(S))) LastGain = 0.75f;
+
+			Rate = ClampRate(LastGain * BtlBw, S);
+			return Rate;
+		}
+
+	private:
+		static constexpr int32 NumSamples = 10;
+
+		float GetBtlBw() const
+		{
+			float M = 0.f;
+			for (float V : Samples) M = FMath::Max(M, V);
+			return M;
+		}
+
+		float Samples[NumSamples] = {};
+		int32 Head        = 0;
+		int32 Cycle       = 0;
+		bool  bStartup    = true;
+		float FullBw      = 0.f;
+		int32 FullBwCount = 0;
+		float LastGain    = 2.f;
+	};
+
+	/** Задержка в очереди (RTT - minRTT) держится у цели: ниже — разгон, выше — торможение */
+	class FDelayController final : public FSRGBudgetController
+	{
+	public:
+		using FSRGBudgetController::FSRGBudgetController;
+
+		virtual ESRGBudgetController GetType() const override { return ESRGBudgetController::Delay; }
+		virtual const TCHAR*         GetName() const override { return TEXT("Delay"); }
+		virtual FString Describe() const override
+		{
+			return FString::Printf(TEXT("qdelay=%.0fms/%.0fms"), QueueDelayMs, Params.DelayTargetMs);
+		}
+
+		virtual float Update(const FSRGLinkSample& S) override
+		{
+			TrackMinRTT(S);
+			if (S.LossFrac > Params.LossThreshold)
+			{
+				Rate *= 0.7f;
+			}
+			else if (S.RTTms > 0.f && MinRTTms > 0.f)
+			{
+				QueueDelayMs = S.RTTms - MinRTTms;
+				const float Target    = FMath::Max(1.f, Params.DelayTargetMs);
+				const float OffTarget = FMath::Clamp((Target - QueueDelayMs) / Target, -1.f, 1.f);
+				// Разгон — только если канал реально загружен; торможение — всегда
+				if (OffTarget < 0.f || !IsAppLimited(S))
+				{
+					Rate *= 1.f + Params.DelayGain * OffTarget * FMath::Min(S.DtSec, 1.f);
+				}
+			}
+			Rate = ClampRate(Rate, S);
+			return Rate;
+		}
+
+	private:
+		float QueueDelayMs = 0.f;
+	};
+}
+
+void FSRGBudgetController::TrackMinRTT(const FSRGLinkSample& S)
+{
+	MinRTTAge += S.DtSec;
+	if (S.RTTms <= 0.f) return;
+	if (MinRTTms <= 0.f || S.RTTms <= MinRTTms || MinRTTAge > MinRTTWindowSec)
+	{
+		MinRTTms  = S.RTTms;
+		MinRTTAge = 0.0;
+	}
+}
+
+float FSRGBudgetController::ClampRate(float R, const FSRGLinkSample& S) const
+{
+	float Upper = Params.MaxBytesPerSec;
+	if (S.LinkBytesPerSec > 0.f) Upper = FMath::Min(Upper, S.LinkBytesPerSec);
+	return FMath::Clamp(R, Params.MinBytesPerSec, FMath::Max(Params.MinBytesPerSec, Upper));
+}
+
+TUniquePtr<FSRGBudgetController> FSRGBudgetController::Make(ESRGBudgetController Type, const FSRGBudgetParams& Params)
+{
+	switch (Type)
+	{
+	case ESRGBudgetController::BBR:   return MakeUnique<FBBRController>(Params);
+	case ESRGBudgetController::Delay: return MakeUnique<FDelayController>(Params);
+	default:                          return MakeUnique<FAIMDController>(Params);
+	}
+}
@@ -0,0 +1,90 @@
+// SRG_BudgetController.h
+#pragma once
+
+// Регуляторы бюджета соединения без UObject/Engine: на входе — отсчёт канала
+// (RTT, потери, очередь, фактически отправленное), на выходе — скорость в байт/с.
+// USpaceReplicationGraph снимает отсчёт с UNetConnection раз в интервал отбора.
+
+#include "CoreMinimal.h"
+
+/** Отсчёт канала соединения за один интервал отбора */
+struct FSRGLinkSample
+{
+	float DtSec           = 0.f;
+	float SentBytes       = 0.f;  // корабли за интервал (замер ReplicateSingleActor)
+	float RTTms           = 0.f;  // 0 — нет данных
+	float LossFrac        = 0.f;  // исходящие потери, [0..1]
+	float QueuedBytes     = 0.f;  // очередь отправки сверх кредита (QueuedBits > 0)
+	float LinkBytesPerSec = 0.f;  // потолок движка (CurrentNetSpeed); 0 — без потолка
+};
+
+/** Настройки регуляторов (CVar'ы space.RepGraph.Budget.* / AIMD.*), применяются каждый отсчёт */
+struct FSRGBudgetParams
+{
+	float MinBytesPerSec   = 8000.f;
+	float MaxBytesPerSec   = 80000.f;
+	float StartBytesPerSec = 22000.f;
+	float LossThreshold    = 0.02f;   // выше — перегрузка
+	float AIMDAlpha        = 1600.f;  // байт/с прибавки за секунду без перегрузки
+	float AIMDBeta         = 0.85f;
+	float DelayTargetMs    = 25.f;    // целевая задержка в очереди (RTT - minRTT)
+	float DelayGain        = 0.5f;    // доля скорости в секунду при полном отклонении от цели
+};
+
+enum class ESRGBudgetController : uint8
+{
+	AIMD  = 0,  // потери/очередь → ×Beta, иначе +Alpha в секунду
+	BBR   = 1,  // оценка пропускной (max доставки) и minRTT, цикл усиления 1.25/0.75/1…
+	Delay = 2,  // LEDBAT-подобный: держит задержку в очереди у цели
+};
+
+/**
+ * Регулятор скорости одного соединения. Update — раз в интервал отбора;
+ * Describe — внутреннее состояние для LiveLog.
+ */
+class SPACETEST_API FSRGBudgetController
+{
+public:
+	virtual ~FSRGBudgetController() = default;
+
+	virtual ESRGBudgetController GetType() const = 0;
+	virtual const TCHAR*         GetName() const = 0;
+	virtual FString              Describe() const = 0;
+
+	/** Новый отсчёт → скорость, байт/с, в пределах Params и потолка канала */
+	virtual float Update(const FSRGLinkSample& S) = 0;
+
+	FORCEINLINE float GetRate() const { return Rate; }
+	FORCEINLINE float GetMinRTTms() const { return MinRTTms; }
+	FORCEINLINE void  SetParams(const FSRGBudgetParams& InParams) { Params = InParams; }
+
+	static TUniquePtr<FSRGBudgetController> Make(ESRGBudgetController Type, const FSRGBudgetParams& Params);
+
+protected:
+	explicit FSRGBudgetController(const FSRGBudgetParams& InParams)
+		: Params(InParams)
+		, Rate(InParams.StartBytesPerSec)
+	{}
+
+	/** Перегрузка по сигналам канала: потери выше порога или очередь сверх кредита */
+	bool IsCongested(const FSRGLinkSample& S) const
+	{
+		return S.LossFrac > Params.LossThreshold || S.QueuedBytes > 0.f;
+	}
+
+	/** Мало отправили относительно скорости — прирост ничего не проверит */
+	bool IsAppLimited(const FSRGLinkSample& S) const
+	{
+		return S.SentBytes < 0.5f * Rate * S.DtSec;
+	}
+
+	/** Оконный минимум RTT (10 с): база для очереди */
+	void TrackMinRTT(const FSRGLinkSample& S);
+
+	float ClampRate(float R, const FSRGLinkSample& S) const;
+
+	FSRGBudgetParams Params;
+	float  Rate        = 0.f;
+	float  MinRTTms    = 0.f;
+	double MinRTTAge   = 0.0;
+};
@@ -0,0 +1,580 @@
+// SRG_CoreShim.h
+#pragma once
+
+// Минимальная прослойка под ядро spatial hash (SRG_SpatialHashCore.h).
+// В модуле — просто Core: TArray, FVector, FMath, ParallelFor. С SRG_STANDALONE
+// (Tests/SpatialHashCore, сборка CMake без движка) — те же имена поверх стандартной
+// библиотеки, ровно в том объёме, в каком их использует ядро. Семантика — как в UE:
+// TArray перемещает элементы побитово, куча — с предикатом «кто ближе к вершине».
+
+#include <atomic>
+#include <type_traits>
+
+#if !defined(SRG_STANDALONE)
+
+#include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include "Algo/BinarySearch.h"
+#include "Algo/Sort.h"
+
+#else // SRG_STANDALONE
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* ===================== Типы, макросы, константы ===================== */
+
+using int8   = std::int8_t;
+using int16  = std::int16_t;
+using int32  = std::int32_t;
+using int64  = std::int64_t;
+using uint8  = std::uint8_t;
+using uint16 = std::uint16_t;
+using uint32 = std::uint32_t;
+using uint64 = std::uint64_t;
+
+#ifndef FORCEINLINE
+	#define FORCEINLINE inline
+#endif
+#ifndef UE_BUILD_SHIPPING
+	#define UE_BUILD_SHIPPING 0
+#endif
+#define check(Expr) assert(Expr)
+
+constexpr int32 INDEX_NONE = -1;
+constexpr int64 MAX_int64  = std::numeric_limits<int64>::max();
+constexpr int64 MIN_int64  = std::numeric_limits<int64>::min();
+
+#define UE_SMALL_NUMBER       (1.e-8f)
+#define UE_KINDA_SMALL_NUMBER (1.e-4f)
+#define UE_PI                 (3.1415926535897932f)
+#define UE_DOUBLE_PI          (3.141592653589793238462643383279502884197169399)
+#define UE_DOUBLE_HALF_PI     (1.570796326794896619231321691639751442098584699)
+
+template<typename T>
+struct TNumericLimits
+{
+	static constexpr T Min()    { return std::numeric_limits<T>::min(); }
+	static constexpr T Max()    { return std::numeric_limits<T>::max(); }
+	static constexpr T Lowest() { return std::numeric_limits<T>::lowest(); }
+};
+
+template<typename T>
+FORCEINLINE std::remove_reference_t<T>&& MoveTemp(T&& V) { return static_cast<std::remove_reference_t<T>&&>(V); }
+
+template<typename T>
+FORCEINLINE void Swap(T& A, T& B) { T Tmp = MoveTemp(A); A = MoveTemp(B); B = MoveTemp(Tmp); }
+
+enum class EAllowShrinking : uint8 { No, Yes };
+
+struct FMemory
+{
+	static FORCEINLINE void* Memcpy(void* Dst, const void* Src, size_t Size) { return std::memcpy(Dst, Src, Size); }
+	static FORCEINLINE void* Memmove(void* Dst, const void* Src, size_t Size) { return std::memmove(Dst, Src, Size); }
+	static FORCEINLINE void* Memset(void* Dst, uint8 Value, size_t Size) { return std::memset(Dst, Value, Size); }
+	static FORCEINLINE void  Memzero(void* Dst, size_t Size) { std::memset(Dst, 0, Size); }
+};
+
+/* ===================== FMath ===================== */
+
+struct FMath
+{
+	template<typename T> static constexpr FORCEINLINE T Max(T A, T B) { return (A >= B) ? A : B; }
+	template<typename T> static constexpr FORCEINLINE T Min(T A, T B) { return (A <= B) ? A : B; }
+	template<typename T> static constexpr FORCEINLINE T Min3(T A, T B, T C) { return Min(Min(A, B), C); }
+	template<typename T> static constexpr FORCEINLINE T Max3(T A, T B, T C) { return Max(Max(A, B), C); }
+	template<typename T> static constexpr FORCEINLINE T Clamp(T X, T Lo, T Hi) { return (X < Lo) ? Lo : ((X < Hi) ? X : Hi); }
+	template<typename T> static constexpr FORCEINLINE T Abs(T A) { return (A < T(0)) ? -A : A; }
+	template<typename T> static constexpr FORCEINLINE T Square(T A) { return A * A; }
+
+	static FORCEINLINE float  Sqrt(float V)  { return std::sqrt(V); }
+	static FORCEINLINE double Sqrt(double V) { return std::sqrt(V); }
+	static FORCEINLINE float  Sin(float V)   { return std::sin(V); }
+	static FORCEINLINE double Sin(double V)  { return std::sin(V); }
+	static FORCEINLINE float  Cos(float V)   { return std::cos(V); }
+	static FORCEINLINE double Cos(double V)  { return std::cos(V); }
+	static FORCEINLINE float  Tan(float V)   { return std::tan(V); }
+	static FORCEINLINE double Tan(double V)  { return std::tan(V); }
+	static FORCEINLINE float  Acos(float V)  { return std::acos(V); }
+	static FORCEINLINE double Acos(double V) { return std::acos(V); }
+	static FORCEINLINE float  Asin(float V)  { return std::asin(V); }
+	static FORCEINLINE double Asin(double V) { return std::asin(V); }
+	static FORCEINLINE float  Loge(float V)  { return std::log(V); }
+	static FORCEINLINE double Loge(double V) { return std::log(V); }
+	static FORCEINLINE float  Pow(float A, float B)   { return std::pow(A, B); }
+	static FORCEINLINE double Pow(double A, double B) { return std::pow(A, B); }
+
+	static FORCEINLINE double FloorToDouble(double V) { return std::floor(V); }
+	static FORCEINLINE double RoundToDouble(double V) { return std::floor(V + 0.5); }
+	static FORCEINLINE int32  FloorToInt(float V)     { return int32(std::floor(V)); }
+	static FORCEINLINE int32  FloorToInt(double V)    { return int32(std::floor(V)); }
+	static FORCEINLINE int32  CeilToInt32(float V)    { return int32(std::ceil(V)); }
+	static FORCEINLINE int32  CeilToInt32(double V)   { return int32(std::ceil(V)); }
+	static FORCEINLINE uint32 FloorLog2(uint32 V)     { uint32 R = 0; while (V >>= 1) ++R; return R; }
+};
+
+/* ===================== Векторы ===================== */
+
+template<typename T>
+struct TVector
+{
+	T X, Y, Z;
+
+	static const TVector ZeroVector;
+	static const TVector OneVector;
+	static const TVector ForwardVector;
+	static const TVector UpVector;
+
+	TVector() = default;
+	constexpr explicit TVector(T V) : X(V), Y(V), Z(V) {}
+	constexpr TVector(T InX, T InY, T InZ) : X(InX), Y(InY), Z(InZ) {}
+	template<typename U, typename = std::enable_if_t<!std::is_same_v<T, U>>>
+	constexpr explicit TVector(const TVector<U>& V) : X(T(V.X)), Y(T(V.Y)), Z(T(V.Z)) {}
+
+	FORCEINLINE TVector operator+(const TVector& V) const { return TVector(X + V.X, Y + V.Y, Z + V.Z); }
+	FORCEINLINE TVector operator-(const TVector& V) const { return TVector(X - V.X, Y - V.Y, Z - V.Z); }
+	FORCEINLINE TVector operator*(const TVector& V) const { return TVector(X * V.X, Y * V.Y, Z * V.Z); }
+	FORCEINLINE TVector operator/(const TVector& V) const { return TVector(X / V.X, Y / V.Y, Z / V.Z); }
+	template<typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+	FORCEINLINE TVector operator*(S Scale) const { return TVector(X * T(Scale), Y * T(Scale), Z * T(Scale)); }
+	template<typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+	FORCEINLINE TVector operator/(S Scale) const { const T Inv = T(1) / T(Scale); return TVector(X * Inv, Y * Inv, Z * Inv); }
+	FORCEINLINE TVector operator-() const { return TVector(-X, -Y, -Z); }
+	FORCEINLINE T       operator|(const TVector& V) const { return DotProduct(*this, V); }
+	FORCEINLINE TVector operator^(const TVector& V) const { return CrossProduct(*this, V); }
+
+	FORCEINLINE TVector& operator+=(const TVector& V) { X += V.X; Y += V.Y; Z += V.Z; return *this; }
+	FORCEINLINE TVector& operator-=(const TVector& V) { X -= V.X; Y -= V.Y; Z -= V.Z; return *this; }
+	template<typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+	FORCEINLINE TVector& operator*=(S Scale) { X *= T(Scale); Y *= T(Scale); Z *= T(Scale); return *this; }
+	template<typename S, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+	FORCEINLINE TVector& operator/=(S Scale) { const T Inv = T(1) / T(Scale); X *= Inv; Y *= Inv; Z *= Inv; return *this; }
+
+	FORCEINLINE bool operator==(const TVector& V) const { return X == V.X && Y == V.Y && Z == V.Z; }
+	FORCEINLINE bool operator!=(const TVector& V) const { return !(*this == V); }
+
+	FORCEINLINE T& operator[](int32 i)       { return (&X)[i]; }
+	FORCEINLINE T  operator[](int32 i) const { return (&X)[i]; }
+
+	FORCEINLINE T SizeSquared() const { return X * X + Y * Y + Z * Z; }
+	FORCEINLINE T Size() const { return std::sqrt(SizeSquared()); }
+	FORCEINLINE bool IsZero() const { return X == T(0) && Y == T(0) && Z == T(0); }
+	FORCEINLINE bool IsNearlyZero(T Tol = T(UE_KINDA_SMALL_NUMBER)) const
+	{
+		return FMath::Abs(X) <= Tol && FMath::Abs(Y) <= Tol && FMath::Abs(Z) <= Tol;
+	}
+	FORCEINLINE T GetMin() const { return FMath::Min3(X, Y, Z); }
+	FORCEINLINE T GetMax() const { return FMath::Max3(X, Y, Z); }
+	FORCEINLINE TVector GetAbs() const { return TVector(FMath::Abs(X), FMath::Abs(Y), FMath::Abs(Z)); }
+	FORCEINLINE TVector ComponentMin(const TVector& V) const { return TVector(FMath::Min(X, V.X), FMath::Min(Y, V.Y), FMath::Min(Z, V.Z)); }
+	FORCEINLINE TVector ComponentMax(const TVector& V) const { return TVector(FMath::Max(X, V.X), FMath::Max(Y, V.Y), FMath::Max(Z, V.Z)); }
+
+	FORCEINLINE TVector GetSafeNormal(T Tolerance = T(UE_SMALL_NUMBER)) const
+	{
+		const T Sq = SizeSquared();
+		if (Sq == T(1)) return *this;
+		if (Sq < Tolerance) return TVector(T(0));
+		return *this * (T(1) / std::sqrt(Sq));
+	}
+
+	/** Два перпендикуляра к единичному вектору (как FVector::FindBestAxisVectors) */
+	void FindBestAxisVectors(TVector& Axis1, TVector& Axis2) const
+	{
+		const T NX = FMath::Abs(X), NY = FMath::Abs(Y), NZ = FMath::Abs(Z);
+		if (NZ > NX && NZ > NY) Axis1 = TVector(1, 0, 0);
+		else                    Axis1 = TVector(0, 0, 1);
+		Axis1 = (Axis1 - *this * DotProduct(Axis1, *this)).GetSafeNormal();
+		Axis2 = CrossProduct(Axis1, *this);
+	}
+
+	static FORCEINLINE T DotProduct(const TVector& A, const TVector& B) { return A.X * B.X + A.Y * B.Y + A.Z * B.Z; }
+	static FORCEINLINE TVector CrossProduct(const TVector& A, const TVector& B)
+	{
+		return TVector(A.Y * B.Z - A.Z * B.Y, A.Z * B.X - A.X * B.Z, A.X * B.Y - A.Y * B.X);
+	}
+	static FORCEINLINE T DistSquared(const TVector& A, const TVector& B) { return (A - B).SizeSquared(); }
+	static FORCEINLINE T Dist(const TVector& A, const TVector& B) { return (A - B).Size(); }
+};
+
+template<typename T> const TVector<T> TVector<T>::ZeroVector(T(0), T(0), T(0));
+template<typename T> const TVector<T> TVector<T>::OneVector(T(1), T(1), T(1));
+template<typename T> const TVector<T> TVector<T>::ForwardVector(T(1), T(0), T(0));
+template<typename T> const TVector<T> TVector<T>::UpVector(T(0), T(0), T(1));
+
+template<typename S, typename T, typename = std::enable_if_t<std::is_arithmetic_v<S>>>
+FORCEINLINE TVector<T> operator*(S Scale, const TVector<T>& V) { return V * Scale; }
+
+using FVector   = TVector<double>;
+using FVector3f = TVector<float>;
+using FVector3d = TVector<double>;
+
+template<typename T>
+struct TIntVector3
+{
+	T X, Y, Z;
+
+	static const TIntVector3 ZeroValue;
+
+	TIntVector3() = default;
+	constexpr explicit TIntVector3(T V) : X(V), Y(V), Z(V) {}
+	constexpr TIntVector3(T InX, T InY, T InZ) : X(InX), Y(InY), Z(InZ) {}
+
+	FORCEINLINE TIntVector3 operator+(const TIntVector3& V) const { return TIntVector3(X + V.X, Y + V.Y, Z + V.Z); }
+	FORCEINLINE TIntVector3 operator-(const TIntVector3& V) const { return TIntVector3(X - V.X, Y - V.Y, Z - V.Z); }
+	FORCEINLINE TIntVector3& operator+=(const TIntVector3& V) { X += V.X; Y += V.Y; Z += V.Z; return *this; }
+	FORCEINLINE TIntVector3& operator-=(const TIntVector3& V) { X -= V.X; Y -= V.Y; Z -= V.Z; return *this; }
+	FORCEINLINE bool operator==(const TIntVector3& V) const { return X == V.X && Y == V.Y && Z == V.Z; }
+	FORCEINLINE bool operator!=(const TIntVector3& V) const { return !(*this == V); }
+};
+
+template<typename T> const TIntVector3<T> TIntVector3<T>::ZeroValue(T(0), T(0), T(0));
+
+using FInt64Vector = TIntVector3<int64>;
+using FIntVector   = TIntVector3<int32>;
+
+/* ===================== Контейнеры ===================== */
+
+/** Тег аллокатора: в прослойке всё в куче, инлайн-ёмкость не нужна */
+template<int32 NumInlineElements>
+struct TInlineAllocator {};
+struct FDefaultAllocator {};
+
+template<typename T>
+class TArrayView
+{
+public:
+	using ElementType = T;
+
+	TArrayView() = default;
+	TArrayView(T* InData, int32 InNum) : Data(InData), ArrayNum(InNum) {}
+	template<typename ContainerType, typename = decltype(std::declval<ContainerType&>().GetData())>
+	TArrayView(ContainerType& C) : Data(C.GetData()), ArrayNum(C.Num()) {}
+	template<typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+	TArrayView(const TArrayView<U>& V) : Data(V.GetData()), ArrayNum(V.Num()) {}
+	TArrayView(std::initializer_list<std::remove_const_t<T>> List) : Data(List.begin()), ArrayNum(int32(List.size())) {}
+
+	FORCEINLINE T*    GetData() const { return Data; }
+	FORCEINLINE int32 Num() const { return ArrayNum; }
+	FORCEINLINE bool  IsEmpty() const { return ArrayNum == 0; }
+	FORCEINLINE bool  IsValidIndex(int32 i) const { return i >= 0 && i < ArrayNum; }
+	FORCEINLINE T&    operator[](int32 i) const { check(IsValidIndex(i)); return Data[i]; }
+	FORCEINLINE T*    begin() const { return Data; }
+	FORCEINLINE T*    end() const { return Data + ArrayNum; }
+
+private:
+	T*    Data     = nullptr;
+	int32 ArrayNum = 0;
+};
+
+template<typename T>
+using TConstArrayView = TArrayView<const T>;
+
+template<typename T>
+FORCEINLINE TArrayView<T> MakeArrayView(T* Data, int32 Num) { return TArrayView<T>(Data, Num); }
+
+/**
+ * TArray поверх malloc: как в UE, элементы переезжают при росте побитово
+ * (std::atomic в FSRGQueryCounters этого и требует — конструкторов переноса нет).
+ */
+template<typename T, typename AllocatorType = FDefaultAllocator>
+class TArray
+{
+public:
+	using ElementType = T;
+
+	TArray() = default;
+	TArray(std::initializer_list<T> List) { Reserve(int32(List.size())); for (const T& E : List) Add(E); }
+	TArray(const TArray& Other) { CopyFrom(Other); }
+	TArray(TArray&& Other) noexcept { Steal(Other); }
+	~TArray() { DestructRange(0, ArrayNum); std::free(Data); }
+
+	TArray& operator=(const TArray& Other)
+	{
+		if (this != &Other) { Reset(); CopyFrom(Other); }
+		return *this;
+	}
+	TArray& operator=(TArray&& Other) noexcept
+	{
+		if (this != &Other) { DestructRange(0, ArrayNum); std::free(Data); Data = nullptr; ArrayNum = ArrayMax = 0; Steal(Other); }
+		return *this;
+	}
+
+	FORCEINLINE T*       GetData()       { return Data; }
+	FORCEINLINE const T* GetData() const { return Data; }
+	FORCEINLINE int32 Num() const { return ArrayNum; }
+	FORCEINLINE int32 Max() const { return ArrayMax; }
+	FORCEINLINE bool  IsEmpty() const { return ArrayNum == 0; }
+	FORCEINLINE bool  IsValidIndex(int32 i) const { return i >= 0 && i < ArrayNum; }
+	FORCEINLINE size_t GetAllocatedSize() const { return size_t(ArrayMax) * sizeof(T); }
+
+	FORCEINLINE T&       operator[](int32 i)       { check(IsValidIndex(i)); return Data[i]; }
+	FORCEINLINE const T& operator[](int32 i) const { check(IsValidIndex(i)); return Data[i]; }
+	FORCEINLINE T&       Last(int32 FromEnd = 0)       { return (*this)[ArrayNum - 1 - FromEnd]; }
+	FORCEINLINE const T& Last(int32 FromEnd = 0) const { return (*this)[ArrayNum - 1 - FromEnd]; }
+
+	FORCEINLINE T*       begin()       { return Data; }
+	FORCEINLINE T*       end()         { return Data + ArrayNum; }
+	FORCEINLINE const T* begin() const { return Data; }
+	FORCEINLINE const T* end()   const { return Data + ArrayNum; }
+
+	void Reserve(int32 Number) { if (Number > ArrayMax) Realloc(Number); }
+
+	void Reset(int32 NewSize = 0)
+	{
+		DestructRange(0, ArrayNum);
+		ArrayNum = 0;
+		Reserve(NewSize);
+	}
+	void Empty(int32 Slack = 0)
+	{
+		DestructRange(0, ArrayNum);
+		ArrayNum = 0;
+		if (ArrayMax != Slack) Realloc(Slack);
+	}
+
+	void SetNum(int32 NewNum, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		if (NewNum > ArrayNum) AddDefaulted(NewNum - ArrayNum);
+		else { DestructRange(NewNum, ArrayNum); ArrayNum = NewNum; }
+	}
+	void SetNumZeroed(int32 NewNum, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		if (NewNum > ArrayNum) AddZeroed(NewNum - ArrayNum);
+		else { DestructRange(NewNum, ArrayNum); ArrayNum = NewNum; }
+	}
+	void SetNumUninitialized(int32 NewNum, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		if (NewNum > ArrayNum) AddUninitialized(NewNum - ArrayNum);
+		else { DestructRange(NewNum, ArrayNum); ArrayNum = NewNum; }
+	}
+
+	int32 AddUninitialized(int32 Count = 1)
+	{
+		const int32 Index = ArrayNum;
+		Grow(ArrayNum + Count);
+		ArrayNum += Count;
+		return Index;
+	}
+	int32 AddZeroed(int32 Count = 1)
+	{
+		const int32 Index = AddUninitialized(Count);
+		std::memset(static_cast<void*>(Data + Index), 0, size_t(Count) * sizeof(T));
+		return Index;
+	}
+	int32 AddDefaulted(int32 Count = 1)
+	{
+		const int32 Index = AddUninitialized(Count);
+		for (int32 i = Index; i < Index + Count; ++i) new (Data + i) T();
+		return Index;
+	}
+	T& AddDefaulted_GetRef() { return Data[AddDefaulted()]; }
+
+	template<typename... ArgsType>
+	int32 Emplace(ArgsType&&... Args)
+	{
+		// Аргумент может ссылаться внутрь массива: сначала конструируем, потом растём
+		T Tmp(std::forward<ArgsType>(Args)...);
+		const int32 Index = AddUninitialized(1);
+		new (Data + Index) T(MoveTemp(Tmp));
+		return Index;
+	}
+	FORCEINLINE int32 Add(const T& Item) { return Emplace(Item); }
+	FORCEINLINE int32 Add(T&& Item)      { return Emplace(MoveTemp(Item)); }
+	FORCEINLINE T&    Add_GetRef(const T& Item) { return Data[Emplace(Item)]; }
+	FORCEINLINE void  Push(const T& Item) { Add(Item); }
+
+	template<typename OtherAllocator>
+	void Append(const TArray<T, OtherAllocator>& Other) { Reserve(ArrayNum + Other.Num()); for (const T& E : Other) Add(E); }
+
+	void RemoveAt(int32 Index, int32 Count = 1, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		DestructRange(Index, Index + Count);
+		std::memmove(static_cast<void*>(Data + Index), Data + Index + Count, size_t(ArrayNum - Index - Count) * sizeof(T));
+		ArrayNum -= Count;
+	}
+	void RemoveAtSwap(int32 Index, int32 Count = 1, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		DestructRange(Index, Index + Count);
+		const int32 NumToMove = FMath::Min(Count, ArrayNum - Index - Count);
+		std::memcpy(static_cast<void*>(Data + Index), Data + ArrayNum - NumToMove, size_t(NumToMove) * sizeof(T));
+		ArrayNum -= Count;
+	}
+
+	template<typename PredType>
+	int32 RemoveAll(PredType&& Pred)
+	{
+		int32 Write = 0;
+		for (int32 Read = 0; Read < ArrayNum; ++Read)
+		{
+			if (Pred(Data[Read])) { Data[Read].~T(); continue; }
+			if (Write != Read) std::memcpy(static_cast<void*>(Data + Write), Data + Read, sizeof(T));
+			++Write;
+		}
+		const int32 Removed = ArrayNum - Write;
+		ArrayNum = Write;
+		return Removed;
+	}
+	int32 RemoveSwap(const T& Item)
+	{
+		int32 Removed = 0;
+		for (int32 i = ArrayNum - 1; i >= 0; --i)
+		{
+			if (Data[i] == Item) { RemoveAtSwap(i); ++Removed; }
+		}
+		return Removed;
+	}
+	bool RemoveSingleSwap(const T& Item)
+	{
+		const int32 i = Find(Item);
+		if (i == INDEX_NONE) return false;
+		RemoveAtSwap(i);
+		return true;
+	}
+
+	int32 Find(const T& Item) const
+	{
+		for (int32 i = 0; i < ArrayNum; ++i) if (Data[i] == Item) return i;
+		return INDEX_NONE;
+	}
+	bool Contains(const T& Item) const { return Find(Item) != INDEX_NONE; }
+
+	bool operator==(const TArray& Other) const
+	{
+		return ArrayNum == Other.ArrayNum && std::equal(begin(), end(), Other.begin());
+	}
+	bool operator!=(const TArray& Other) const { return !(*this == Other); }
+
+	void Sort() { std::sort(begin(), end()); }
+	template<typename PredType>
+	void Sort(PredType&& Pred) { std::sort(begin(), end(), Pred); }
+
+	// Куча UE: Pred(A, B) == true — A ближе к вершине
+	template<typename PredType>
+	int32 HeapPush(T&& Item, PredType&& Pred)
+	{
+		Add(MoveTemp(Item));
+		std::push_heap(begin(), end(), [&Pred](const T& A, const T& B){ return Pred(B, A); });
+		return ArrayNum - 1;
+	}
+	template<typename PredType>
+	int32 HeapPush(const T& Item, PredType&& Pred) { T Tmp(Item); return HeapPush(MoveTemp(Tmp), Pred); }
+	template<typename PredType>
+	void HeapPopDiscard(PredType&& Pred, EAllowShrinking = EAllowShrinking::Yes)
+	{
+		std::pop_heap(begin(), end(), [&Pred](const T& A, const T& B){ return Pred(B, A); });
+		RemoveAt(ArrayNum - 1);
+	}
+	FORCEINLINE const T& HeapTop() const { return Data[0]; }
+	FORCEINLINE T&       HeapTop()       { return Data[0]; }
+
+private:
+	void Grow(int32 MinNum)
+	{
+		if (MinNum > ArrayMax) Realloc(FMath::Max(MinNum, ArrayMax + ArrayMax / 2 + 4));
+	}
+	void Realloc(int32 NewMax)
+	{
+		if (NewMax == 0) { std::free(Data); Data = nullptr; ArrayMax = 0; return; }
+		T* NewData = static_cast<T*>(std::realloc(static_cast<void*>(Data), size_t(NewMax) * sizeof(T)));
+		if (!NewData) throw std::bad_alloc();
+		Data = NewData;
+		ArrayMax = NewMax;
+	}
+	void DestructRange(int32 From, int32 To)
+	{
+		if constexpr (!std::is_trivially_destructible_v<T>)
+		{
+			for (int32 i = From; i < To; ++i) Data[i].~T();
+		}
+	}
+	void CopyFrom(const TArray& Other)
+	{
+		Reserve(Other.ArrayNum);
+		for (int32 i = 0; i < Other.ArrayNum; ++i) new (Data + i) T(Other.Data[i]);
+		ArrayNum = Other.ArrayNum;
+	}
+	void Steal(TArray& Other)
+	{
+		Data = Other.Data; ArrayNum = Other.ArrayNum; ArrayMax = Other.ArrayMax;
+		Other.Data = nullptr; Other.ArrayNum = Other.ArrayMax = 0;
+	}
+
+	T*    Data     = nullptr;
+	int32 ArrayNum = 0;
+	int32 ArrayMax = 0;
+};
+
+/* ===================== Algo ===================== */
+
+namespace Algo
+{
+	template<typename RangeType, typename PredType>
+	FORCEINLINE void Sort(RangeType&& Range, PredType&& Pred) { std::sort(Range.begin(), Range.end(), Pred); }
+
+	template<typename RangeType>
+	FORCEINLINE void Sort(RangeType&& Range) { std::sort(Range.begin(), Range.end()); }
+
+	/** Индекс первого элемента >= Value */
+	template<typename RangeType, typename ValueType>
+	FORCEINLINE int32 LowerBound(const RangeType& Range, const ValueType& Value)
+	{
+		return int32(std::lower_bound(Range.begin(), Range.end(), Value) - Range.begin());
+	}
+
+	/** Индекс элемента == Value в отсортированном диапазоне или INDEX_NONE */
+	template<typename RangeType, typename ValueType>
+	FORCEINLINE int32 BinarySearch(const RangeType& Range, const ValueType& Value)
+	{
+		const int32 Idx = LowerBound(Range, Value);
+		return (Idx < int32(Range.end() - Range.begin()) && !(Value < Range.begin()[Idx])) ? Idx : INDEX_NONE;
+	}
+}
+
+/* ===================== ParallelFor ===================== */
+
+enum class EParallelForFlags : uint8 { None = 0, ForceSingleThread = 1 };
+
+struct FPlatformMisc
+{
+	static int32 NumberOfCores() { return FMath::Max(1, int32(std::thread::hardware_concurrency())); }
+	static int32 NumberOfWorkerThreadsToSpawn() { return FMath::Max(1, NumberOfCores() - 1); }
+};
+
+/** Как ParallelFor UE: Body(i) для i в [0, Num), индексы раздаются из общего счётчика */
+template<typename BodyType>
+void ParallelFor(int32 Num, BodyType&& Body, EParallelForFlags Flags = EParallelForFlags::None)
+{
+	const int32 NumThreads = (Flags == EParallelForFlags::ForceSingleThread)
+		? 1 : FMath::Min(Num, FPlatformMisc::NumberOfWorkerThreadsToSpawn() + 1);
+	if (NumThreads <= 1)
+	{
+		for (int32 i = 0; i < Num; ++i) Body(i);
+		return;
+	}
+
+	std::atomic<int32> Next{ 0 };
+	auto Worker = [&]()
+	{
+		for (int32 i = Next.fetch_add(1, std::memory_order_relaxed); i < Num; i = Next.fetch_add(1, std::memory_order_relaxed))
+		{
+			Body(i);
+		}
+	};
+	std::vector<std::thread> Threads;
+	Threads.reserve(size_t(NumThreads - 1));
+	for (int32 t = 1; t < NumThreads; ++t) Threads.emplace_back(Worker);
+	Worker();  // вызывающий поток тоже работает, как в UE
+	for (std::thread& T : Threads) T.join();
+}
+
+#endif // SRG_STANDALONE
@@ -2,4 +2,891 @@
 
 
 #include "SRG_SpatialHash3D.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Math/RandomStream.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "Misc/AutomationTest.h"
 
+DEFINE_LOG_CATEGORY_STATIC(LogSpatialHash3D, Log, All);
+
+DEFINE_STAT(STAT_SRG_Refresh);
+DEFINE_STAT(STAT_SRG_Query);
+DEFINE_STAT(STAT_SRG_Cells);
+DEFINE_STAT(STAT_SRG_Slots);
+DEFINE_STAT(STAT_SRG_Entries);
+DEFINE_STAT(STAT_SRG_MaxPerCell);
+DEFINE_STAT(STAT_SRG_MeanPerCell);
+DEFINE_STAT(STAT_SRG_Reads);
+DEFINE_STAT(STAT_SRG_Relinks);
+DEFINE_STAT(STAT_SRG_Dropped);
+DEFINE_STAT(STAT_SRG_Queries);
+DEFINE_STAT(STAT_SRG_CellsVisited);
+DEFINE_STAT(STAT_SRG_CellsHit);
+DEFINE_STAT(STAT_SRG_ActorsTested);
+DEFINE_STAT(STAT_SRG_ActorsAccepted);
+
+// Те же величины — дорожками в Unreal Insights (-trace=counters), без stat-системы
+TRACE_DECLARE_INT_COUNTER(SRG_Cells,          TEXT("SpatialHash/Cells"));
+TRACE_DECLARE_INT_COUNTER(SRG_MaxPerCell,     TEXT("SpatialHash/MaxPerCell"));
+TRACE_DECLARE_INT_COUNTER(SRG_Relinks,        TEXT("SpatialHash/Relinks"));
+TRACE_DECLARE_INT_COUNTER(SRG_CellsVisited,   TEXT("SpatialHash/CellsVisited"));
+TRACE_DECLARE_INT_COUNTER(SRG_ActorsTested,   TEXT("SpatialHash/ActorsTested"));
+TRACE_DECLARE_INT_COUNTER(SRG_ActorsAccepted, TEXT("SpatialHash/ActorsAccepted"));
+
+/* ===================== Инструментирование ===================== */
+
+void USRG_SpatialHash3D::UpdateFrameStats()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(SRG_UpdateFrameStats);
+
+	FSRGSpatialFrameStats S;
+	Levels.GetBase().GetOccupancy(S.Occupancy);
+	for (int32 l = 0; l < Levels.NumLevels(); ++l)
+	{
+		const FSRGRefreshStats& R = Levels.GetLevel(l).GetLastRefreshStats();
+		S.Refresh.Reads   += R.Reads;
+		S.Refresh.Relinks += R.Relinks;
+		S.Refresh.Dropped += R.Dropped;
+	}
+	S.Queries = Levels.ConsumeQueryCounters();  // запросы прошлого кадра — до этого Refresh
+	FrameStats = S;
+
+	SET_DWORD_STAT(STAT_SRG_Cells,          S.Occupancy.NumCells);
+	SET_DWORD_STAT(STAT_SRG_Slots,          S.Occupancy.NumSlots);
+	SET_DWORD_STAT(STAT_SRG_Entries,        S.Occupancy.NumEntries);
+	SET_DWORD_STAT(STAT_SRG_MaxPerCell,     S.Occupancy.MaxPerCell);
+	SET_FLOAT_STAT(STAT_SRG_MeanPerCell,    S.Occupancy.GetMeanPerCell());
+	SET_DWORD_STAT(STAT_SRG_Reads,          S.Refresh.Reads);
+	SET_DWORD_STAT(STAT_SRG_Relinks,        S.Refresh.Relinks);
+	SET_DWORD_STAT(STAT_SRG_Dropped,        S.Refresh.Dropped);
+	SET_DWORD_STAT(STAT_SRG_Queries,        uint32(S.Queries.Queries));
+	SET_DWORD_STAT(STAT_SRG_CellsVisited,   uint32(S.Queries.CellsVisited));
+	SET_DWORD_STAT(STAT_SRG_CellsHit,       uint32(S.Queries.CellsHit));
+	SET_DWORD_STAT(STAT_SRG_ActorsTested,   uint32(S.Queries.Tested));
+	SET_DWORD_STAT(STAT_SRG_ActorsAccepted, uint32(S.Queries.Accepted));
+
+	TRACE_COUNTER_SET(SRG_Cells,          S.Occupancy.NumCells);
+	TRACE_COUNTER_SET(SRG_MaxPerCell,     S.Occupancy.MaxPerCell);
+	TRACE_COUNTER_SET(SRG_Relinks,        S.Refresh.Relinks);
+	TRACE_COUNTER_SET(SRG_CellsVisited,   S.Queries.CellsVisited);
+	TRACE_COUNTER_SET(SRG_ActorsTested,   S.Queries.Tested);
+	TRACE_COUNTER_SET(SRG_ActorsAccepted, S.Queries.Accepted);
+}
+
+void USRG_SpatialHash3D::WriteCellsCsv(int32 Level, FString& Out) const
+{
+	Level = FMath::Clamp(Level, 0, Levels.NumLevels() - 1);
+	const FCore& L = Levels.GetLevel(Level);
+	const double Half = L.GetCellSize() * 0.5;
+
+	Out.Reset();
+	Out += FString::Printf(TEXT("Level,CellMeters,CellX,CellY,CellZ,CenterX,CenterY,CenterZ,Count,NPCShip,PlayerShip,Projectile,Static,Other\n"));
+	L.ForEachCellInfo([&](const FInt64Vector& Cell, const FVector& Corner, TConstArrayView<uint8> Cats)
+	{
+		int32 ByCat[5] = {};
+		for (const uint8 C : Cats)
+		{
+			++ByCat[FMath::Min<int32>(C, 4)];
+		}
+		const FVector Center = Corner + FVector(Half);
+		Out += FString::Printf(TEXT("%d,%.0f,%lld,%lld,%lld,%.0f,%.0f,%.0f,%d,%d,%d,%d,%d,%d\n"),
+			Level, L.GetCellSize() / 100.0, Cell.X, Cell.Y, Cell.Z, Center.X, Center.Y, Center.Z,
+			Cats.Num(), ByCat[0], ByCat[1], ByCat[2], ByCat[3], ByCat[4]);
+	});
+}
+
+/* ===================== Бенчмарк таблицы ячеек ===================== */
+
+namespace SRGBench
+{
+	/** Эталон: прежняя раскладка TMap<ячейка, TArray<...>> с бакетом на ячейку */
+	struct FLegacyTMapCells
+	{
+		TMap<FInt64Vector, TArray<int32>> Buckets;
+
+		void Add(const FInt64Vector& C, int32 Id)    { Buckets.FindOrAdd(C).Add(Id); }
+		void Remove(const FInt64Vector& C, int32 Id)
+		{
+			if (TArray<int32>* B = Buckets.Find(C))
+			{
+				B->RemoveSingleSwap(Id);
+				if (B->Num() == 0) Buckets.Remove(C);
+			}
+		}
+		FORCEINLINE const TArray<int32>* Find(const FInt64Vector& C) const { return Buckets.Find(C); }
+	};
+
+	/** Флот: несколько эскадр с гауссовым разбросом вокруг центров */
+	static void MakeFleet(int32 Num, double SpreadUU, FRandomStream& Rng, TArray<FVector>& Out)
+	{
+		const int32 NumSquads = FMath::Max(1, Num / 500);
+		TArray<FVector> Centers;
+		for (int32 i = 0; i < NumSquads; ++i)
+		{
+			Centers.Add(Rng.GetUnitVector() * Rng.FRandRange(0.f, 1.f) * SpreadUU * 4.0);
+		}
+
+		Out.SetNumUninitialized(Num);
+		for (int32 i = 0; i < Num; ++i)
+		{
+			// Box–Muller по каждой оси
+			const FVector& C = Centers[i % NumSquads];
+			auto Gauss = [&Rng]()
+			{
+				const float U1 = FMath::Max(1e-6f, Rng.GetFraction());
+				const float U2 = Rng.GetFraction();
+				return FMath::Sqrt(-2.f * FMath::Loge(U1)) * FMath::Cos(2.f * PI * U2);
+			};
+			Out[i] = C + FVector(Gauss(), Gauss(), Gauss()) * SpreadUU;
+		}
+	}
+
+	FORCEINLINE FInt64Vector ToCell(const FVector& P, double InvCellUU)
+	{
+		return FInt64Vector(
+			int64(FMath::FloorToDouble(P.X * InvCellUU)),
+			int64(FMath::FloorToDouble(P.Y * InvCellUU)),
+			int64(FMath::FloorToDouble(P.Z * InvCellUU)));
+	}
+
+	/** Позиция относительно угла ячейки (сетка с началом в нуле) — как в SoA хэша */
+	FORCEINLINE FVector3f ToCellLocal(const FVector& P, const FInt64Vector& C, double CellUU)
+	{
+		return FVector3f(P - SRG_CellCorner(C, CellUU));
+	}
+
+	struct FResult
+	{
+		double BuildMs  = 0.0;
+		double UpdateMs = 0.0;
+		double QueryMs  = 0.0;
+		int64  Hits     = 0;
+	};
+
+	/**
+	 * Общий прогон: Build → Update (сдвиг флота) → Query по сферам вокруг случайных кораблей.
+	 * Refresh(Cell, Id, Pos) — корабль сдвинулся, но остался в ячейке.
+	 * Query(Cell, Pos, Center, RadiusSq) возвращает число попаданий в ячейке.
+	 */
+	template<typename AddFn, typename RemoveFn, typename RefreshFn, typename QueryFn>
+	static FResult Run(TArray<FVector> Pos, const TArray<FVector>& Delta, double InvCellUU,
+	                   const TArray<int32>& Viewers, double RadiusUU,
+	                   AddFn&& Add, RemoveFn&& Remove, RefreshFn&& Refresh, QueryFn&& Query)
+	{
+		FResult R;
+
+		double T0 = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Pos.Num(); ++i)
+		{
+			Add(ToCell(Pos[i], InvCellUU), i, Pos[i]);
+		}
+		R.BuildMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		T0 = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Pos.Num(); ++i)
+		{
+			const FInt64Vector OldC = ToCell(Pos[i], InvCellUU);
+			Pos[i] += Delta[i];
+			const FInt64Vector NewC = ToCell(Pos[i], InvCellUU);
+			if (OldC != NewC)
+			{
+				Remove(OldC, i);
+				Add(NewC, i, Pos[i]);
+			}
+			else
+			{
+				Refresh(NewC, i, Pos[i]);
+			}
+		}
+		R.UpdateMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		const double RadiusSq = RadiusUU * RadiusUU;
+		T0 = FPlatformTime::Seconds();
+		for (int32 v : Viewers)
+		{
+			const FVector Center = Pos[v];
+			const FInt64Vector MinC = ToCell(Center - FVector(RadiusUU), InvCellUU);
+			const FInt64Vector MaxC = ToCell(Center + FVector(RadiusUU), InvCellUU);
+			for (int64 cz = MinC.Z; cz <= MaxC.Z; ++cz)
+			for (int64 cy = MinC.Y; cy <= MaxC.Y; ++cy)
+			for (int64 cx = MinC.X; cx <= MaxC.X; ++cx)
+			{
+				R.Hits += Query(FInt64Vector(cx, cy, cz), Pos, Center, RadiusSq);
+			}
+		}
+		R.QueryMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+		return R;
+	}
+
+	static void RunSize(int32 NumShips, double CellUU, double RadiusUU, int32 NumQueries)
+	{
+		FRandomStream Rng(1337 + NumShips);
+
+		TArray<FVector> Pos;
+		MakeFleet(NumShips, /*SpreadUU*/ 2.0 * RadiusUU, Rng, Pos);
+
+		// Сдвиг за кадр ~ несколько км/с на 4 Гц — часть кораблей меняет ячейку
+		TArray<FVector> Delta;
+		Delta.SetNumUninitialized(NumShips);
+		for (FVector& D : Delta) D = Rng.GetUnitVector() * Rng.FRandRange(0.f, 0.05f) * CellUU;
+
+		TArray<int32> Viewers;
+		for (int32 q = 0; q < NumQueries; ++q) Viewers.Add(Rng.RandHelper(NumShips));
+
+		const double InvCellUU = 1.0 / CellUU;
+
+		FLegacyTMapCells Legacy;
+		const FResult L = Run(Pos, Delta, InvCellUU, Viewers, RadiusUU,
+			[&](const FInt64Vector& C, int32 Id, const FVector&){ Legacy.Add(C, Id); },
+			[&](const FInt64Vector& C, int32 Id){ Legacy.Remove(C, Id); },
+			[&](const FInt64Vector&, int32, const FVector&){},
+			[&](const FInt64Vector& C, const TArray<FVector>& P, const FVector& Center, double RadiusSq)
+			{
+				int32 Hits = 0;
+				if (const TArray<int32>* B = Legacy.Find(C))
+					for (int32 Id : *B) Hits += (FVector::DistSquared(P[Id], Center) <= RadiusSq) ? 1 : 0;
+				return Hits;
+			});
+
+		TSRGCellTable<int32> Flat;
+		const FResult F = Run(Pos, Delta, InvCellUU, Viewers, RadiusUU,
+			[&](const FInt64Vector& C, int32 Id, const FVector& P){ Flat.Add(C, Id, ToCellLocal(P, C, CellUU)); },
+			[&](const FInt64Vector& C, int32 Id){ Flat.Remove(C, Id); },
+			[&](const FInt64Vector& C, int32 Id, const FVector& P)
+			{
+				const int32 Slot  = Flat.FindSlot(C);
+				const int32 Start = Flat.GetSlot(Slot).Start;
+				const int32 End   = Start + Flat.GetSlot(Slot).Num;
+				for (int32 Idx = Start; Idx < End; ++Idx)
+				{
+					if (Flat.GetItem(Idx) == Id) { Flat.SetLocalPosition(Idx, ToCellLocal(P, C, CellUU)); break; }
+				}
+			},
+			[&](const FInt64Vector& C, const TArray<FVector>&, const FVector& Center, double RadiusSq)
+			{
+				// SoA-кэш таблицы: позиции не читаются из внешнего массива
+				const int32 Slot = Flat.FindSlot(C);
+				if (Slot == INDEX_NONE) return 0;
+				const float* PX = Flat.GetSlabX();
+				const float* PY = Flat.GetSlabY();
+				const float* PZ = Flat.GetSlabZ();
+				const FVector3f L  = ToCellLocal(Center, C, CellUU);
+				const float     RSq = float(RadiusSq);
+				const int32 Start = Flat.GetSlot(Slot).Start;
+				const int32 End   = Start + Flat.GetSlot(Slot).Num;
+				int32 Hits = 0;
+				for (int32 Idx = Start; Idx < End; ++Idx)
+				{
+					const float dx = PX[Idx] - L.X, dy = PY[Idx] - L.Y, dz = PZ[Idx] - L.Z;
+					Hits += (dx*dx + dy*dy + dz*dz <= RSq) ? 1 : 0;
+				}
+				return Hits;
+			});
+
+		UE_LOG(LogSpatialHash3D, Display,
+			TEXT("[BENCH] N=%6d Cells=%5d | Build  TMap=%7.2f ms  Flat=%7.2f ms (x%.2f)"),
+			NumShips, Flat.Num(), L.BuildMs, F.BuildMs, L.BuildMs / FMath::Max(1e-6, F.BuildMs));
+		UE_LOG(LogSpatialHash3D, Display,
+			TEXT("[BENCH] N=%6d            | Update TMap=%7.2f ms  Flat=%7.2f ms (x%.2f)"),
+			NumShips, L.UpdateMs, F.UpdateMs, L.UpdateMs / FMath::Max(1e-6, F.UpdateMs));
+		UE_LOG(LogSpatialHash3D, Display,
+			TEXT("[BENCH] N=%6d Q=%d      | Query  TMap=%7.2f ms  Flat=%7.2f ms (x%.2f) Hits=%lld/%lld"),
+			NumShips, NumQueries, L.QueryMs, F.QueryMs, L.QueryMs / FMath::Max(1e-6, F.QueryMs),
+			(long long)L.Hits, (long long)F.Hits);
+	}
+
+	/** Сфера против таблицы: полный AABB-скан или скан с классификацией кубов ячеек */
+	struct FSphereScanStats
+	{
+		double Ms      = 0.0;
+		int64  Lookups = 0;
+		int64  Tests   = 0;
+		int64  Hits    = 0;
+	};
+
+	static FSphereScanStats ScanNaive(const TSRGCellTable<int32>& T, const TArray<FVector>& Centers, double RadiusUU, double CellUU)
+	{
+		FSphereScanStats S;
+		const double InvCellUU = 1.0 / CellUU;
+		const float  RadiusSq  = float(RadiusUU * RadiusUU);
+		const float* PX = T.GetSlabX();
+		const float* PY = T.GetSlabY();
+		const float* PZ = T.GetSlabZ();
+
+		const double T0 = FPlatformTime::Seconds();
+		for (const FVector& Center : Centers)
+		{
+			const FInt64Vector MinC = ToCell(Center - FVector(RadiusUU), InvCellUU);
+			const FInt64Vector MaxC = ToCell(Center + FVector(RadiusUU), InvCellUU);
+			for (int64 cz = MinC.Z; cz <= MaxC.Z; ++cz)
+			for (int64 cy = MinC.Y; cy <= MaxC.Y; ++cy)
+			for (int64 cx = MinC.X; cx <= MaxC.X; ++cx)
+			{
+				++S.Lookups;
+				const FInt64Vector Cell(cx, cy, cz);
+				const int32 Slot = T.FindSlot(Cell);
+				if (Slot == INDEX_NONE) continue;
+				const FVector3f L = ToCellLocal(Center, Cell, CellUU);
+				const int32 Start = T.GetSlot(Slot).Start;
+				const int32 End   = Start + T.GetSlot(Slot).Num;
+				for (int32 Idx = Start; Idx < End; ++Idx)
+				{
+					++S.Tests;
+					const float dx = PX[Idx] - L.X, dy = PY[Idx] - L.Y, dz = PZ[Idx] - L.Z;
+					S.Hits += (dx*dx + dy*dy + dz*dz <= RadiusSq) ? 1 : 0;
+				}
+			}
+		}
+		S.Ms = (FPlatformTime::Seconds() - T0) * 1000.0;
+		return S;
+	}
+
+	static FSphereScanStats ScanClassified(const TSRGCellTable<int32>& T, const TArray<FVector>& Centers, double RadiusUU, double CellUU)
+	{
+		FSphereScanStats S;
+		const float  RadiusSq = float(RadiusUU * RadiusUU);
+		const float* PX = T.GetSlabX();
+		const float* PY = T.GetSlabY();
+		const float* PZ = T.GetSlabZ();
+
+		const double T0 = FPlatformTime::Seconds();
+		for (const FVector& Center : Centers)
+		{
+			SRG_ForEachSphereCell(Center, RadiusUU, CellUU, /*LooseUU*/ 0.0, [&](const FInt64Vector& Cell, bool bFullyInside)
+			{
+				++S.Lookups;
+				const int32 Slot = T.FindSlot(Cell);
+				if (Slot == INDEX_NONE) return;
+				const int32 Start = T.GetSlot(Slot).Start;
+				const int32 End   = Start + T.GetSlot(Slot).Num;
+				if (bFullyInside)
+				{
+					S.Hits += End - Start;
+					return;
+				}
+				const FVector3f L = ToCellLocal(Center, Cell, CellUU);
+				for (int32 Idx = Start; Idx < End; ++Idx)
+				{
+					++S.Tests;
+					const float dx = PX[Idx] - L.X, dy = PY[Idx] - L.Y, dz = PZ[Idx] - L.Z;
+					S.Hits += (dx*dx + dy*dy + dz*dz <= RadiusSq) ? 1 : 0;
+				}
+			});
+		}
+		S.Ms = (FPlatformTime::Seconds() - T0) * 1000.0;
+		return S;
+	}
+
+	/** Свип по отношению CellSize/Radius при фиксированном флоте и радиусе */
+	static void RunRatioSweep(int32 NumShips, double RadiusUU, int32 NumQueries)
+	{
+		FRandomStream Rng(4242 + NumShips);
+
+		TArray<FVector> Pos;
+		MakeFleet(NumShips, /*SpreadUU*/ 2.0 * RadiusUU, Rng, Pos);
+
+		TArray<FVector> Centers;
+		for (int32 q = 0; q < NumQueries; ++q) Centers.Add(Pos[Rng.RandHelper(NumShips)]);
+
+		for (double Ratio : { 4.0, 2.0, 1.0, 0.5, 0.25, 0.1, 0.05 })
+		{
+			const double CellUU    = RadiusUU * Ratio;
+			const double InvCellUU = 1.0 / CellUU;
+
+			TSRGCellTable<int32> T;
+			for (int32 i = 0; i < Pos.Num(); ++i)
+			{
+				const FInt64Vector C = ToCell(Pos[i], InvCellUU);
+				T.Add(C, i, ToCellLocal(Pos[i], C, CellUU));
+			}
+			T.Compact();
+
+			const FSphereScanStats N = ScanNaive(T, Centers, RadiusUU, CellUU);
+			const FSphereScanStats C = ScanClassified(T, Centers, RadiusUU, CellUU);
+
+			UE_LOG(LogSpatialHash3D, Display,
+				TEXT("[BENCH] Cell/R=%5.2f Cells=%6d | AABB %8.3f ms (lookups=%lld tests=%lld) | Classified %8.3f ms (lookups=%lld tests=%lld) x%.2f Hits=%lld/%lld"),
+				Ratio, T.Num(),
+				N.Ms, (long long)N.Lookups, (long long)N.Tests,
+				C.Ms, (long long)C.Lookups, (long long)C.Tests,
+				N.Ms / FMath::Max(1e-6, C.Ms),
+				(long long)N.Hits, (long long)C.Hits);
+		}
+	}
+
+	/** Синтетический флот для ядра TSpatialHash3D: хэндл — индекс корабля, без UObject */
+	struct FBenchShip
+	{
+		FVector Pos = FVector::ZeroVector;
+		FVector Vel = FVector::ZeroVector;
+	};
+
+	struct FBenchFleetPolicy
+	{
+		using FResolved = const FBenchShip*;
+
+		const TArray<FBenchShip>* Ships = nullptr;
+
+		FORCEINLINE const FBenchShip* Resolve(int32 H) const { return Ships->IsValidIndex(H) ? &(*Ships)[H] : nullptr; }
+		FORCEINLINE FVector GetLocation(const FBenchShip* S) const { return S->Pos; }
+		FORCEINLINE FVector GetVelocity(const FBenchShip* S) const { return S->Vel; }
+	};
+
+	/** Пропускная способность ядра: вставка, Refresh после шага флота, сфера, конус обзора, KNN */
+	static void RunCore(int32 NumShips, double CellUU, double RadiusUU, int32 NumQueries, int32 K)
+	{
+		FRandomStream Rng(9001 + NumShips);
+
+		TArray<FVector> Pos;
+		MakeFleet(NumShips, /*SpreadUU*/ 2.0 * RadiusUU, Rng, Pos);
+
+		// Скорости — как сдвиг в RunSize: до 5% ячейки за шаг 0.25 с
+		constexpr double StepSec = 0.25;
+		TArray<FBenchShip> Ships;
+		Ships.SetNum(NumShips);
+		for (int32 i = 0; i < NumShips; ++i)
+		{
+			Ships[i].Pos = Pos[i];
+			Ships[i].Vel = Rng.GetUnitVector() * Rng.FRandRange(0.f, 0.05f) * CellUU / StepSec;
+		}
+
+		TArray<int32> Viewers;
+		for (int32 q = 0; q < NumQueries; ++q) Viewers.Add(Rng.RandHelper(NumShips));
+
+		FBenchFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		TSpatialHash3D<int32, FBenchFleetPolicy> Hash(Policy);
+		Hash.Init(float(CellUU));
+
+		double T0 = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NumShips; ++i) Hash.Add(i);
+		const double InsertMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		// Первый Refresh — полный проход; второй — только «грязные» записи
+		Hash.Refresh(0.0);
+		for (FBenchShip& S : Ships) S.Pos += S.Vel * StepSec;
+		T0 = FPlatformTime::Seconds();
+		Hash.Refresh(StepSec);
+		const double RefreshMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		TArray<const FBenchShip*> Out;
+		int64 SphereHits = 0;
+		T0 = FPlatformTime::Seconds();
+		for (int32 v : Viewers)
+		{
+			Hash.QuerySphere(Ships[v].Pos, RadiusUU, Out);
+			SphereHits += Out.Num();
+		}
+		const double SphereMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		// Конус ±60° (типичный FOV*1.5/2) в случайную сторону, тот же радиус
+		using FViewHit = TSpatialHash3D<int32, FBenchFleetPolicy>::FViewHit;
+		TArray<FViewHit> ConeOut;
+		int64 ConeHits = 0;
+		T0 = FPlatformTime::Seconds();
+		for (int32 v : Viewers)
+		{
+			Hash.QueryCone(Ships[v].Pos, Rng.GetUnitVector(), FMath::DegreesToRadians(60.f), RadiusUU, ConeOut);
+			ConeHits += ConeOut.Num();
+		}
+		const double ConeMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		FSRGKnnScratch KnnScratch;
+		int64 KnnHits = 0;
+		T0 = FPlatformTime::Seconds();
+		for (int32 v : Viewers)
+		{
+			Hash.QueryKNearest(Ships[v].Pos, K, RadiusUU, Out, KnnScratch);
+			KnnHits += Out.Num();
+		}
+		const double KnnMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+		const double PerShip  = 1e6 / double(FMath::Max(1, NumShips));
+		const double PerQuery = 1e3 / double(FMath::Max(1, NumQueries));
+		UE_LOG(LogSpatialHash3D, Display,
+			TEXT("[BENCH] Core N=%6d | Insert %7.2f ms (%6.0f ns/ship) | Refresh %7.2f ms (%6.0f ns/ship) | Sphere %7.3f us/q Hits=%lld | Cone60 %7.3f us/q Hits=%lld | KNN(K=%d) %7.3f us/q Hits=%lld"),
+			NumShips, InsertMs, InsertMs * PerShip, RefreshMs, RefreshMs * PerShip,
+			SphereMs * PerQuery, (long long)SphereHits, ConeMs * PerQuery, (long long)ConeHits,
+			K, KnnMs * PerQuery, (long long)KnnHits);
+	}
+
+	/**
+	 * Многоуровневый индекс против одной сетки: одни и те же сферы смесей радиусов
+	 * (AlwaysInclude ~300 м, ближний бой ~5 км, отсечка ~100 км и всё вперемешку)
+	 * на конфигурациях уровней Levels x Factor. Hits должны совпадать между строками.
+	 */
+	static void RunLevels(int32 NumShips, double CellUU, double SpreadUU, int32 NumQueries)
+	{
+		FRandomStream Rng(31337 + NumShips);
+
+		TArray<FVector> Pos;
+		MakeFleet(NumShips, SpreadUU, Rng, Pos);
+
+		constexpr double StepSec = 0.25;
+		TArray<FBenchShip> Ships;
+		Ships.SetNum(NumShips);
+		for (int32 i = 0; i < NumShips; ++i)
+		{
+			Ships[i].Pos = Pos[i];
+			Ships[i].Vel = Rng.GetUnitVector() * Rng.FRandRange(0.f, 30000.f);  // до 300 м/с
+		}
+
+		TArray<int32> Viewers;
+		for (int32 q = 0; q < NumQueries; ++q) Viewers.Add(Rng.RandHelper(NumShips));
+
+		struct FMix { const TCHAR* Name; TArray<double> RadiiUU; };
+		const FMix Mixes[] = {
+			{ TEXT("Small  300m"), { 30000.0 } },
+			{ TEXT("Mid     5km"), { 500000.0 } },
+			{ TEXT("Large 100km"), { 10000000.0 } },
+			{ TEXT("Mixed      "), { 30000.0, 500000.0, 10000000.0, 30000.0, 30000.0 } } };
+
+		const FIntPoint Configs[] = { { 1, 8 }, { 2, 8 }, { 3, 8 }, { 3, 4 }, { 4, 4 } };
+		for (const FIntPoint& Cfg : Configs)
+		{
+			FBenchFleetPolicy Policy;
+			Policy.Ships = &Ships;
+			TSRGSpatialLevels<int32, FBenchFleetPolicy> Levels(Policy);
+			Levels.Init(float(CellUU));
+			Levels.SetLevels(Cfg.X, Cfg.Y);
+
+			double T0 = FPlatformTime::Seconds();
+			for (int32 i = 0; i < NumShips; ++i) Levels.Add(i);
+			const double InsertMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+			Levels.Refresh(0.0);
+			TArray<FBenchShip> StartShips = Ships;
+			for (FBenchShip& S : Ships) S.Pos += S.Vel * StepSec;
+			T0 = FPlatformTime::Seconds();
+			Levels.Refresh(StepSec);
+			const double RefreshMs = (FPlatformTime::Seconds() - T0) * 1000.0;
+
+			FString Line = FString::Printf(TEXT("[BENCH] Levels=%d F=%2d | Insert %7.2f ms | Refresh %7.2f ms"),
+				Cfg.X, Cfg.Y, InsertMs, RefreshMs);
+
+			TArray<const FBenchShip*> Out;
+			for (const FMix& Mix : Mixes)
+			{
+				int64 Hits = 0;
+				T0 = FPlatformTime::Seconds();
+				for (int32 q = 0; q < Viewers.Num(); ++q)
+				{
+					const double R = Mix.RadiiUU[q % Mix.RadiiUU.Num()];
+					Levels.ForRadius(R).QuerySphere(Ships[Viewers[q]].Pos, R, Out);
+					Hits += Out.Num();
+				}
+				const double Us = (FPlatformTime::Seconds() - T0) * 1e6 / double(FMath::Max(1, Viewers.Num()));
+				Line += FString::Printf(TEXT(" | %s %8.2f us/q Hits=%lld"), Mix.Name, Us, (long long)Hits);
+			}
+			UE_LOG(LogSpatialHash3D, Display, TEXT("%s"), *Line);
+
+			Ships = MoveTemp(StartShips);  // следующая конфигурация — с того же старта
+		}
+	}
+
+	/**
+	 * Проверки на экстремальных координатах (автотесты SpaceTest.Spatial.LWC.*) —
+	 * по настоящему TSpatialHash3D с синтетической политикой. Флот вокруг базы
+	 * BaseUU; хэш проходит путь графа: Bias у базы, затем ребиас (O(1) сдвиг
+	 * CellOffset), рыхлая сетка и Refresh после шага флота. Эталон — перебор в double.
+	 * Каждая проверка возвращает число нарушений.
+	 */
+	static const FVector LWCBases[] = { FVector(1e12, -5e11, 2.5e11), FVector(-1e12, 1e12, -1e12), FVector(1.5e13, -4e12, 2e11) };
+	// 1 км — дальше окна Morton (алиасинг ключей), 50 км — внутри окна
+	static const double LWCCellsUU[] = { 1000.0 * 100.0, 50000.0 * 100.0 };
+	static constexpr double LWCRadiusUU   = 18000.0 * 100.0;
+	static constexpr int32  LWCNumShips   = 5000;
+	static constexpr int32  LWCNumQueries = 32;
+	static constexpr int32  LWCK          = 32;
+
+	using FLWCHash = TSpatialHash3D<int32, FBenchFleetPolicy>;
+
+	/** Флот вокруг BaseUU и хэш над ним в состоянии «после ребиаса + шаг флота» */
+	struct FLWCFixture
+	{
+		TArray<FBenchShip> Ships;
+		FLWCHash           Hash;
+
+		FLWCFixture(const FVector& BaseUU, double CellUU, int32 NumShips)
+		{
+			FRandomStream Rng(777 + NumShips);
+			TArray<FVector> Pos;
+			MakeFleet(NumShips, /*SpreadUU*/ 2.0 * LWCRadiusUU, Rng, Pos);
+			Ships.SetNum(NumShips);
+			for (int32 i = 0; i < NumShips; ++i)
+			{
+				Ships[i].Pos = BaseUU + Pos[i];
+				Ships[i].Vel = Rng.GetUnitVector() * Rng.FRandRange(0.f, 0.3f) * CellUU;  // за 1 с — до трети ячейки
+			}
+
+			FBenchFleetPolicy Policy;
+			Policy.Ships = &Ships;
+			Hash.GetPolicy() = Policy;
+			Hash.Init(float(CellUU));
+			Hash.SetBias(BaseUU);
+			for (int32 i = 0; i < NumShips; ++i) Hash.Add(i);
+
+			// Ребиас без ре-хеша: наблюдатель ушёл на 37 ячеек и чуть-чуть
+			Hash.SetBias(BaseUU + FVector(37.3, -12.8, 5.1) * CellUU);
+			Hash.SetLooseMargin(float(0.25 * CellUU));
+			Hash.Refresh(0.0);
+			for (FBenchShip& S : Ships) S.Pos += S.Vel;
+			Hash.Refresh(1.0);
+		}
+
+		FVector QueryCenter(FRandomStream& Rng) const
+		{
+			return Ships[Rng.RandHelper(Ships.Num())].Pos + Rng.GetUnitVector() * Rng.FRandRange(0.f, 0.5f) * LWCRadiusUU;
+		}
+
+		FORCEINLINE int32 IndexOf(const FBenchShip* S) const { return int32(S - Ships.GetData()); }
+	};
+
+	/** Допуск на float-позиции в координатах ячейки: расхождения у самой границы — не ошибка */
+	FORCEINLINE double LWCTolerance(double RadiusUU) { return 1.0 + RadiusUU * 1e-6; }
+
+	/** Каждый корабль находит себя крошечной сферой: ячейка и позиция в ней сошлись с мировой */
+	static int32 CountLostSelf(const FVector& BaseUU, double CellUU, int32 NumShips)
+	{
+		const FLWCFixture F(BaseUU, CellUU, NumShips);
+		TArray<const FBenchShip*> Out;
+		int32 Lost = 0;
+		for (int32 i = 0; i < NumShips; ++i)
+		{
+			F.Hash.QuerySphere(F.Ships[i].Pos, /*RadiusUU*/ 10.0, Out);
+			Lost += Out.Contains(&F.Ships[i]) ? 0 : 1;
+		}
+		return Lost;
+	}
+
+	/** QuerySphere против перебора в double. Пропуски + лишние */
+	static int32 CountSphereMismatches(const FVector& BaseUU, double CellUU, int32 NumShips, int32 NumQueries)
+	{
+		const FLWCFixture F(BaseUU, CellUU, NumShips);
+		FRandomStream Rng(4242 + NumShips);
+		const double Tol = LWCTolerance(LWCRadiusUU);
+
+		int32 Mismatches = 0;
+		TArray<const FBenchShip*> Out;
+		TArray<uint8> Got;
+		for (int32 q = 0; q < NumQueries; ++q)
+		{
+			const FVector Center = F.QueryCenter(Rng);
+			F.Hash.QuerySphere(Center, LWCRadiusUU, Out);
+			Got.Reset();
+			Got.SetNumZeroed(NumShips);
+			for (const FBenchShip* S : Out)
+			{
+				Mismatches += Got[F.IndexOf(S)]++ ? 1 : 0;  // дубль
+			}
+			for (int32 i = 0; i < NumShips; ++i)
+			{
+				const double Dist = FVector::Dist(F.Ships[i].Pos, Center);
+				if (FMath::Abs(Dist - LWCRadiusUU) <= Tol) continue;
+				Mismatches += ((Dist <= LWCRadiusUU) != (Got[i] != 0)) ? 1 : 0;
+			}
+		}
+		return Mismatches;
+	}
+
+	/** QueryKNearest против перебора в double: i-я дистанция совпадает с i-й эталонной */
+	static int32 CountKnnMismatches(const FVector& BaseUU, double CellUU, int32 NumShips, int32 NumQueries, int32 K)
+	{
+		const FLWCFixture F(BaseUU, CellUU, NumShips);
+		FRandomStream Rng(4343 + NumShips);
+		const double Tol = LWCTolerance(LWCRadiusUU);
+
+		int32 Mismatches = 0;
+		FSRGKnnScratch Scratch;
+		TArray<const FBenchShip*> Out;
+		TArray<double> Brute;
+		for (int32 q = 0; q < NumQueries; ++q)
+		{
+			const FVector Center = F.QueryCenter(Rng);
+			F.Hash.QueryKNearest(Center, K, LWCRadiusUU, Out, Scratch);
+
+			Brute.Reset();
+			for (const FBenchShip& S : F.Ships)
+			{
+				const double Dist = FVector::Dist(S.Pos, Center);
+				if (Dist <= LWCRadiusUU + Tol) Brute.Add(Dist);
+			}
+			Brute.Sort();
+
+			// Эталон с допуском на границе MaxRadius: ровно там число может разойтись
+			const int32 Expected = FMath::Min(K, Brute.Num());
+			int32 ExpectedStrict = 0;
+			while (ExpectedStrict < Expected && Brute[ExpectedStrict] <= LWCRadiusUU - Tol) ++ExpectedStrict;
+			Mismatches += (Out.Num() < ExpectedStrict || Out.Num() > Expected) ? 1 : 0;
+
+			for (int32 i = 0; i < FMath::Min(Out.Num(), Brute.Num()); ++i)
+			{
+				Mismatches += (FMath::Abs(FVector::Dist(Out[i]->Pos, Center) - Brute[i]) <= Tol) ? 0 : 1;
+			}
+		}
+		return Mismatches;
+	}
+
+	/**
+	 * Ячейки с одинаковым Morton-кодом (2^21 и 2^42 ячеек по оси) не сливаются:
+	 * сфера вокруг каждого из «близнецов» находит только его.
+	 */
+	static int32 CountAliasedCells(const FVector& BaseUU, double CellUU)
+	{
+		const FVector Offsets[] = {
+			FVector::ZeroVector,
+			FVector(double(int64(1) << 21), 0.0, 0.0),
+			FVector(0.0, double(int64(1) << 21), 0.0),
+			FVector(0.0, 0.0, -double(int64(1) << 42)) };
+
+		TArray<FBenchShip> Ships;
+		for (const FVector& O : Offsets)
+		{
+			// Центр ячейки: позиция далеко от граней, float-точность не мешает
+			Ships.AddDefaulted_GetRef().Pos = BaseUU + (O + FVector(0.5)) * CellUU;
+		}
+
+		FBenchFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		FLWCHash Hash(Policy);
+		Hash.Init(float(CellUU));
+		Hash.SetBias(BaseUU);
+		for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i);
+
+		int32 Aliased = 0;
+		TArray<const FBenchShip*> Out;
+		for (const FBenchShip& S : Ships)
+		{
+			Hash.QuerySphere(S.Pos, 0.25 * CellUU, Out);
+			Aliased += (Out.Num() == 1 && Out[0] == &S) ? 0 : 1;
+		}
+		return Aliased;
+	}
+}
+
+// space.RepGraph.Spatial.Bench [CellMeters=50000] [RadiusMeters=18000] [Queries=64]
+static FAutoConsoleCommand CCmd_SpaceRepGraph_SpatialBench(
+	TEXT("space.RepGraph.Spatial.Bench"),
+	TEXT("Benchmark flat Morton cell table vs legacy TMap buckets at 1k/10k/100k ships. Args: [CellMeters] [RadiusMeters] [Queries]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const double CellM   = (Args.Num() > 0) ? FCString::Atod(*Args[0]) : 50000.0;
+		const double RadiusM = (Args.Num() > 1) ? FCString::Atod(*Args[1]) : 18000.0;
+		const int32  Queries = (Args.Num() > 2) ? FCString::Atoi(*Args[2]) : 64;
+
+		UE_LOG(LogSpatialHash3D, Display, TEXT("[BENCH] Cell=%.0fm Radius=%.0fm Queries=%d"), CellM, RadiusM, Queries);
+		for (int32 N : { 1000, 10000, 100000 })
+		{
+			SRGBench::RunSize(N, FMath::Max(1.0, CellM) * 100.0, FMath::Max(1.0, RadiusM) * 100.0, FMath::Max(1, Queries));
+		}
+	}));
+
+// space.RepGraph.Spatial.BenchRatio [Ships=10000] [RadiusMeters=15000] [Queries=64]
+static FAutoConsoleCommand CCmd_SpaceRepGraph_SpatialBenchRatio(
+	TEXT("space.RepGraph.Spatial.BenchRatio"),
+	TEXT("Sweep cell-size/radius ratio: full AABB cell scan vs sphere-classified scan. Args: [Ships] [RadiusMeters] [Queries]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32  Ships   = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 10000;
+		const double RadiusM = (Args.Num() > 1) ? FCString::Atod(*Args[1]) : 15000.0;
+		const int32  Queries = (Args.Num() > 2) ? FCString::Atoi(*Args[2]) : 64;
+
+		UE_LOG(LogSpatialHash3D, Display, TEXT("[BENCH] Ships=%d Radius=%.0fm Queries=%d"), Ships, RadiusM, Queries);
+		SRGBench::RunRatioSweep(FMath::Max(1, Ships), FMath::Max(1.0, RadiusM) * 100.0, FMath::Max(1, Queries));
+	}));
+
+// space.RepGraph.Spatial.BenchCore [CellMeters=50000] [RadiusMeters=18000] [Queries=256] [K=32]
+// Внутриредакторная версия; основной бенч ядра — Tests/SpatialHashCore (CMake, без движка).
+static FAutoConsoleCommand CCmd_SpaceRepGraph_SpatialBenchCore(
+	TEXT("space.RepGraph.Spatial.BenchCore"),
+	TEXT("Throughput of the engine-independent TSpatialHash3D core (insert, refresh, sphere, cone, KNN) at 1k/10k/100k ships. Args: [CellMeters] [RadiusMeters] [Queries] [K]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const double CellM   = (Args.Num() > 0) ? FCString::Atod(*Args[0]) : 50000.0;
+		const double RadiusM = (Args.Num() > 1) ? FCString::Atod(*Args[1]) : 18000.0;
+		const int32  Queries = (Args.Num() > 2) ? FCString::Atoi(*Args[2]) : 256;
+		const int32  K       = (Args.Num() > 3) ? FCString::Atoi(*Args[3]) : 32;
+
+		UE_LOG(LogSpatialHash3D, Display, TEXT("[BENCH] Core Cell=%.0fm Radius=%.0fm Queries=%d K=%d"), CellM, RadiusM, Queries, K);
+		for (int32 N : { 1000, 10000, 100000 })
+		{
+			SRGBench::RunCore(N, FMath::Max(1.0, CellM) * 100.0, FMath::Max(1.0, RadiusM) * 100.0, FMath::Max(1, Queries), FMath::Max(1, K));
+		}
+	}));
+
+// space.RepGraph.Spatial.BenchLevels [Ships=20000] [CellMeters=50000] [SpreadMeters=20000] [Queries=512]
+static FAutoConsoleCommand CCmd_SpaceRepGraph_SpatialBenchLevels(
+	TEXT("space.RepGraph.Spatial.BenchLevels"),
+	TEXT("Multi-level Spatial3D index vs a single grid on small/mid/large/mixed query radii. Args: [Ships] [CellMeters] [SpreadMeters] [Queries]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32  Ships   = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 20000;
+		const double CellM   = (Args.Num() > 1) ? FCString::Atod(*Args[1]) : 50000.0;
+		const double SpreadM = (Args.Num() > 2) ? FCString::Atod(*Args[2]) : 20000.0;
+		const int32  Queries = (Args.Num() > 3) ? FCString::Atoi(*Args[3]) : 512;
+
+		UE_LOG(LogSpatialHash3D, Display, TEXT("[BENCH] Levels Ships=%d Cell=%.0fm Spread=%.0fm Queries=%d"), Ships, CellM, SpreadM, Queries);
+		SRGBench::RunLevels(FMath::Max(1, Ships), FMath::Max(1.0, CellM) * 100.0, FMath::Max(1.0, SpreadM) * 100.0, FMath::Max(1, Queries));
+	}));
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Automation RunTests SpaceTest.Spatial.LWC — без мира и сервера, годится для CI
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSRGLWCCellContainmentTest, "SpaceTest.Spatial.LWC.CellContainment",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSRGLWCCellContainmentTest::RunTest(const FString& Parameters)
+{
+	for (const FVector& Base : SRGBench::LWCBases)
+	for (double CellUU : SRGBench::LWCCellsUU)
+	{
+		TestEqual(FString::Printf(TEXT("ships not found at own position, Base=(%.3g, %.3g, %.3g) Cell=%.0fm"), Base.X, Base.Y, Base.Z, CellUU / 100.0),
+			SRGBench::CountLostSelf(Base, CellUU, SRGBench::LWCNumShips), 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSRGLWCSphereVsDoubleTest, "SpaceTest.Spatial.LWC.SphereVsDouble",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSRGLWCSphereVsDoubleTest::RunTest(const FString& Parameters)
+{
+	for (const FVector& Base : SRGBench::LWCBases)
+	for (double CellUU : SRGBench::LWCCellsUU)
+	{
+		TestEqual(FString::Printf(TEXT("sphere vs double brute force, Base=(%.3g, %.3g, %.3g) Cell=%.0fm"), Base.X, Base.Y, Base.Z, CellUU / 100.0),
+			SRGBench::CountSphereMismatches(Base, CellUU, SRGBench::LWCNumShips, SRGBench::LWCNumQueries), 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSRGLWCKnnVsDoubleTest, "SpaceTest.Spatial.LWC.KNearestVsDouble",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSRGLWCKnnVsDoubleTest::RunTest(const FString& Parameters)
+{
+	for (const FVector& Base : SRGBench::LWCBases)
+	for (double CellUU : SRGBench::LWCCellsUU)
+	{
+		TestEqual(FString::Printf(TEXT("KNN vs double brute force, Base=(%.3g, %.3g, %.3g) Cell=%.0fm"), Base.X, Base.Y, Base.Z, CellUU / 100.0),
+			SRGBench::CountKnnMismatches(Base, CellUU, SRGBench::LWCNumShips, SRGBench::LWCNumQueries, SRGBench::LWCK), 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSRGLWCMortonTwinsTest, "SpaceTest.Spatial.LWC.MortonTwinsDistinct",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSRGLWCMortonTwinsTest::RunTest(const FString& Parameters)
+{
+	for (const FVector& Base : SRGBench::LWCBases)
+	for (double CellUU : SRGBench::LWCCellsUU)
+	{
+		TestEqual(FString::Printf(TEXT("aliased cells 2^21/2^42 apart, Base=(%.3g, %.3g, %.3g) Cell=%.0fm"), Base.X, Base.Y, Base.Z, CellUU / 100.0),
+			SRGBench::CountAliasedCells(Base, CellUU), 0);
+	}
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
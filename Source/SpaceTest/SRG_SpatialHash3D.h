@@ -4,18 +4,166 @@
 #include "CoreMinimal.h"
 #include "UObject/Object.h"
 #include "GameFramework/Actor.h"
+#include "Stats/Stats.h"
+#include "SRG_SpatialHashCore.h"
 #include "SRG_SpatialHash3D.generated.h"
 
+DECLARE_STATS_GROUP(TEXT("SpaceSpatialHash"), STATGROUP_SpaceSpatialHash, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Refresh"),             STAT_SRG_Refresh,         STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Query"),               STAT_SRG_Query,           STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cells"),           STAT_SRG_Cells,         STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Table slots"),     STAT_SRG_Slots,         STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Entries"),         STAT_SRG_Entries,       STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Max per cell"),    STAT_SRG_MaxPerCell,    STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Mean per cell"),   STAT_SRG_MeanPerCell,   STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Reads/frame"),     STAT_SRG_Reads,         STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Relinks/frame"),   STAT_SRG_Relinks,       STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Invalid removed"), STAT_SRG_Dropped,       STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queries"),         STAT_SRG_Queries,       STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cells visited"),   STAT_SRG_CellsVisited,  STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cells hit"),       STAT_SRG_CellsHit,      STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Actors tested"),   STAT_SRG_ActorsTested,  STATGROUP_SpaceSpatialHash, SPACETEST_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Actors accepted"), STAT_SRG_ActorsAccepted, STATGROUP_SpaceSpatialHash, SPACETEST_API);
+
+/**
+ * Стабильный хэндл зарегистрированного актёра: плотный индекс слота + поколение.
+ * Индекс — дешёвый ID корабля для массивов/карт состояния; поколение отличает
+ * «висячий» хэндл от нового владельца переиспользованного слота.
+ */
+struct FSRGActorHandle
+{
+	int32  Index      = INDEX_NONE;
+	uint32 Generation = 0;
+
+	FORCEINLINE bool IsSet() const { return Index != INDEX_NONE; }
+
+	FORCEINLINE bool operator==(const FSRGActorHandle& O) const { return Index == O.Index && Generation == O.Generation; }
+	FORCEINLINE bool operator!=(const FSRGActorHandle& O) const { return !(*this == O); }
+
+	friend FORCEINLINE uint32 GetTypeHash(const FSRGActorHandle& H)
+	{
+		return HashCombineFast(uint32(H.Index), H.Generation);
+	}
+};
+
+/**
+ * Таблица хэндлов актёров: плотный массив слотов + free-list.
+ * Allocate/Free — O(1), слоты переиспользуются, поколение растёт на каждом Free.
+ * Резолв по индексу — без хэширования (один TWeakObjectPtr::Get).
+ */
+class FSRGActorHandleTable
+{
+public:
+	FSRGActorHandle Allocate(AActor* A)
+	{
+		int32 Index;
+		if (FreeList.Num() > 0)
+		{
+			Index = FreeList.Pop(EAllowShrinking::No);
+		}
+		else
+		{
+			Index = Slots.AddDefaulted();
+		}
+		FSlot& S = Slots[Index];
+		S.Actor  = A;
+		S.bAlive = true;
+		++NumAlive;
+		return FSRGActorHandle{ Index, S.Generation };
+	}
+
+	void Free(const FSRGActorHandle& H)
+	{
+		if (!IsAlive(H)) return;
+		FSlot& S = Slots[H.Index];
+		S.Actor.Reset();
+		S.bAlive = false;
+		++S.Generation;
+		--NumAlive;
+		FreeList.Add(H.Index);
+	}
+
+	FORCEINLINE bool IsAlive(const FSRGActorHandle& H) const
+	{
+		return Slots.IsValidIndex(H.Index) && Slots[H.Index].bAlive && Slots[H.Index].Generation == H.Generation;
+	}
+
+	/** Живой актёр слота или nullptr (слот свободен / актёр уничтожен) */
+	FORCEINLINE AActor* Resolve(int32 Index) const
+	{
+		if (!Slots.IsValidIndex(Index) || !Slots[Index].bAlive) return nullptr;
+		AActor* A = Slots[Index].Actor.Get();
+		return IsValid(A) ? A : nullptr;
+	}
+
+	FORCEINLINE AActor* Resolve(const FSRGActorHandle& H) const
+	{
+		return IsAlive(H) ? Resolve(H.Index) : nullptr;
+	}
+
+	FORCEINLINE FSRGActorHandle GetHandle(int32 Index) const
+	{
+		return (Slots.IsValidIndex(Index) && Slots[Index].bAlive) ? FSRGActorHandle{ Index, Slots[Index].Generation } : FSRGActorHandle();
+	}
+
+	/** Верхняя граница индексов — размер для массивов, индексируемых хэндлом */
+	FORCEINLINE int32 GetCapacity() const { return Slots.Num(); }
+	FORCEINLINE int32 Num() const { return NumAlive; }
+
+private:
+	struct FSlot
+	{
+		TWeakObjectPtr<AActor> Actor;
+		uint32                 Generation = 0;
+		bool                   bAlive     = false;
+	};
+
+	TArray<FSlot> Slots;
+	TArray<int32> FreeList;
+	int32         NumAlive = 0;
+};
+
+/** Категории актёров в хэше: индекс бита в FSRGCategoryRadii::Mask */
+enum class ESRGActorCategory : uint8
+{
+	NPCShip    = 0,
+	PlayerShip = 1,
+	Projectile = 2,
+	Static     = 3,
+};
+
+/** Сводка хэша за кадр: заполненность (базовый уровень), Refresh, стоимость запросов всех уровней */
+struct FSRGSpatialFrameStats
+{
+	FSRGOccupancy              Occupancy;
+	FSRGRefreshStats           Refresh;
+	FSRGQueryCounters::FValues Queries;
+};
+
+/** Стратегия ядра для актёров: хэндл — индекс в FSRGActorHandleTable */
+struct FSRGActorPositionPolicy
+{
+	using FResolved = AActor*;
+
+	const FSRGActorHandleTable* Table = nullptr;
+
+	FORCEINLINE AActor* Resolve(int32 Index) const { return Table->Resolve(Index); }
+	FORCEINLINE FVector GetLocation(const AActor* A) const { return A->GetActorLocation(); }
+	FORCEINLINE FVector GetVelocity(const AActor* A) const { return A->GetVelocity(); }
+};
+
 /**
- * USRG_SpatialHash3D — компактный 3D spatial hash для RepGraph:
- * - Хранит актёров по кубическим ячейкам размера CellUU (см).
- * - Поддерживает Bias со снэпом к сетке и полный ре-хеш при смене Bias.
- * - Ленивая самоподчистка бакетов (уборка invalid, пере-хеш «съехавших»).
- * - Быстрые запросы по сфере / K-ближайших (для пузыря интереса).
- * - Хелперы для дедлайн-планирования по угловой заметности (T*).
+ * USRG_SpatialHash3D — UObject-обёртка над TSpatialHash3D для RepGraph:
+ * актёры регистрируются в таблице хэндлов (Add → FSRGActorHandle), в ячейках
+ * ядра лежат плоские int32-индексы. Вся логика ячеек, Refresh() и запросов —
+ * в ядре (SRG_SpatialHashCore.h). Ядро может быть многоуровневым (SetLevels):
+ * запрос уходит на уровень с ячейкой под свой радиус.
+ * Плюс хелперы для дедлайн-планирования по угловой заметности (T*).
  *
- * Важно: QuerySphere/QueryKNearest могут МУТИРОВАТЬ внутренние структуры
- * (ленивая подчистка), поэтому они не const.
+ * Мутирует хэш только game thread: Add/Remove/UpdateActor/Refresh/SetBias/SetCellSize.
+ * Запросы const, без аллокаций (Out переиспользует ёмкость) и безопасны
+ * для параллельного вызова с воркеров между двумя Refresh() (вне GC).
  */
 UCLASS()
 class SPACETEST_API USRG_SpatialHash3D : public UObject
@@ -23,189 +171,230 @@ class SPACETEST_API USRG_SpatialHash3D : public UObject
 	GENERATED_BODY()
 
 public:
-	/** Инициализация: размер ячейки в UU (см) */
-	void Init(float InCellUU)
+	using FCore        = TSpatialHash3D<int32, FSRGActorPositionPolicy>;
+	using FLevels      = TSRGSpatialLevels<int32, FSRGActorPositionPolicy>;
+	using FViewHit     = FCore::FViewHit;
+	using FApproachHit = FCore::FApproachHit;
+
+	USRG_SpatialHash3D()
 	{
-		SetCellSize(FMath::Max(1.f, InCellUU));
-		Bias = FVector::ZeroVector;
+		FSRGActorPositionPolicy Policy;
+		Policy.Table = &Handles;
+		Levels.SetPolicy(Policy);
 	}
 
+	/** Инициализация: размер ячейки в UU (см) */
+	void Init(float InCellUU) { Levels.Init(InCellUU); }
+
 	/** Задать новый размер ячейки (полный ре-хеш) */
-	void SetCellSize(float InCellUU)
+	void SetCellSize(float InCellUU) { Levels.SetCellSize(InCellUU); }
+
+	/** Сменить Bias (снэп к сетке) за O(1) */
+	void SetBias(const FVector& NewBias) { Levels.SetBias(NewBias); }
+
+	FORCEINLINE const FVector&      GetBias()       const { return Levels.GetBase().GetBias(); }
+	FORCEINLINE const FInt64Vector& GetCellOffset() const { return Levels.GetBase().GetCellOffset(); }
+
+	/** Параметры грязного трекинга Refresh() (см. TSpatialHash3D::SetRefreshParams) */
+	void SetRefreshParams(float ToleranceUU, float FullSweepSec) { Levels.SetRefreshParams(ToleranceUU, FullSweepSec); }
+
+	/** Запас рыхлой сетки, 0 — строгая (см. TSpatialHash3D::SetLooseMargin) */
+	void SetLooseMargin(float MarginUU) { Levels.SetLooseMargin(MarginUU); }
+
+	/** Уровни индекса (см. TSRGSpatialLevels): число, шаг ячейки между уровнями, целевая ячейка/радиус */
+	void SetLevels(int32 NumLevels, int32 Factor, float CellPerRadius)
 	{
-		CellUU    = FMath::Max(1.f, InCellUU);
-		InvCellUU = 1.f / CellUU;
-		RehashAll();
+		Levels.SetLevels(NumLevels, Factor);
+		Levels.SetCellPerRadius(CellPerRadius);
+	}
+
+	FORCEINLINE float GetLooseMargin()      const { return Levels.GetBase().GetLooseMargin(); }
+	FORCEINLINE float GetRelinksPerSecond() const { return Levels.GetBase().GetRelinksPerSecond(); }
+
+	/** Зарегистрировать актёра: выдать хэндл и положить в ячейку (повторно — обновить позицию) */
+	FSRGActorHandle Add(AActor* A, ESRGActorCategory Category = ESRGActorCategory::NPCShip)
+	{
+		if (!IsValid(A)) return FSRGActorHandle();
+		if (const FSRGActorHandle* Found = ActorToHandle.Find(A))
+		{
+			Levels.Update(Found->Index);
+			return *Found;
+		}
+
+		const FSRGActorHandle H = Handles.Allocate(A);
+		ActorToHandle.Add(A, H);
+		Levels.Add(H.Index, uint8(Category));
+		return H;
 	}
 
-	/** Сменить Bias (снэп к сетке) и полностью переразложить */
-	void SetBias(const FVector& NewBias)
+	/** Сменить категорию (посадка игрока, передача управления ИИ); без изменений — no-op */
+	void SetCategory(AActor* A, ESRGActorCategory Category)
 	{
-		Bias = FVector(
-			FMath::RoundToDouble(NewBias.X * InvCellUU) * CellUU,
-			FMath::RoundToDouble(NewBias.Y * InvCellUU) * CellUU,
-			FMath::RoundToDouble(NewBias.Z * InvCellUU) * CellUU
-		);
-		RehashAll();
+		if (const FSRGActorHandle* Found = ActorToHandle.Find(A))
+		{
+			Levels.SetCategory(Found->Index, uint8(Category));
+		}
 	}
 
-	/** Добавить актёра в структуру */
-	void Add(AActor* A)
+	/** Снять актёра по хэндлу: O(1), без хэширования указателя */
+	void Remove(const FSRGActorHandle& H)
 	{
-		if (!IsValid(A)) return;
-		const FIntVector C = WorldToCell(A->GetActorLocation());
-		FBucket& B = Buckets.FindOrAdd(C);
-		B.Actors.Add(A);
-		ActorToCell.Add(A, C); // TWeakObjectPtr как ключ — ок
+		if (!Handles.IsAlive(H)) return;
+		if (AActor* A = Handles.Resolve(H))
+		{
+			ActorToHandle.Remove(A);
+		}
+		Levels.Remove(H.Index);
+		Handles.Free(H);
 	}
 
-	/** Удалить актёра из структуры */
+	/** Снять актёра (RouteRemove знает только указатель — один поиск в ActorToHandle) */
 	void Remove(AActor* A)
 	{
 		if (!A) return;
-		if (FIntVector* Found = ActorToCell.Find(A))
+		FSRGActorHandle H;
+		if (ActorToHandle.RemoveAndCopyValue(A, H))
 		{
-			if (FBucket* B = Buckets.Find(*Found))
-			{
-				B->Actors.RemoveSingleSwap(A);
-				if (B->Actors.Num() == 0) Buckets.Remove(*Found);
-			}
-			ActorToCell.Remove(A);
+			Levels.Remove(H.Index);
+			Handles.Free(H);
 		}
 	}
 
-	/** Явное обновление позиции конкретного актёра (опционально) */
+	/** Явное обновление позиции конкретного актёра (телепорт, спавн и т.п.) */
 	void UpdateActor(AActor* A)
 	{
 		if (!IsValid(A)) { Remove(A); return; }
-		const FIntVector NewC = WorldToCell(A->GetActorLocation());
-		if (FIntVector* OldC = ActorToCell.Find(A))
+		if (const FSRGActorHandle* Found = ActorToHandle.Find(A))
 		{
-			if (*OldC == NewC) return;
-			// убрать из старого
-			if (FBucket* OB = Buckets.Find(*OldC))
-			{
-				OB->Actors.RemoveSingleSwap(A);
-				if (OB->Actors.Num() == 0) Buckets.Remove(*OldC);
-			}
-			// добавить в новый
-			FBucket& NB = Buckets.FindOrAdd(NewC);
-			NB.Actors.Add(A);
-			*OldC = NewC;
+			Levels.Update(Found->Index);
 		}
 		else
 		{
-			// не было в карте — добавить
 			Add(A);
 		}
 	}
 
-	/** Быстрый отбор по сфере (uu). Out — без дублей, с ленивой подчисткой */
-	void QuerySphere(const FVector& Center, float RadiusUU, TArray<AActor*>& Out)
+	/** Раз в кадр (сервер, game thread): SoA-кэш позиций, релинк, уборка невалидных, сводка кадра */
+	void Refresh(double NowSeconds)
 	{
-		Out.Reset();
-		if (RadiusUU <= 0.f) return;
-
-		const FVector R(RadiusUU);
-		const FIntVector MinC = WorldToCell(Center - R);
-		const FIntVector MaxC = WorldToCell(Center + R);
-
-		TSet<AActor*> Unique;
-		Unique.Reserve(256);
-
-		const float RadiusSq = RadiusUU * RadiusUU;
-
-		for (int32 cz = MinC.Z; cz <= MaxC.Z; ++cz)
-		for (int32 cy = MinC.Y; cy <= MaxC.Y; ++cy)
-		for (int32 cx = MinC.X; cx <= MaxC.X; ++cx)
 		{
-			const FIntVector Key(cx, cy, cz);
-			FBucket* B = Buckets.Find(Key);
-			if (!B) continue;
-
-			for (int32 i = 0; i < B->Actors.Num(); /*i++ внутри*/)
+			SCOPE_CYCLE_COUNTER(STAT_SRG_Refresh);
+			if (Levels.Refresh(NowSeconds) > 0)
 			{
-				AActor* A = B->Actors[i].Get();
-				if (!IsValid(A))
-				{
-					B->Actors.RemoveAtSwap(i);
-					continue;
-				}
-
-				// Проверим принадлежность ячейке (ленивый релинк)
-				const FIntVector CurC = WorldToCell(A->GetActorLocation());
-				if (CurC != Key)
-				{
-					B->Actors.RemoveAtSwap(i);
-					Relink(A, CurC);
-					continue;
-				}
-
-				// Геометрия сферы
-				const float DistSq = FVector::DistSquared(A->GetActorLocation(), Center);
-				if (DistSq <= RadiusSq)
-				{
-					if (!Unique.Contains(A))
-					{
-						Unique.Add(A);
-						Out.Add(A);
-					}
-				}
-
-				++i;
-			}
-
-			if (B->Actors.Num() == 0)
-			{
-				Buckets.Remove(Key);
+				FreeStaleHandles();
 			}
 		}
+		UpdateFrameStats();
 	}
 
+	/** Сводка прошлого кадра (считается в Refresh) */
+	FORCEINLINE const FSRGSpatialFrameStats& GetFrameStats() const { return FrameStats; }
+
 	/**
-	 * K-ближайших актёров к Center (до MaxRadiusUU). Удобно для "все в одной точке":
-	 * Мы не бежим по всей карте — берём сферу и режем по K.
+	 * Карта ячеек уровня Level в CSV: ячейка, мировой центр, число записей и
+	 * разбивка по ESRGActorCategory — для подбора CellMeters и поиска горячих ячеек.
 	 */
-	void QueryKNearest(const FVector& Center, int32 K, float MaxRadiusUU, TArray<AActor*>& Out)
+	void WriteCellsCsv(int32 Level, FString& Out) const;
+
+	/* Хэндлы: дешёвый ID корабля для остального графа */
+	FORCEINLINE FSRGActorHandle FindHandle(const AActor* A) const
 	{
-		QuerySphere(Center, MaxRadiusUU, Out);
-		if (Out.Num() <= K || K <= 0) return;
+		const FSRGActorHandle* Found = ActorToHandle.Find(A);
+		return Found ? *Found : FSRGActorHandle();
+	}
+	FORCEINLINE AActor* ResolveHandle(const FSRGActorHandle& H) const { return Handles.Resolve(H); }
+	FORCEINLINE const FSRGActorHandleTable& GetHandleTable() const { return Handles; }
 
-		Out.Sort([&](const AActor& L, const AActor& R)
-		{
-			return FVector::DistSquared(L.GetActorLocation(), Center) <
-			       FVector::DistSquared(R.GetActorLocation(), Center);
-		});
-		Out.SetNum(K, /*bAllowShrinking=*/false);
+	/** Отбор по сфере (uu). Out — без дублей. */
+	void QuerySphere(const FVector& Center, double RadiusUU, TArray<AActor*>& Out) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(RadiusUU).QuerySphere(Center, RadiusUU, Out);
+	}
+
+	/** Отбор по категориям с радиусом на категорию, в один проход */
+	void QuerySphere(const FVector& Center, const FSRGCategoryRadii& Radii, TArray<AActor*>& Out) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Radii.GetMaxRadius()).QuerySphere(Center, Radii, Out);
+	}
+
+	/** Пакетный отбор по сферам одного радиуса: Out[i] — для Centers[i] */
+	void QuerySpheresBatch(TArrayView<const FVector> Centers, double RadiusUU,
+	                       TArrayView<TArray<AActor*>> Out, FSRGBatchQueryScratch& Scratch) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(RadiusUU).QuerySpheresBatch(Centers, RadiusUU, Out, Scratch);
+	}
+
+	void QuerySpheresBatch(TArrayView<const FVector> Centers, const FSRGCategoryRadii& Radii,
+	                       TArrayView<TArray<AActor*>> Out, FSRGBatchQueryScratch& Scratch) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Radii.GetMaxRadius()).QuerySpheresBatch(Centers, Radii, Out, Scratch);
+	}
+
+	/** K-ближайших актёров к Center (до MaxRadiusUU), Out — по возрастанию дистанции */
+	void QueryKNearest(const FVector& Center, int32 K, double MaxRadiusUU, TArray<AActor*>& Out, FSRGKnnScratch& Scratch) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(MaxRadiusUU).QueryKNearest(Center, K, MaxRadiusUU, Out, Scratch);
+	}
+
+	void QueryKNearest(const FVector& Center, int32 K, const FSRGCategoryRadii& Radii, TArray<AActor*>& Out, FSRGKnnScratch& Scratch) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Radii.GetMaxRadius()).QueryKNearest(Center, K, Radii, Out, Scratch);
+	}
+
+	/** Кто войдёт в сферу (радиус по категориям) за HorizonSec; по возрастанию времени входа */
+	void QueryApproaching(const FVector& Center, const FVector& ViewerVel, const FSRGCategoryRadii& Radii, float HorizonSec,
+	                      TArray<FApproachHit>& Out) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Radii.GetMaxRadius()).QueryApproaching(Center, ViewerVel, Radii, HorizonSec, Out);
+	}
+
+	/** Конус обзора: полуугол HalfAngleRad, дальность по категориям; ближе AllAroundUU — при любом угле */
+	void QueryCone(const FVector& Origin, const FVector& Forward, float HalfAngleRad, const FSRGCategoryRadii& Radii,
+	               TArray<FViewHit>& Out, double AllAroundUU = 0.0) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Radii.GetMaxRadius()).QueryCone(Origin, Forward, HalfAngleRad, Radii, Out, AllAroundUU);
+	}
+
+	/** Пирамида обзора (FSRGViewFrustum::Make), только категории из CategoryMask */
+	void QueryFrustum(const FSRGViewFrustum& Frustum, TArray<FViewHit>& Out, uint8 CategoryMask = 0xFF) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SRG_Query);
+		Levels.ForRadius(Frustum.RangeUU).QueryFrustum(Frustum, Out, CategoryMask);
+	}
+
+	/** Все пары ближе RadiusUU (одна из MaskA, другая из MaskB): Fn(int32 A, int32 B, float DistSq), индексы хэндлов */
+	template<typename FuncType>
+	void ForEachPairWithin(double RadiusUU, FuncType&& Fn, FSRGPairScratch& Scratch, uint8 MaskA = 0xFF, uint8 MaskB = 0xFF) const
+	{
+		Levels.ForRadius(RadiusUU).ForEachPairWithin(RadiusUU, Forward<FuncType>(Fn), Scratch, MaskA, MaskB);
+	}
+
+	/** То же по воркерам: Fn(int32 TaskIndex, int32 A, int32 B, float DistSq) */
+	template<typename FuncType>
+	void ParallelForEachPairWithin(double RadiusUU, FuncType&& Fn, FSRGPairScratch& Scratch, uint8 MaskA = 0xFF, uint8 MaskB = 0xFF, int32 NumTasks = 0) const
+	{
+		Levels.ForRadius(RadiusUU).ParallelForEachPairWithin(RadiusUU, Forward<FuncType>(Fn), Scratch, MaskA, MaskB, NumTasks);
 	}
 
 	/** Убрать все невалидные ссылки (полезно после массовых удалений) */
 	void RemoveInvalids()
 	{
-		// Чистим бакеты
-		for (auto It = Buckets.CreateIterator(); It; ++It)
-		{
-			FBucket& B = It.Value();
-			for (int32 i = 0; i < B.Actors.Num(); /*i*/)
-			{
-				if (!IsValid(B.Actors[i].Get()))
-				{
-					B.Actors.RemoveAtSwap(i);
-				}
-				else { ++i; }
-			}
-			if (B.Actors.Num() == 0) It.RemoveCurrent();
-		}
-		// Чистим индекс
-		for (auto It = ActorToCell.CreateIterator(); It; ++It)
-		{
-			if (!IsValid(It.Key().Get()))
-			{
-				It.RemoveCurrent();
-			}
-		}
+		Levels.RemoveInvalids();
+		FreeStaleHandles();
 	}
 
+	/** Базовый (самый крупный) уровень: категории, позиции */
+	FORCEINLINE const FCore& GetCore() const { return Levels.GetBase(); }
+	FORCEINLINE const FLevels& GetLevels() const { return Levels; }
+
 	/* ===================== ДЕДЛАЙН-ПЛАНИРОВАНИЕ (угловая заметность) ===================== */
 
 	/** Вход для расчёта дедлайна T* (все величины — в СИ, где требуется) */
@@ -280,55 +469,35 @@ public:
 	}
 
 private:
-	struct FBucket
-	{
-		TArray<TWeakObjectPtr<AActor>> Actors;
-	};
+	// Таблица хэндлов объявлена до ядра: политика ядра держит на неё указатель
+	FSRGActorHandleTable Handles;
+	FLevels Levels;
 
-	// Параметры
-	float   CellUU    = 1000.f;
-	float   InvCellUU = 1.f / 1000.f;
-	FVector Bias      = FVector::ZeroVector;
-
-	// Хранилище
-	TMap<FIntVector, FBucket> Buckets;
-	// В качестве ключа используем WeakPtr — безопасно для GC; хэш и сравнение поддерживаются UE.
-	TMap<TWeakObjectPtr<AActor>, FIntVector> ActorToCell;
-
-	// Вспомогательные
-	FORCEINLINE FIntVector WorldToCell(const FVector& P) const
-	{
-		const FVector Q = (P - Bias) * InvCellUU;
-		return FIntVector(
-			int32(FMath::FloorToFloat(Q.X)),
-			int32(FMath::FloorToFloat(Q.Y)),
-			int32(FMath::FloorToFloat(Q.Z))
-		);
-	}
+	// Актёр → хэндл: только для регистрации/снятия по указателю (RouteAdd/RouteRemove)
+	TMap<TWeakObjectPtr<AActor>, FSRGActorHandle> ActorToHandle;
+
+	FSRGSpatialFrameStats FrameStats;
+
+	/** Сводка кадра → FrameStats, stat SpaceSpatialHash и счётчики Insights */
+	void UpdateFrameStats();
 
-	void RehashAll()
+	/** Вернуть в таблицу слоты актёров, уничтоженных без Remove() */
+	void FreeStaleHandles()
 	{
-		TMap<FIntVector, FBucket> NewBuckets;
-		for (auto It = ActorToCell.CreateIterator(); It; ++It)
+		for (auto It = ActorToHandle.CreateIterator(); It; ++It)
 		{
-			AActor* A = It.Key().Get();
-			if (!IsValid(A))
+			const FSRGActorHandle H = It.Value();
+			if (!Handles.IsAlive(H))
 			{
+				// Хэндл уже освобождён через Remove(Handle), слот мог уйти другому актёру
+				It.RemoveCurrent();
+			}
+			else if (!Handles.Resolve(H))
+			{
+				Levels.Remove(H.Index);
+				Handles.Free(H);
 				It.RemoveCurrent();
-				continue;
 			}
-			const FIntVector C = WorldToCell(A->GetActorLocation());
-			NewBuckets.FindOrAdd(C).Actors.Add(A);
-			It.Value() = C;
 		}
-		Buckets = MoveTemp(NewBuckets);
-	}
-
-	void Relink(AActor* A, const FIntVector& NewC)
-	{
-		if (!IsValid(A)) return;
-		FBucket& NB = Buckets.FindOrAdd(NewC);
-		NB.Actors.Add(A);
-		ActorToCell.Add(A, NewC); // перезапишет старое значение
 	}
 };
@@ -0,0 +1,2399 @@
+// SRG_SpatialHashCore.h
+#pragma once
+
+// Ядро spatial hash без UObject/Engine: зависит только от SRG_CoreShim.h
+// (TArray, FVector, FMath, ParallelFor) — в модуле это Core, в Tests/SpatialHashCore
+// та же прослойка поверх стандартной библиотеки. USRG_SpatialHash3D — тонкая обёртка.
+
+#include "SRG_CoreShim.h"
+
+/* ===================== Ключи ячеек ===================== */
+
+/** Пустой слот таблицы ячеек (реальные Morton-коды занимают максимум 63 бита) */
+static constexpr uint64 SRG_EmptyCellKey = ~0ull;
+
+/** Смещение координат ячейки перед упаковкой: 21 бит на ось, окно [-2^20, 2^20) */
+static constexpr int64 SRG_MortonAxisBias = 1 << 20;
+
+/** Разнести младшие 21 бит по каждой третьей позиции */
+FORCEINLINE uint64 SRG_MortonSplitBy3(uint32 V)
+{
+	uint64 X = V & 0x1fffffull;
+	X = (X | (X << 32)) & 0x001f00000000ffffull;
+	X = (X | (X << 16)) & 0x001f0000ff0000ffull;
+	X = (X | (X <<  8)) & 0x100f00f00f00f00full;
+	X = (X | (X <<  4)) & 0x10c30c30c30c30c3ull;
+	X = (X | (X <<  2)) & 0x1249249249249249ull;
+	return X;
+}
+
+/**
+ * Z-order ключ ячейки по младшим 21 биту каждой оси. Соседние ячейки дают
+ * близкие ключи. Ключ задаёт порядок и домашний слот, но не идентичность:
+ * дальше ±2^20 ячеек он заворачивается, поэтому таблица сравнивает полные
+ * 64-битные координаты.
+ */
+FORCEINLINE uint64 SRG_MakeCellKey(const FInt64Vector& C)
+{
+	return  SRG_MortonSplitBy3(uint32(C.X + SRG_MortonAxisBias))
+		| (SRG_MortonSplitBy3(uint32(C.Y + SRG_MortonAxisBias)) << 1)
+		| (SRG_MortonSplitBy3(uint32(C.Z + SRG_MortonAxisBias)) << 2);
+}
+
+/** Свёртка бит выше Morton-окна: 0 рядом с началом сетки, иначе разводит «завернувшиеся» ячейки по слотам */
+FORCEINLINE uint64 SRG_CellHighBitsHash(const FInt64Vector& C)
+{
+	const uint64 HX = uint64(C.X + SRG_MortonAxisBias) >> 21;
+	const uint64 HY = uint64(C.Y + SRG_MortonAxisBias) >> 21;
+	const uint64 HZ = uint64(C.Z + SRG_MortonAxisBias) >> 21;
+	const uint64 H  = (HX * 0x9E3779B97F4A7C15ull) ^ (HY * 0xC2B2AE3D27D4EB4Full) ^ (HZ * 0x165667B19E3779F9ull);
+	return H ^ (H >> 32);
+}
+
+/** Лексикографический порядок ячеек — добивка сортировки при равных Morton-ключах */
+FORCEINLINE bool SRG_CellLess(const FInt64Vector& L, const FInt64Vector& R)
+{
+	if (L.X != R.X) return L.X < R.X;
+	if (L.Y != R.Y) return L.Y < R.Y;
+	return L.Z < R.Z;
+}
+
+/** Угол ячейки относительно начала сетки (double: точно, пока |C*CellUU| < 2^53) */
+FORCEINLINE FVector SRG_CellCorner(const FInt64Vector& C, double CellUU)
+{
+	return FVector(double(C.X) * CellUU, double(C.Y) * CellUU, double(C.Z) * CellUU);
+}
+
+/* ===================== Классификация ячеек против сферы ===================== */
+
+/**
+ * Квадраты ближнего/дальнего расстояния от X до отрезка ячейки по одной оси.
+ * LooseUU — запас «рыхлой» ячейки: [C*Cell - Loose, (C+1)*Cell + Loose].
+ */
+FORCEINLINE void SRG_AxisCellDistSq(double X, int64 C, double CellUU, double LooseUU, double& OutNearSq, double& OutFarSq)
+{
+	const double Lo = double(C) * CellUU - LooseUU;
+	const double Hi = Lo + CellUU + 2.0 * LooseUU;
+	const double Near = (X < Lo) ? (Lo - X) : ((X > Hi) ? (X - Hi) : 0.0);
+	const double Far  = FMath::Max(FMath::Abs(X - Lo), FMath::Abs(X - Hi));
+	OutNearSq = Near * Near;
+	OutFarSq  = Far * Far;
+}
+
+enum class ESRGCellOverlap : uint8 { Outside, Partial, Inside };
+
+/** Классификация (рыхлого) куба ячейки Cell против сферы (LocalCenter — относительно начала сетки) */
+FORCEINLINE ESRGCellOverlap SRG_ClassifyCell(const FVector& LocalCenter, const FInt64Vector& Cell, double CellUU, double LooseUU, double RadiusSq)
+{
+	double NxSq, FxSq, NySq, FySq, NzSq, FzSq;
+	SRG_AxisCellDistSq(LocalCenter.X, Cell.X, CellUU, LooseUU, NxSq, FxSq);
+	SRG_AxisCellDistSq(LocalCenter.Y, Cell.Y, CellUU, LooseUU, NySq, FySq);
+	SRG_AxisCellDistSq(LocalCenter.Z, Cell.Z, CellUU, LooseUU, NzSq, FzSq);
+	if (NxSq + NySq + NzSq > RadiusSq) return ESRGCellOverlap::Outside;
+	if (FxSq + FySq + FzSq <= RadiusSq) return ESRGCellOverlap::Inside;
+	return ESRGCellOverlap::Partial;
+}
+
+/**
+ * Обойти ячейки AABB сферы, классифицируя куб каждой ячейки:
+ * - целиком снаружи — пропускается без вызова Fn (и без поиска в хэше);
+ * - целиком внутри  — Fn(Cell, true): актёров можно брать без теста расстояния;
+ * - на границе      — Fn(Cell, false): нужен тест по актёрам.
+ * LocalCenter — центр относительно начала сетки. Ряды/столбцы вне сферы отсекаются целиком.
+ * LooseUU > 0 — рыхлая сетка: актёр ячейки может лежать до LooseUU за её гранью,
+ * диапазон ячеек и классификация расширяются на этот запас.
+ */
+template<typename FuncType>
+FORCEINLINE void SRG_ForEachSphereCell(const FVector& LocalCenter, double RadiusUU, double CellUU, double LooseUU, FuncType&& Fn)
+{
+	const double Inv   = 1.0 / CellUU;
+	const double RSq   = RadiusUU * RadiusUU;
+	const double Reach = RadiusUU + LooseUU;
+	const FInt64Vector MinC(
+		int64(FMath::FloorToDouble((LocalCenter.X - Reach) * Inv)),
+		int64(FMath::FloorToDouble((LocalCenter.Y - Reach) * Inv)),
+		int64(FMath::FloorToDouble((LocalCenter.Z - Reach) * Inv)));
+	const FInt64Vector MaxC(
+		int64(FMath::FloorToDouble((LocalCenter.X + Reach) * Inv)),
+		int64(FMath::FloorToDouble((LocalCenter.Y + Reach) * Inv)),
+		int64(FMath::FloorToDouble((LocalCenter.Z + Reach) * Inv)));
+
+	for (int64 cz = MinC.Z; cz <= MaxC.Z; ++cz)
+	{
+		double NzSq, FzSq;
+		SRG_AxisCellDistSq(LocalCenter.Z, cz, CellUU, LooseUU, NzSq, FzSq);
+		if (NzSq > RSq) continue;
+
+		for (int64 cy = MinC.Y; cy <= MaxC.Y; ++cy)
+		{
+			double NySq, FySq;
+			SRG_AxisCellDistSq(LocalCenter.Y, cy, CellUU, LooseUU, NySq, FySq);
+			if (NzSq + NySq > RSq) continue;
+
+			for (int64 cx = MinC.X; cx <= MaxC.X; ++cx)
+			{
+				double NxSq, FxSq;
+				SRG_AxisCellDistSq(LocalCenter.X, cx, CellUU, LooseUU, NxSq, FxSq);
+				if (NzSq + NySq + NxSq > RSq) continue;
+
+				Fn(FInt64Vector(cx, cy, cz), (FzSq + FySq + FxSq) <= RSq);
+			}
+		}
+	}
+}
+
+/**
+ * TSRGCellTable — плоская open-addressing таблица ячеек (linear probing).
+ * - Ячейка идентифицируется полными 64-битными координатами; Morton-код
+ *   (младшие 21 бит по оси) хранится рядом для порядка и выбора слота.
+ * - Элементы всех ячеек упакованы в общий Slab: у ячейки свой прогон [Start, Start+Num).
+ *   Переполненный прогон переезжает в конец Slab с удвоенной ёмкостью, дыры
+ *   собираются Compact(), который заодно раскладывает прогоны в Z-порядке.
+ * - Рядом со Slab лежит SoA-зеркало позиций (X[], Y[], Z[]) с той же индексацией:
+ *   тест расстояния идёт по плотной памяти, не трогая сами элементы.
+ *   Позиции — float относительно угла своей ячейки: их модуль порядка CellUU,
+ *   так что точность не зависит от удаления ячейки от начала мира.
+ *   Там же байтовая дорожка Cat[] — категория элемента (см. FSRGCategoryRadii).
+ * - Индекс слота (SlotOf) — свёртка: Key ^ Key>>27 ^ Key>>45 ^ хэш бит координат
+ *   за 21-битным окном, по маске таблицы. Свёртка разводит по таблице дальние
+ *   ячейки с одинаковыми младшими битами; цена — соседство слотов не гарантируется.
+ *   Внутри выровненного блока 2^9 ячеек по оси старшие слагаемые одинаковы, и слот —
+ *   младшие биты Morton-кода с постоянным XOR; между блоками слоты произвольны.
+ *   Локальность обхода даёт не таблица, а Slab: Compact() кладёт прогоны в Z-порядке.
+ */
+template<typename ElementType>
+class TSRGCellTable
+{
+public:
+	struct FCellSlot
+	{
+		FInt64Vector Cell  = FInt64Vector::ZeroValue;
+		uint64       Key   = SRG_EmptyCellKey;  // Morton-код Cell
+		int32        Start = 0;  // начало прогона в Slab
+		int32        Num   = 0;  // занято
+		int32        Cap   = 0;  // зарезервировано под ячейку
+	};
+
+	TSRGCellTable() { Reset(); }
+
+	void Reset()
+	{
+		Slots.Reset();
+		Slots.SetNum(MinSlots);
+		Mask      = MinSlots - 1;
+		NumCells  = 0;
+		Slab.Reset();
+		SlabX.Reset();
+		SlabY.Reset();
+		SlabZ.Reset();
+		SlabCat.Reset();
+		SlabWaste = 0;
+	}
+
+	FORCEINLINE int32 Num() const { return NumCells; }
+	FORCEINLINE int32 GetSlabSize() const { return Slab.Num(); }
+	FORCEINLINE int32 GetNumSlots() const { return Slots.Num(); }
+
+	/** Индекс слота ячейки или INDEX_NONE */
+	FORCEINLINE int32 FindSlot(const FInt64Vector& Cell) const
+	{
+		const uint64 Key = SRG_MakeCellKey(Cell);
+		for (uint32 i = SlotOf(Key, Cell); ; i = (i + 1) & Mask)
+		{
+			const FCellSlot& S = Slots[i];
+			if (S.Key == Key && S.Cell == Cell) return int32(i);
+			if (S.Key == SRG_EmptyCellKey)      return INDEX_NONE;
+		}
+	}
+
+	FORCEINLINE const FCellSlot& GetSlot(int32 S) const { return Slots[S]; }
+
+	/** Элементы ячейки (пусто, если ячейки нет). Вид живёт до следующей мутации. */
+	FORCEINLINE TArrayView<ElementType> Find(const FInt64Vector& Cell)
+	{
+		const int32 S = FindSlot(Cell);
+		return (S == INDEX_NONE) ? TArrayView<ElementType>() : GetSlotItems(S);
+	}
+
+	FORCEINLINE TArrayView<const ElementType> Find(const FInt64Vector& Cell) const
+	{
+		const int32 S = FindSlot(Cell);
+		return (S == INDEX_NONE) ? TArrayView<const ElementType>() : GetSlotItems(S);
+	}
+
+	FORCEINLINE TArrayView<ElementType> GetSlotItems(int32 S)
+	{
+		const FCellSlot& C = Slots[S];
+		return TArrayView<ElementType>(Slab.GetData() + C.Start, C.Num);
+	}
+
+	FORCEINLINE TArrayView<const ElementType> GetSlotItems(int32 S) const
+	{
+		const FCellSlot& C = Slots[S];
+		return TArrayView<const ElementType>(Slab.GetData() + C.Start, C.Num);
+	}
+
+	/* SoA-доступ по абсолютному индексу Slab (Start + i); позиции — от угла ячейки */
+	FORCEINLINE const ElementType& GetItem(int32 Idx) const { return Slab[Idx]; }
+	FORCEINLINE ElementType& GetItemMutable(int32 Idx) { return Slab[Idx]; }
+	FORCEINLINE const float* GetSlabX() const { return SlabX.GetData(); }
+	FORCEINLINE const float* GetSlabY() const { return SlabY.GetData(); }
+	FORCEINLINE const float* GetSlabZ() const { return SlabZ.GetData(); }
+	FORCEINLINE const uint8* GetSlabCategory() const { return SlabCat.GetData(); }
+	FORCEINLINE FVector3f GetLocalPosition(int32 Idx) const { return FVector3f(SlabX[Idx], SlabY[Idx], SlabZ[Idx]); }
+	FORCEINLINE void SetCategory(int32 Idx, uint8 Category) { SlabCat[Idx] = Category; }
+
+	FORCEINLINE void SetLocalPosition(int32 Idx, const FVector3f& P)
+	{
+		SlabX[Idx] = P.X;
+		SlabY[Idx] = P.Y;
+		SlabZ[Idx] = P.Z;
+	}
+
+	void Add(const FInt64Vector& Cell, const ElementType& E, const FVector3f& LocalPos, uint8 Category = 0)
+	{
+		const int32 S = FindOrAddSlot(Cell);
+		FCellSlot& C = Slots[S];
+		if (C.Num == C.Cap)
+		{
+			GrowRun(C);
+		}
+		Slab[C.Start + C.Num] = E;
+		SetLocalPosition(C.Start + C.Num, LocalPos);
+		SlabCat[C.Start + C.Num] = Category;
+		++C.Num;
+	}
+
+	/** Убрать элемент из ячейки (swap внутри прогона). Пустая ячейка удаляется. */
+	bool Remove(const FInt64Vector& Cell, const ElementType& E)
+	{
+		return RemoveFirstIf(Cell, [&E](const ElementType& X){ return X == E; });
+	}
+
+	/** Убрать первый элемент ячейки, для которого Pred(E) == true */
+	template<typename PredType>
+	bool RemoveFirstIf(const FInt64Vector& Cell, PredType&& Pred)
+	{
+		const int32 S = FindSlot(Cell);
+		if (S == INDEX_NONE) return false;
+
+		const FCellSlot& C = Slots[S];
+		for (int32 i = 0; i < C.Num; ++i)
+		{
+			if (Pred(Slab[C.Start + i]))
+			{
+				RemoveAtSwap(S, i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/** Убрать i-й элемент прогона слота S. Возвращает false, если ячейка опустела и удалена. */
+	bool RemoveAtSwap(int32 S, int32 i)
+	{
+		FCellSlot& C = Slots[S];
+		--C.Num;
+		if (i != C.Num)
+		{
+			MoveItem(C.Start + i, C.Start + C.Num);
+		}
+		Slab[C.Start + C.Num] = ElementType();
+
+		if (C.Num == 0)
+		{
+			RemoveSlot(S);
+			return false;
+		}
+		return true;
+	}
+
+	/** Обойти все непустые ячейки: Fn(Cell, SlotIndex) */
+	template<typename FuncType>
+	void ForEachCell(FuncType&& Fn) const
+	{
+		for (int32 S = 0; S < Slots.Num(); ++S)
+		{
+			if (Slots[S].Key != SRG_EmptyCellKey)
+			{
+				Fn(Slots[S].Cell, S);
+			}
+		}
+	}
+
+	/** Удалить элементы, для которых Pred(E) == true; опустевшие ячейки тоже уходят */
+	template<typename PredType>
+	int32 RemoveAll(PredType&& Pred)
+	{
+		int32 Removed = 0;
+		TArray<FInt64Vector, TInlineAllocator<32>> EmptyCells;
+		for (int32 S = 0; S < Slots.Num(); ++S)
+		{
+			FCellSlot& C = Slots[S];
+			if (C.Key == SRG_EmptyCellKey) continue;
+
+			for (int32 i = 0; i < C.Num; /*i*/)
+			{
+				if (Pred(Slab[C.Start + i]))
+				{
+					--C.Num;
+					MoveItem(C.Start + i, C.Start + C.Num);
+					Slab[C.Start + C.Num] = ElementType();
+					++Removed;
+				}
+				else { ++i; }
+			}
+			if (C.Num == 0) EmptyCells.Add(C.Cell);
+		}
+		// Удаляем после обхода: backward-shift двигает слоты
+		for (const FInt64Vector& Cell : EmptyCells)
+		{
+			const int32 S = FindSlot(Cell);
+			if (S != INDEX_NONE) RemoveSlot(S);
+		}
+		return Removed;
+	}
+
+	/** Пересобрать Slab без дыр, прогоны — в порядке Morton-ключей */
+	void Compact()
+	{
+		TArray<int32> Order;
+		Order.Reserve(NumCells);
+		for (int32 S = 0; S < Slots.Num(); ++S)
+		{
+			if (Slots[S].Key != SRG_EmptyCellKey) Order.Add(S);
+		}
+		Order.Sort([this](int32 L, int32 R)
+		{
+			return (Slots[L].Key != Slots[R].Key) ? (Slots[L].Key < Slots[R].Key) : SRG_CellLess(Slots[L].Cell, Slots[R].Cell);
+		});
+
+		int32 Total = 0;
+		for (int32 S : Order) Total += RunCapacityFor(Slots[S].Num);
+
+		TArray<ElementType> NewSlab;
+		TArray<float> NewX, NewY, NewZ;
+		TArray<uint8> NewCat;
+		NewSlab.SetNum(Total);
+		NewX.SetNumZeroed(Total);
+		NewY.SetNumZeroed(Total);
+		NewZ.SetNumZeroed(Total);
+		NewCat.SetNumZeroed(Total);
+
+		int32 Cursor = 0;
+		for (int32 S : Order)
+		{
+			FCellSlot& C = Slots[S];
+			for (int32 i = 0; i < C.Num; ++i)
+			{
+				NewSlab[Cursor + i] = MoveTemp(Slab[C.Start + i]);
+				NewX[Cursor + i]    = SlabX[C.Start + i];
+				NewY[Cursor + i]    = SlabY[C.Start + i];
+				NewZ[Cursor + i]    = SlabZ[C.Start + i];
+				NewCat[Cursor + i]  = SlabCat[C.Start + i];
+			}
+			C.Start = Cursor;
+			C.Cap   = RunCapacityFor(C.Num);
+			Cursor += C.Cap;
+		}
+		Slab      = MoveTemp(NewSlab);
+		SlabX     = MoveTemp(NewX);
+		SlabY     = MoveTemp(NewY);
+		SlabZ     = MoveTemp(NewZ);
+		SlabCat   = MoveTemp(NewCat);
+		SlabWaste = 0;
+	}
+
+private:
+	static constexpr int32 MinSlots  = 64;
+	static constexpr int32 MinRunCap = 4;
+
+	TArray<FCellSlot>   Slots;
+	uint32              Mask      = MinSlots - 1;
+	int32               NumCells  = 0;
+	TArray<ElementType> Slab;
+	TArray<float>       SlabX, SlabY, SlabZ;
+	TArray<uint8>       SlabCat;
+	int32               SlabWaste = 0;
+
+	/** Младшие биты Morton-кода + свёртка старших и бит за окном (дальние ячейки не липнут друг к другу) */
+	FORCEINLINE uint32 SlotOf(uint64 Key, const FInt64Vector& Cell) const
+	{
+		return uint32(Key ^ (Key >> 27) ^ (Key >> 45) ^ SRG_CellHighBitsHash(Cell)) & Mask;
+	}
+
+	static FORCEINLINE int32 RunCapacityFor(int32 Num)
+	{
+		return FMath::Max(MinRunCap, Num + Num / 2);
+	}
+
+	FORCEINLINE void MoveItem(int32 Dst, int32 Src)
+	{
+		Slab[Dst]  = MoveTemp(Slab[Src]);
+		SlabX[Dst] = SlabX[Src];
+		SlabY[Dst] = SlabY[Src];
+		SlabZ[Dst] = SlabZ[Src];
+		SlabCat[Dst] = SlabCat[Src];
+	}
+
+	void AddSlabDefaulted(int32 Count)
+	{
+		Slab.AddDefaulted(Count);
+		SlabX.AddZeroed(Count);
+		SlabY.AddZeroed(Count);
+		SlabZ.AddZeroed(Count);
+		SlabCat.AddZeroed(Count);
+	}
+
+	int32 FindOrAddSlot(const FInt64Vector& Cell)
+	{
+		// Load factor <= 0.5: пробы linear probing остаются короткими
+		if ((NumCells + 1) * 2 > Slots.Num())
+		{
+			GrowSlots();
+		}
+
+		const uint64 Key = SRG_MakeCellKey(Cell);
+		uint32 i = SlotOf(Key, Cell);
+		for (;; i = (i + 1) & Mask)
+		{
+			if (Slots[i].Key == Key && Slots[i].Cell == Cell) return int32(i);
+			if (Slots[i].Key == SRG_EmptyCellKey) break;
+		}
+		FCellSlot& C = Slots[i];
+		C.Cell  = Cell;
+		C.Key   = Key;
+		C.Start = Slab.Num();
+		C.Num   = 0;
+		C.Cap   = MinRunCap;
+		AddSlabDefaulted(MinRunCap);
+		++NumCells;
+		return int32(i);
+	}
+
+	void GrowRun(FCellSlot& C)
+	{
+		const int32 NewCap = FMath::Max(MinRunCap, C.Cap * 2);
+		// Прогон в хвосте Slab растёт на месте
+		if (C.Start + C.Cap == Slab.Num())
+		{
+			AddSlabDefaulted(NewCap - C.Cap);
+			C.Cap = NewCap;
+			return;
+		}
+
+		const int32 NewStart = Slab.Num();
+		AddSlabDefaulted(NewCap);
+		for (int32 i = 0; i < C.Num; ++i)
+		{
+			MoveItem(NewStart + i, C.Start + i);
+			Slab[C.Start + i] = ElementType();
+		}
+		SlabWaste += C.Cap;
+		C.Start = NewStart;
+		C.Cap   = NewCap;
+
+		if (SlabWaste > 1024 && SlabWaste * 2 > Slab.Num())
+		{
+			Compact();
+		}
+	}
+
+	void GrowSlots()
+	{
+		TArray<FCellSlot> Old = MoveTemp(Slots);
+		Slots.Reset();
+		Slots.SetNum(Old.Num() * 2);
+		Mask = uint32(Slots.Num() - 1);
+		for (const FCellSlot& C : Old)
+		{
+			if (C.Key == SRG_EmptyCellKey) continue;
+			uint32 i = SlotOf(C.Key, C.Cell);
+			while (Slots[i].Key != SRG_EmptyCellKey) i = (i + 1) & Mask;
+			Slots[i] = C;
+		}
+	}
+
+	/** Backward-shift удаление: без tombstone'ов, цепочки проб не деградируют */
+	void RemoveSlot(int32 S)
+	{
+		SlabWaste += Slots[S].Cap;
+		--NumCells;
+
+		uint32 i = uint32(S);
+		Slots[i] = FCellSlot();
+		for (uint32 j = (i + 1) & Mask; Slots[j].Key != SRG_EmptyCellKey; j = (j + 1) & Mask)
+		{
+			const uint32 k = SlotOf(Slots[j].Key, Slots[j].Cell);
+			// Слот j остаётся на месте, если его «домашний» k лежит в (i, j] по кругу
+			const bool bStays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+			if (bStays) continue;
+
+			Slots[i] = Slots[j];
+			Slots[j] = FCellSlot();
+			i = j;
+		}
+
+		if (NumCells == 0)
+		{
+			Slab.Reset();
+			SlabX.Reset();
+			SlabY.Reset();
+			SlabZ.Reset();
+			SlabCat.Reset();
+			SlabWaste = 0;
+		}
+		else if (SlabWaste > 1024 && SlabWaste * 2 > Slab.Num())
+		{
+			Compact();
+		}
+	}
+};
+
+/** Число категорий записей хэша: категория — индекс бита в 8-битной маске */
+static constexpr int32 SRG_MaxCategories = 8;
+
+/**
+ * Фильтр запроса по категориям: маска + свой радиус на каждую категорию.
+ * Категория записи лежит в байтовой дорожке рядом с позициями, так что отбор
+ * по ней идёт во внутреннем цикле, без резолва хэндла. Радиус категории вне
+ * маски — «минус один»: дистанция его никогда не пройдёт.
+ */
+struct FSRGCategoryRadii
+{
+	uint8  Mask = 0;
+	double RadiusUU[SRG_MaxCategories] = {};
+
+	/** Все категории с одним радиусом — обычный запрос по сфере */
+	static FSRGCategoryRadii All(double InRadiusUU)
+	{
+		FSRGCategoryRadii Out;
+		for (int32 c = 0; c < SRG_MaxCategories; ++c) Out.Set(uint8(c), InRadiusUU);
+		return Out;
+	}
+
+	/** Включить категорию с радиусом (<= 0 — выключить) */
+	FSRGCategoryRadii& Set(uint8 Category, double InRadiusUU)
+	{
+		check(Category < SRG_MaxCategories);
+		RadiusUU[Category] = FMath::Max(0.0, InRadiusUU);
+		if (InRadiusUU > 0.0) Mask |= uint8(1u << Category);
+		else                  Mask &= uint8(~(1u << Category));
+		return *this;
+	}
+
+	FORCEINLINE bool IsEmpty() const { return Mask == 0; }
+
+	double GetMaxRadius() const
+	{
+		double R = 0.0;
+		for (int32 c = 0; c < SRG_MaxCategories; ++c) if (Mask & (1u << c)) R = FMath::Max(R, RadiusUU[c]);
+		return R;
+	}
+
+	double GetMinRadius() const
+	{
+		double R = 0.0;
+		bool bAny = false;
+		for (int32 c = 0; c < SRG_MaxCategories; ++c)
+		{
+			if (!(Mask & (1u << c))) continue;
+			R = bAny ? FMath::Min(R, RadiusUU[c]) : RadiusUU[c];
+			bAny = true;
+		}
+		return R;
+	}
+
+	/** Таблица квадратов радиусов для внутреннего цикла: вне маски — -1 */
+	void MakeRadiusSqTable(float (&Out)[SRG_MaxCategories]) const
+	{
+		for (int32 c = 0; c < SRG_MaxCategories; ++c)
+		{
+			Out[c] = (Mask & (1u << c)) ? float(RadiusUU[c] * RadiusUU[c]) : -1.f;
+		}
+	}
+};
+
+/* ===================== Классификация ячеек против конуса и пирамиды обзора ===================== */
+
+/**
+ * Куб (рыхлой) ячейки против бесконечного конуса: апекс LocalApex (от начала
+ * сетки), единичная ось Axis, полуугол HalfAngle. Тест по описанной сфере куба —
+ * консервативный: «Outside» и «Inside» всегда верны, часть «Partial» — с запасом.
+ */
+FORCEINLINE ESRGCellOverlap SRG_ClassifyCellCone(const FVector& LocalApex, const FVector& Axis, double HalfAngle,
+                                                 const FInt64Vector& Cell, double CellUU, double LooseUU)
+{
+	const double  Half   = 0.5 * CellUU + LooseUU;
+	const FVector Center = SRG_CellCorner(Cell, CellUU) + FVector(0.5 * CellUU) - LocalApex;
+	const double  Rb     = Half * FMath::Sqrt(3.0);
+	const double  Len    = Center.Size();
+	if (Len <= Rb) return ESRGCellOverlap::Partial;  // апекс внутри описанной сферы
+
+	const double Theta  = FMath::Acos(FMath::Clamp(FVector::DotProduct(Center, Axis) / Len, -1.0, 1.0));
+	const double Spread = FMath::Asin(Rb / Len);
+	if (Theta - Spread > HalfAngle)  return ESRGCellOverlap::Outside;
+	if (Theta + Spread <= HalfAngle) return ESRGCellOverlap::Inside;
+	return ESRGCellOverlap::Partial;
+}
+
+/**
+ * Пирамида обзора для TSpatialHash3D::QueryFrustum: плоскости вида
+ * N·(P - Origin) <= Dist (нормали наружу). Четыре боковые проходят через
+ * Origin, дальняя — на RangeUU по оси взгляда. Bounds — AABB относительно Origin.
+ */
+struct FSRGViewFrustum
+{
+	static constexpr int32 MaxPlanes = 6;
+
+	FVector Origin    = FVector::ZeroVector;
+	FVector Forward   = FVector::ForwardVector;
+	double  RangeUU   = 0.0;
+	int32   NumPlanes = 0;
+	FVector Normal[MaxPlanes];
+	double  Dist[MaxPlanes] = {};
+	FVector BoundsMin = FVector::ZeroVector;
+	FVector BoundsMax = FVector::ZeroVector;
+
+	/** Симметричная пирамида: полууглы по горизонтали/вертикали (< 90°), дальность RangeUU */
+	static FSRGViewFrustum Make(const FVector& InOrigin, const FVector& InForward, const FVector& InUp,
+	                            double HalfFovXRad, double HalfFovYRad, double InRangeUU)
+	{
+		FSRGViewFrustum F;
+		F.Origin  = InOrigin;
+		F.Forward = InForward.GetSafeNormal();
+		F.RangeUU = FMath::Max(0.0, InRangeUU);
+		if (F.Forward.IsZero()) return F;
+
+		// Базис как у FRotationMatrix: X — вперёд, Y — вправо, Z — вверх
+		FVector Right = FVector::CrossProduct(InUp, F.Forward).GetSafeNormal();
+		if (Right.IsZero())
+		{
+			FVector Unused;
+			F.Forward.FindBestAxisVectors(Right, Unused);
+		}
+		const FVector Up = FVector::CrossProduct(F.Forward, Right);
+
+		const double Hx = FMath::Clamp(HalfFovXRad, 0.0, UE_DOUBLE_HALF_PI - 1e-3);
+		const double Hy = FMath::Clamp(HalfFovYRad, 0.0, UE_DOUBLE_HALF_PI - 1e-3);
+		const double Cx = FMath::Cos(Hx), Sx = FMath::Sin(Hx);
+		const double Cy = FMath::Cos(Hy), Sy = FMath::Sin(Hy);
+
+		F.AddPlane( Right * Cx - F.Forward * Sx, 0.0);
+		F.AddPlane(-Right * Cx - F.Forward * Sx, 0.0);
+		F.AddPlane( Up    * Cy - F.Forward * Sy, 0.0);
+		F.AddPlane(-Up    * Cy - F.Forward * Sy, 0.0);
+		F.AddPlane( F.Forward, F.RangeUU);
+
+		// AABB: апекс + четыре угла дальней грани
+		const double Tx = FMath::Tan(Hx) * F.RangeUU;
+		const double Ty = FMath::Tan(Hy) * F.RangeUU;
+		for (int32 sx = -1; sx <= 1; sx += 2)
+		for (int32 sy = -1; sy <= 1; sy += 2)
+		{
+			const FVector P = F.Forward * F.RangeUU + Right * (sx * Tx) + Up * (sy * Ty);
+			F.BoundsMin = F.BoundsMin.ComponentMin(P);
+			F.BoundsMax = F.BoundsMax.ComponentMax(P);
+		}
+		return F;
+	}
+
+	void AddPlane(const FVector& N, double D)
+	{
+		check(NumPlanes < MaxPlanes);
+		Normal[NumPlanes] = N;
+		Dist[NumPlanes]   = D;
+		++NumPlanes;
+	}
+
+	/** Коробка [Min, Max] (относительно Origin) против пирамиды */
+	ESRGCellOverlap ClassifyBox(const FVector& Min, const FVector& Max) const
+	{
+		const FVector Center = (Min + Max) * 0.5;
+		const FVector Extent = (Max - Min) * 0.5;
+		bool bInside = true;
+		for (int32 p = 0; p < NumPlanes; ++p)
+		{
+			const FVector& N = Normal[p];
+			const double S = FVector::DotProduct(N, Center) - Dist[p];
+			const double R = Extent.X * FMath::Abs(N.X) + Extent.Y * FMath::Abs(N.Y) + Extent.Z * FMath::Abs(N.Z);
+			if (S > R)  return ESRGCellOverlap::Outside;
+			if (S > -R) bInside = false;
+		}
+		return bInside ? ESRGCellOverlap::Inside : ESRGCellOverlap::Partial;
+	}
+};
+
+/**
+ * Скретч для TSpatialHash3D::QuerySpheresBatch. Свой на каждый поток,
+ * живёт между вызовами — после прогрева пакетный запрос не аллоцирует.
+ */
+struct FSRGBatchQueryScratch
+{
+	struct FViewer { uint64 HomeKey; FInt64Vector Home; int32 Index; };
+	struct FGroup  { int32 First; int32 Last; };   // диапазон в Viewers
+	struct FVisit  { int32 Slot;  int32 Group; };
+
+	TArray<FViewer>   Viewers;
+	TArray<FGroup>    Groups;
+	TArray<FVisit>    Visits;
+	TArray<int32>     Active;        // зрители с граничной ячейкой
+	TArray<FVector3f> ActiveCenters; // их центры относительно угла ячейки
+	TArray<int32>     ActiveInside;  // ячейка целиком в сфере
+};
+
+/** Скретч для TSpatialHash3D::QueryKNearest: bounded max-heap (distSq, индекс в Slab) */
+struct FSRGKnnScratch
+{
+	struct FItem { double DistSq; int32 SlabIndex; };
+	TArray<FItem> Heap;
+};
+
+/** Скретч для TSpatialHash3D::(Parallel)ForEachPairWithin: трафарет соседей и список ячеек */
+struct FSRGPairScratch
+{
+	TArray<FInt64Vector> Stencil;
+	TArray<int32>        Slots;
+};
+
+/* ===================== Инструментирование ===================== */
+
+/** Счётчики стоимости запросов; в Shipping вырезаются (SRG_TALLY — пусто) */
+#ifndef SRG_WITH_QUERY_COUNTERS
+	#define SRG_WITH_QUERY_COUNTERS !UE_BUILD_SHIPPING
+#endif
+
+#if SRG_WITH_QUERY_COUNTERS
+	#define SRG_TALLY(...) __VA_ARGS__
+#else
+	#define SRG_TALLY(...)
+#endif
+
+/**
+ * Накопленная стоимость запросов к хэшу: ячейки, найденные поиском в таблице
+ * (Visited) и непустые из них (Hit), записи непустых ячеек (Tested) и
+ * попавшие в ответ (Accepted). Пишут запросы с любых потоков (relaxed atomics),
+ * забирает и обнуляет владелец раз в кадр (Consume).
+ */
+struct FSRGQueryCounters
+{
+	struct FValues
+	{
+		int64 Queries      = 0;
+		int64 CellsVisited = 0;
+		int64 CellsHit     = 0;
+		int64 Tested       = 0;
+		int64 Accepted     = 0;
+
+		FValues& operator+=(const FValues& O)
+		{
+			Queries += O.Queries; CellsVisited += O.CellsVisited; CellsHit += O.CellsHit;
+			Tested  += O.Tested;  Accepted     += O.Accepted;
+			return *this;
+		}
+	};
+
+	FSRGQueryCounters() = default;
+	// Счётчики принадлежат своему хэшу: копия начинает с нуля
+	FSRGQueryCounters(const FSRGQueryCounters&) {}
+	FSRGQueryCounters& operator=(const FSRGQueryCounters&) { return *this; }
+
+	FORCEINLINE void Add(const FValues& V)
+	{
+		Queries.fetch_add(V.Queries, std::memory_order_relaxed);
+		CellsVisited.fetch_add(V.CellsVisited, std::memory_order_relaxed);
+		CellsHit.fetch_add(V.CellsHit, std::memory_order_relaxed);
+		Tested.fetch_add(V.Tested, std::memory_order_relaxed);
+		Accepted.fetch_add(V.Accepted, std::memory_order_relaxed);
+	}
+
+	/** Забрать накопленное с обнулением */
+	FValues Consume()
+	{
+		FValues V;
+		V.Queries      = Queries.exchange(0, std::memory_order_relaxed);
+		V.CellsVisited = CellsVisited.exchange(0, std::memory_order_relaxed);
+		V.CellsHit     = CellsHit.exchange(0, std::memory_order_relaxed);
+		V.Tested       = Tested.exchange(0, std::memory_order_relaxed);
+		V.Accepted     = Accepted.exchange(0, std::memory_order_relaxed);
+		return V;
+	}
+
+private:
+	std::atomic<int64> Queries{ 0 };
+	std::atomic<int64> CellsVisited{ 0 };
+	std::atomic<int64> CellsHit{ 0 };
+	std::atomic<int64> Tested{ 0 };
+	std::atomic<int64> Accepted{ 0 };
+};
+
+/** Счёт одного запроса в локальных полях; сливается в FSRGQueryCounters в деструкторе */
+struct FSRGQueryTally
+{
+	FSRGQueryCounters&         Sink;
+	FSRGQueryCounters::FValues V;
+
+	explicit FSRGQueryTally(FSRGQueryCounters& InSink, int32 NumQueries = 1) : Sink(InSink) { V.Queries = NumQueries; }
+	~FSRGQueryTally() { Sink.Add(V); }
+
+	/** Ячейка найдена поиском в таблице: NumInCell записей или INDEX_NONE — пустая */
+	FORCEINLINE void Visit(int32 NumInCell)
+	{
+		++V.CellsVisited;
+		if (NumInCell == INDEX_NONE) return;
+		++V.CellsHit;
+		V.Tested += NumInCell;
+	}
+};
+
+/** Итог одного Refresh(): перечитанные записи, релинки (смены ячейки), выброшенные невалидные */
+struct FSRGRefreshStats
+{
+	int32 Reads   = 0;
+	int32 Relinks = 0;
+	int32 Dropped = 0;
+};
+
+/** Заполненность таблицы ячеек: гистограмма записей на ячейку по степеням двойки */
+struct FSRGOccupancy
+{
+	static constexpr int32 NumBuckets = 10;  // 1, 2-3, 4-7, ..., 256-511, 512+
+
+	int32 NumSlots   = 0;  // ёмкость open-addressing таблицы (бакеты)
+	int32 NumCells   = 0;  // непустые ячейки
+	int32 NumEntries = 0;
+	int32 MaxPerCell = 0;
+	int32 SlabSize   = 0;  // с резервом прогонов и дырами
+	int32 Histogram[NumBuckets] = {};
+
+	FORCEINLINE float GetMeanPerCell() const { return NumCells > 0 ? float(NumEntries) / float(NumCells) : 0.f; }
+
+	/** Нижняя граница корзины b: 1, 2, 4, ... */
+	static FORCEINLINE int32 BucketFloor(int32 b) { return 1 << b; }
+	static FORCEINLINE int32 BucketOf(int32 Num) { return FMath::Min(NumBuckets - 1, int32(FMath::FloorLog2(uint32(FMath::Max(1, Num))))); }
+};
+
+/**
+ * TSpatialHash3D — компактный 3D spatial hash по хэндлам:
+ * - Хранит хэндлы по кубическим ячейкам размера CellUU (см).
+ * - Ячейки — плоская open-addressing таблица с 64-битными координатами и
+ *   Morton-порядком (TSRGCellTable), записи всех ячеек лежат в одном общем Slab
+ *   рядом с SoA-кэшем позиций.
+ * - Координаты ячеек — int64, считаются в double: хэш точен и за много а.е. от
+ *   начала мира (LWC). Ядро теста расстояния — float в координатах ячейки.
+ * - Поддерживает Bias со снэпом к сетке; смена Bias — O(1) сдвиг ключей (CellOffset),
+ *   полный ре-хеш только при смене размера ячейки.
+ * - Раз в кадр Refresh(): перечитать позиции, переложить «съехавших», убрать invalid.
+ *   Перечитываются только «грязные» записи — те, что по оценке скорости могли
+ *   уйти из ячейки или дальше допуска RefreshToleranceUU.
+ * - Опциональная рыхлая сетка (SetLooseMargin): ячейка меняется только после
+ *   выхода за её грань дальше запаса — корабли на границе не перекладываются
+ *   каждый кадр; запросы расширяют диапазон ячеек на этот запас.
+ * - Быстрые запросы по сфере / K-ближайших (оболочками, с bounded heap) и пакетный
+ *   QuerySpheresBatch для многих зрителей сразу (каждая ячейка — один раз).
+ * - Упреждающий QueryApproaching: кто войдёт в сферу за горизонт T (по скоростям записей).
+ * - Запросы по конусу/пирамиде обзора (QueryCone/QueryFrustum): ячейки вне
+ *   объёма отсекаются целиком, у попаданий — угол от оси взгляда.
+ *
+ * HandleType — плотный целый индекс (>= 0): запись хэндла (ячейка, позиция) лежит
+ * в массиве по этому индексу, без хэширования. Выдача/переиспользование индексов
+ * и поколения — забота владельца (см. FSRGActorHandleTable).
+ * PositionPolicy — стратегия по значению, знает, как хэндл превращается в объект:
+ *   using FResolved = ...;                       // указатель-подобный; «ложь» — хэндл мёртв
+ *   FResolved Resolve(const HandleType&) const;
+ *   FVector   GetLocation(FResolved) const;
+ *   FVector   GetVelocity(FResolved) const;
+ * Запросы отдают FResolved; Resolve зовётся только у прошедших отбор.
+ *
+ * Мутации (Add/Remove/Update/Refresh/SetBias/SetCellSize) — из одного потока.
+ * Запросы const, без аллокаций (Out переиспользует ёмкость) и безопасны
+ * для параллельного вызова между двумя Refresh(), если это позволяет Policy.
+ */
+template<typename HandleType, typename PositionPolicy>
+class TSpatialHash3D
+{
+public:
+	static_assert(std::is_integral_v<HandleType>, "TSpatialHash3D: HandleType must be a dense integer index");
+
+	using FResolved = typename PositionPolicy::FResolved;
+
+	TSpatialHash3D() = default;
+	explicit TSpatialHash3D(const PositionPolicy& InPolicy) : Policy(InPolicy) {}
+
+	/** Инициализация: размер ячейки в UU (см) */
+	void Init(float InCellUU)
+	{
+		Bias = FVector::ZeroVector;
+		SetCellSize(FMath::Max(1.f, InCellUU));
+	}
+
+	/** Задать новый размер ячейки (полный ре-хеш) */
+	void SetCellSize(float InCellUU)
+	{
+		CellUU    = FMath::Max(1.0, double(InCellUU));
+		InvCellUU = 1.0 / CellUU;
+		LooseUU   = FMath::Min(LooseUU, CellUU);
+		RehashAll();
+	}
+
+	/**
+	 * Сменить Bias (снэп к сетке) за O(1). Bias всегда кратен CellUU, значит
+	 * ребиас — целочисленный сдвиг всех ключей: копим его в CellOffset и
+	 * применяем при вычислении ячейки. Хранимые ключи и Slab не трогаются.
+	 */
+	void SetBias(const FVector& NewBias)
+	{
+		const FInt64Vector BiasCells(
+			int64(FMath::RoundToDouble(NewBias.X * InvCellUU)),
+			int64(FMath::RoundToDouble(NewBias.Y * InvCellUU)),
+			int64(FMath::RoundToDouble(NewBias.Z * InvCellUU)));
+
+		const FInt64Vector NewOffset = BiasCells - BiasCellsAtRehash;
+		if (NewOffset == CellOffset) return;
+
+		CellOffset = NewOffset;
+		Bias       = SRG_CellCorner(BiasCells, CellUU);
+		// GridOrigin не меняется: Bias и CellOffset сдвинулись на одно и то же
+	}
+
+	FORCEINLINE const FVector&      GetBias()       const { return Bias; }
+	FORCEINLINE const FInt64Vector& GetCellOffset() const { return CellOffset; }
+	FORCEINLINE double              GetCellSize()   const { return CellUU; }
+
+	/**
+	 * Параметры грязного трекинга Refresh():
+	 * ToleranceUU     — насколько кэш позиции может отстать от актёра;
+	 * FullSweepSec    — период полного прохода (ловит телепорты и резкие разгоны).
+	 */
+	void SetRefreshParams(float ToleranceUU, float FullSweepSec)
+	{
+		RefreshToleranceUU = FMath::Max(0.f, ToleranceUU);
+		FullSweepPeriodSec = FMath::Max(0.f, FullSweepSec);
+	}
+
+	/**
+	 * Рыхлая сетка: актёр покидает ячейку, только выйдя за её грань дальше
+	 * MarginUU (гистерезис против релинка на границе). Запросы расширяют
+	 * диапазон ячеек на тот же запас. 0 — строгая сетка. Не больше CellUU.
+	 */
+	void SetLooseMargin(float MarginUU)
+	{
+		const double NewLoose = FMath::Clamp(double(MarginUU), 0.0, CellUU);
+		if (NewLoose < LooseUU)
+		{
+			// Часть записей могла оказаться за новой гранью: ближайший Refresh пройдёт всех
+			LastFullSweepTime = -1e30;
+		}
+		LooseUU = NewLoose;
+	}
+
+	FORCEINLINE float GetLooseMargin() const { return float(LooseUU); }
+
+	/** Смен ячейки (релинков) в секунду, по окну ~1 с — для подбора запаса рыхлой сетки */
+	FORCEINLINE float GetRelinksPerSecond() const { return RelinksPerSec; }
+
+	/** Наибольшая скорость записей (см/с) по последнему полному проходу Refresh и после него */
+	FORCEINLINE float GetMaxSpeed() const { return MaxSpeedUU; }
+
+	/* Инструментирование: итог последнего Refresh, стоимость запросов, заполненность ячеек */
+	FORCEINLINE const FSRGRefreshStats& GetLastRefreshStats() const { return LastRefreshStats; }
+
+	/** Забрать стоимость запросов, накопленную с прошлого вызова (раз в кадр, game thread) */
+	FSRGQueryCounters::FValues ConsumeQueryCounters() const { return QueryCounters.Consume(); }
+
+	/** Гистограмма записей на ячейку, максимум и ёмкость таблицы — O(ячеек) */
+	void GetOccupancy(FSRGOccupancy& Out) const
+	{
+		Out = FSRGOccupancy();
+		Out.NumSlots = Cells.GetNumSlots();
+		Out.NumCells = Cells.Num();
+		Out.SlabSize = Cells.GetSlabSize();
+		Cells.ForEachCell([this, &Out](const FInt64Vector& /*Cell*/, int32 Slot)
+		{
+			const int32 N = Cells.GetSlot(Slot).Num;
+			Out.NumEntries += N;
+			Out.MaxPerCell  = FMath::Max(Out.MaxPerCell, N);
+			++Out.Histogram[FSRGOccupancy::BucketOf(N)];
+		});
+	}
+
+	/** Обойти непустые ячейки: Fn(Cell, мировой угол ячейки, категории записей) — для дампа карты */
+	template<typename FuncType>
+	void ForEachCellInfo(FuncType&& Fn) const
+	{
+		const uint8* PC = Cells.GetSlabCategory();
+		Cells.ForEachCell([&](const FInt64Vector& Cell, int32 Slot)
+		{
+			const typename TSRGCellTable<FEntry>::FCellSlot& S = Cells.GetSlot(Slot);
+			Fn(Cell, GridOrigin + SRG_CellCorner(Cell, CellUU), TConstArrayView<uint8>(PC + S.Start, S.Num));
+		});
+	}
+
+	/**
+	 * Добавить объект в структуру (уже добавленный — обновить).
+	 * Category — индекс категории (< SRG_MaxCategories) для фильтра запросов;
+	 * у добавленного ранее не меняется — для этого SetCategory().
+	 */
+	void Add(HandleType H, uint8 Category = 0)
+	{
+		check(H >= 0 && Category < SRG_MaxCategories);
+		const FResolved R = Policy.Resolve(H);
+		if (!R) return;
+		if (Contains(H)) { Update(H); return; }
+
+		if (int32(H) >= Records.Num())
+		{
+			Records.SetNum(int32(H) + 1);
+		}
+
+		const FVector      Loc  = Policy.GetLocation(R);
+		const FInt64Vector Cell = WorldToCell(Loc);
+		Cells.Add(Cell, MakeEntry(H), ToCellLocal(Loc, Cell), Category);
+
+		FRecord& Rec = Records[H];
+		Rec.Cell     = Cell;
+		Rec.Location = Loc;
+		Rec.Category = Category;
+		Rec.bLinked  = true;
+		++NumLinked;
+	}
+
+	/** Удалить объект из структуры: O(1) по хэндлу + короткий проход по прогону ячейки */
+	void Remove(HandleType H)
+	{
+		if (!Contains(H)) return;
+		FRecord& Rec = Records[H];
+		RemoveEntry(Rec.Cell, H);
+		Rec.bLinked = false;
+		--NumLinked;
+	}
+
+	/** Явное обновление позиции конкретного объекта (телепорт, спавн и т.п.) */
+	void Update(HandleType H)
+	{
+		const FResolved R = Policy.Resolve(H);
+		if (!R) { Remove(H); return; }
+		if (!Contains(H))
+		{
+			// не было в структуре — добавить
+			Add(H);
+			return;
+		}
+
+		const FVector Loc = Policy.GetLocation(R);
+		FRecord& Rec = Records[H];
+		Rec.Location = Loc;
+		if (StaysInCell(Loc, Rec.Cell))
+		{
+			// Ноль в NextRefreshTime — следующий Refresh перечитает и скорость
+			SetCachedLocation(Rec.Cell, H, Loc);
+			return;
+		}
+		const FInt64Vector NewCell = WorldToCell(Loc);
+		RemoveEntry(Rec.Cell, H);
+		Cells.Add(NewCell, MakeEntry(H), ToCellLocal(Loc, NewCell), Rec.Category);
+		Rec.Cell = NewCell;
+		++RelinkCount;
+	}
+
+	FORCEINLINE bool Contains(HandleType H) const { return H >= 0 && int32(H) < Records.Num() && Records[H].bLinked; }
+	FORCEINLINE int32 Num() const { return NumLinked; }
+
+	/** Верхняя граница индексов хэндлов, виденных структурой */
+	FORCEINLINE int32 GetHandleCapacity() const { return Records.Num(); }
+
+	/** Позиция объекта на последнем чтении (Add/Update/Refresh); точность — RefreshToleranceUU */
+	FORCEINLINE const FVector& GetCachedLocation(HandleType H) const { check(Contains(H)); return Records[H].Location; }
+
+	/** Хранимая ячейка объекта (с учётом рыхлой сетки) */
+	FORCEINLINE const FInt64Vector& GetCell(HandleType H) const { check(Contains(H)); return Records[H].Cell; }
+
+	FORCEINLINE uint8 GetCategory(HandleType H) const { check(Contains(H)); return Records[H].Category; }
+
+	/** Сменить категорию объекта (смена владельца, посадка игрока и т.п.): один проход по прогону ячейки */
+	void SetCategory(HandleType H, uint8 Category)
+	{
+		check(Category < SRG_MaxCategories);
+		if (!Contains(H)) return;
+		FRecord& Rec = Records[H];
+		if (Rec.Category == Category) return;
+		Rec.Category = Category;
+
+		const int32 Idx = FindEntryIndex(Rec.Cell, H);
+		if (Idx != INDEX_NONE)
+		{
+			Cells.SetCategory(Idx, Category);
+		}
+	}
+
+	/**
+	 * Раз в кадр (сервер, game thread). Перечитывает позицию/скорость только у
+	 * записей, чей NextRefreshTime наступил: до этого момента актёр, двигаясь не
+	 * быстрее |v|*RefreshSpeedMargin, не мог покинуть ячейку или уйти от кэша
+	 * дальше RefreshToleranceUU. Раз в FullSweepPeriodSec проходим всех.
+	 * Тут же релинк сменивших ячейку (с учётом запаса рыхлой сетки) и уборка невалидных.
+	 * Возвращает число выброшенных невалидных хэндлов.
+	 */
+	int32 Refresh(double NowSeconds)
+	{
+		const bool bFullSweep = (NowSeconds - LastFullSweepTime) >= FullSweepPeriodSec;
+		if (bFullSweep)
+		{
+			LastFullSweepTime = NowSeconds;
+		}
+
+		PendingMoves.Reset();
+		bool  bHasInvalid = false;
+		float MaxSpeedSq  = 0.f;  // по перечитанным записям
+		int32 Reads       = 0;
+
+		Cells.ForEachCell([this, NowSeconds, bFullSweep, &bHasInvalid, &MaxSpeedSq, &Reads](const FInt64Vector& Cell, int32 Slot)
+		{
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				FEntry& E = Cells.GetItemMutable(Idx);
+				if (!bFullSweep && NowSeconds < E.NextRefreshTime) continue;
+
+				const FResolved R = Policy.Resolve(E.Handle);
+				if (!R)
+				{
+					bHasInvalid = true;
+					continue;
+				}
+
+				++Reads;
+				const FVector Loc = Policy.GetLocation(R);
+				const FVector Vel = Policy.GetVelocity(R);
+				E.Vel = FVector3f(Vel);
+				MaxSpeedSq = FMath::Max(MaxSpeedSq, E.Vel.SizeSquared());
+				Records[E.Handle].Location = Loc;
+
+				if (StaysInCell(Loc, Cell))
+				{
+					E.NextRefreshTime = NowSeconds + ComputeRefreshDelay(Loc, Cell, Vel);
+					Cells.SetLocalPosition(Idx, ToCellLocal(Loc, Cell));
+				}
+				else
+				{
+					const FInt64Vector NewCell = WorldToCell(Loc);
+					E.NextRefreshTime = NowSeconds + ComputeRefreshDelay(Loc, NewCell, Vel);
+					PendingMoves.Add({ E, Cell, NewCell, Loc });
+				}
+			}
+		});
+
+		// Перекладываем после обхода: вставка может переложить Slab
+		for (const FPendingMove& M : PendingMoves)
+		{
+			RemoveEntry(M.OldCell, M.Entry.Handle);
+			FRecord& Rec = Records[M.Entry.Handle];
+			Cells.Add(M.NewCell, M.Entry, ToCellLocal(M.Loc, M.NewCell), Rec.Category);
+			Rec.Cell = M.NewCell;
+		}
+		RelinkCount += PendingMoves.Num();
+
+		// Полный проход видел всех — оценка точная; иначе только растёт до следующего
+		MaxSpeedUU = bFullSweep ? FMath::Sqrt(MaxSpeedSq) : FMath::Max(MaxSpeedUU, FMath::Sqrt(MaxSpeedSq));
+
+		const int32 Dropped = bHasInvalid ? RemoveInvalids() : 0;
+
+		LastRefreshStats.Reads   = Reads;
+		LastRefreshStats.Relinks = PendingMoves.Num();
+		LastRefreshStats.Dropped = Dropped;
+
+		const double RelinkWindow = NowSeconds - RelinkWindowStart;
+		if (RelinkWindow >= 1.0 || RelinkWindow < 0.0)
+		{
+			RelinksPerSec     = (RelinkWindow > 0.0) ? float(RelinkCount / RelinkWindow) : 0.f;
+			RelinkCount       = 0;
+			RelinkWindowStart = NowSeconds;
+		}
+		return Dropped;
+	}
+
+	/**
+	 * Быстрый отбор по сфере (uu). Out — без дублей.
+	 * Кубы ячеек классифицируются против сферы: внешние пропускаются без поиска
+	 * в хэше, внутренние забираются целиком, по актёрам тестируются только
+	 * граничные. Тест идёт по SoA-кэшу позиций (точность — RefreshToleranceUU)
+	 * во float: центр один раз на ячейку переводится в её координаты.
+	 * Хэндл резолвится (Policy.Resolve) только у прошедших.
+	 */
+	void QuerySphere(const FVector& Center, double RadiusUU, TArray<FResolved>& Out) const
+	{
+		QuerySphere(Center, FSRGCategoryRadii::All(RadiusUU), Out);
+	}
+
+	/**
+	 * Отбор по категориям: только категории из Radii.Mask, у каждой свой радиус.
+	 * Ячейки обходятся по наибольшему радиусу; «целиком внутри» — по наименьшему.
+	 * Категория берётся из байтовой дорожки рядом с позициями, объект не трогаем.
+	 */
+	void QuerySphere(const FVector& Center, const FSRGCategoryRadii& Radii, TArray<FResolved>& Out) const
+	{
+		Out.Reset();
+		const double MaxRadiusUU = Radii.GetMaxRadius();
+		if (MaxRadiusUU <= 0.0) return;
+		const double MinRadiusUU = Radii.GetMinRadius();
+
+		float RadiusSq[SRG_MaxCategories];
+		Radii.MakeRadiusSqTable(RadiusSq);
+		const FVector Local = Center - GridOrigin;
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters));
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		SRG_ForEachSphereCell(Local, MaxRadiusUU, CellUU, LooseUU, [&](const FInt64Vector& Cell, bool bInsideMax)
+		{
+			const int32 Slot = Cells.FindSlot(Cell);
+			SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+			if (Slot == INDEX_NONE) return;
+
+			const bool bFullyInside = bInsideMax && (MinRadiusUU >= MaxRadiusUU
+				|| SRG_ClassifyCell(Local, Cell, CellUU, LooseUU, MinRadiusUU * MinRadiusUU) == ESRGCellOverlap::Inside);
+
+			const FVector3f C(Local - SRG_CellCorner(Cell, CellUU));
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				const float Rsq = RadiusSq[PC[Idx]];
+				if (Rsq < 0.f) continue;  // категория вне маски
+
+				if (!bFullyInside)
+				{
+					const float dx = PX[Idx] - C.X;
+					const float dy = PY[Idx] - C.Y;
+					const float dz = PZ[Idx] - C.Z;
+					if (dx*dx + dy*dy + dz*dz > Rsq) continue;
+				}
+
+				if (const FResolved R = Policy.Resolve(Cells.GetItem(Idx).Handle))
+				{
+					Out.Add(R);
+				}
+			}
+		});
+		SRG_TALLY(Tally.V.Accepted = Out.Num());
+	}
+
+	/**
+	 * Пакетный отбор по сферам одного радиуса для многих зрителей.
+	 * Зрители группируются по «домашней» ячейке, каждая затронутая ячейка
+	 * обходится один раз: её актёры тестируются против всех зрителей, чья
+	 * сфера пересекает куб ячейки, и раскладываются в Out[i] (для Centers[i]).
+	 * Массивы Out и Scratch принадлежат вызывающему, ёмкость переиспользуется.
+	 */
+	void QuerySpheresBatch(TArrayView<const FVector> Centers, double RadiusUU,
+	                       TArrayView<TArray<FResolved>> Out, FSRGBatchQueryScratch& Scratch) const
+	{
+		QuerySpheresBatch(Centers, FSRGCategoryRadii::All(RadiusUU), Out, Scratch);
+	}
+
+	/** Пакетный отбор по категориям (см. QuerySphere с FSRGCategoryRadii) */
+	void QuerySpheresBatch(TArrayView<const FVector> Centers, const FSRGCategoryRadii& Radii,
+	                       TArrayView<TArray<FResolved>> Out, FSRGBatchQueryScratch& Scratch) const
+	{
+		check(Out.Num() >= Centers.Num());
+		for (int32 v = 0; v < Centers.Num(); ++v) Out[v].Reset();
+		const double RadiusUU = Radii.GetMaxRadius();
+		if (RadiusUU <= 0.0 || Centers.Num() == 0) return;
+
+		const double RadiusSq    = RadiusUU * RadiusUU;
+		const double MinRadiusSq = FMath::Square(Radii.GetMinRadius());
+		float RadiusSqByCat[SRG_MaxCategories];
+		Radii.MakeRadiusSqTable(RadiusSqByCat);
+		const FVector R(RadiusUU + LooseUU);  // актёры рыхлой ячейки — до LooseUU за гранью
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters, Centers.Num()));
+
+		// 1) Зрители, отсортированные по домашней ячейке
+		Scratch.Viewers.Reset();
+		for (int32 v = 0; v < Centers.Num(); ++v)
+		{
+			const FInt64Vector Home = WorldToCell(Centers[v]);
+			Scratch.Viewers.Add({ SRG_MakeCellKey(Home), Home, v });
+		}
+		Scratch.Viewers.Sort([](const FSRGBatchQueryScratch::FViewer& L, const FSRGBatchQueryScratch::FViewer& Rh)
+		{
+			return (L.HomeKey != Rh.HomeKey) ? (L.HomeKey < Rh.HomeKey) : SRG_CellLess(L.Home, Rh.Home);
+		});
+
+		// 2) Для каждой группы — объединённый AABB ячеек; пары (слот, группа)
+		Scratch.Groups.Reset();
+		Scratch.Visits.Reset();
+		for (int32 First = 0; First < Scratch.Viewers.Num(); )
+		{
+			int32 Last = First + 1;
+			while (Last < Scratch.Viewers.Num() && Scratch.Viewers[Last].Home == Scratch.Viewers[First].Home) ++Last;
+
+			FInt64Vector MinC(MAX_int64), MaxC(MIN_int64);
+			for (int32 k = First; k < Last; ++k)
+			{
+				const FVector& C = Centers[Scratch.Viewers[k].Index];
+				const FInt64Vector Lo = WorldToCell(C - R);
+				const FInt64Vector Hi = WorldToCell(C + R);
+				MinC = FInt64Vector(FMath::Min(MinC.X, Lo.X), FMath::Min(MinC.Y, Lo.Y), FMath::Min(MinC.Z, Lo.Z));
+				MaxC = FInt64Vector(FMath::Max(MaxC.X, Hi.X), FMath::Max(MaxC.Y, Hi.Y), FMath::Max(MaxC.Z, Hi.Z));
+			}
+
+			const int32 GroupIdx = Scratch.Groups.Add({ First, Last });
+			for (int64 cz = MinC.Z; cz <= MaxC.Z; ++cz)
+			for (int64 cy = MinC.Y; cy <= MaxC.Y; ++cy)
+			for (int64 cx = MinC.X; cx <= MaxC.X; ++cx)
+			{
+				const FInt64Vector Cell(cx, cy, cz);
+
+				// Ячейку вне всех сфер группы в хэше не ищем
+				bool bTouched = false;
+				for (int32 k = First; k < Last && !bTouched; ++k)
+				{
+					bTouched = SRG_ClassifyCell(Centers[Scratch.Viewers[k].Index] - GridOrigin, Cell, CellUU, LooseUU, RadiusSq) != ESRGCellOverlap::Outside;
+				}
+				if (!bTouched) continue;
+
+				const int32 Slot = Cells.FindSlot(Cell);
+				SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+				if (Slot != INDEX_NONE)
+				{
+					Scratch.Visits.Add({ Slot, GroupIdx });
+				}
+			}
+			First = Last;
+		}
+
+		// 3) Каждая ячейка — один раз, со всеми группами, которые её задели
+		Scratch.Visits.Sort([](const FSRGBatchQueryScratch::FVisit& L, const FSRGBatchQueryScratch::FVisit& Rh)
+		{
+			return L.Slot < Rh.Slot;
+		});
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		for (int32 First = 0; First < Scratch.Visits.Num(); )
+		{
+			const int32 Slot = Scratch.Visits[First].Slot;
+			int32 Last = First + 1;
+			while (Last < Scratch.Visits.Num() && Scratch.Visits[Last].Slot == Slot) ++Last;
+
+			// Оставляем зрителей, чья сфера задевает куб ячейки; «целиком внутри» — без тестов
+			const FInt64Vector& Cell   = Cells.GetSlot(Slot).Cell;
+			const FVector       Corner = GridOrigin + SRG_CellCorner(Cell, CellUU);
+
+			Scratch.Active.Reset();
+			Scratch.ActiveCenters.Reset();
+			Scratch.ActiveInside.Reset();
+			for (int32 k = First; k < Last; ++k)
+			{
+				const FSRGBatchQueryScratch::FGroup& G = Scratch.Groups[Scratch.Visits[k].Group];
+				for (int32 g = G.First; g < G.Last; ++g)
+				{
+					const int32 v = Scratch.Viewers[g].Index;
+					ESRGCellOverlap Overlap = SRG_ClassifyCell(Centers[v] - GridOrigin, Cell, CellUU, LooseUU, RadiusSq);
+					if (Overlap == ESRGCellOverlap::Inside && MinRadiusSq < RadiusSq)
+					{
+						// Внутри самой большой сферы, но не обязательно внутри меньших
+						Overlap = SRG_ClassifyCell(Centers[v] - GridOrigin, Cell, CellUU, LooseUU, MinRadiusSq) == ESRGCellOverlap::Inside
+							? ESRGCellOverlap::Inside : ESRGCellOverlap::Partial;
+					}
+					switch (Overlap)
+					{
+					case ESRGCellOverlap::Inside:
+						Scratch.ActiveInside.Add(v);
+						break;
+					case ESRGCellOverlap::Partial:
+						Scratch.Active.Add(v);
+						Scratch.ActiveCenters.Add(FVector3f(Centers[v] - Corner));
+						break;
+					default: break;
+					}
+				}
+			}
+			First = Last;
+			if (Scratch.Active.Num() == 0 && Scratch.ActiveInside.Num() == 0) continue;
+
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				const float Rsq = RadiusSqByCat[PC[Idx]];
+				if (Rsq < 0.f) continue;  // категория вне маски
+
+				// Хэндл резолвим один раз на объект, а не на зрителя
+				FResolved A = FResolved();
+				bool bResolved = false;
+				auto Resolve = [&]()
+				{
+					if (!bResolved)
+					{
+						A = Policy.Resolve(Cells.GetItem(Idx).Handle);
+						bResolved = true;
+					}
+					return A;
+				};
+
+				for (int32 v : Scratch.ActiveInside)
+				{
+					if (!Resolve()) break;
+					Out[v].Add(A);
+				}
+
+				for (int32 a = 0; a < Scratch.Active.Num(); ++a)
+				{
+					const FVector3f& C = Scratch.ActiveCenters[a];
+					const float dx = PX[Idx] - C.X;
+					const float dy = PY[Idx] - C.Y;
+					const float dz = PZ[Idx] - C.Z;
+					if (dx*dx + dy*dy + dz*dz > Rsq) continue;
+
+					if (!Resolve()) break;
+					Out[Scratch.Active[a]].Add(A);
+				}
+			}
+		}
+		SRG_TALLY(for (int32 v = 0; v < Centers.Num(); ++v) Tally.V.Accepted += Out[v].Num());
+	}
+
+	/**
+	 * K-ближайших объектов к Center (до MaxRadiusUU), Out — по возрастанию дистанции.
+	 * Настоящий KNN: ячейки обходятся расширяющимися оболочками (куб Чебышёва
+	 * радиуса s вокруг домашней ячейки), лучшие K держатся в max-heap по distSq.
+	 * Обход останавливается, как только ближайшая точка следующей оболочки дальше
+	 * текущего K-го. Scratch — свой на поток; после прогрева без аллокаций.
+	 */
+	void QueryKNearest(const FVector& Center, int32 K, double MaxRadiusUU, TArray<FResolved>& Out, FSRGKnnScratch& Scratch) const
+	{
+		QueryKNearest(Center, K, FSRGCategoryRadii::All(MaxRadiusUU), Out, Scratch);
+	}
+
+	/** K-ближайших среди категорий Radii.Mask, каждая — не дальше своего радиуса */
+	void QueryKNearest(const FVector& Center, int32 K, const FSRGCategoryRadii& Radii, TArray<FResolved>& Out, FSRGKnnScratch& Scratch) const
+	{
+		Out.Reset();
+		const double MaxRadiusUU = Radii.GetMaxRadius();
+		if (K <= 0 || MaxRadiusUU <= 0.0) return;
+
+		float RadiusSqByCat[SRG_MaxCategories];
+		Radii.MakeRadiusSqTable(RadiusSqByCat);
+
+		using FHeapItem = FSRGKnnScratch::FItem;
+		auto HeapPred = [](const FHeapItem& L, const FHeapItem& R){ return L.DistSq > R.DistSq; }; // max-heap
+
+		TArray<FHeapItem>& Heap = Scratch.Heap;
+		Heap.Reset();
+
+		const double MaxRadiusSq = MaxRadiusUU * MaxRadiusUU;
+		const FVector Local = Center - GridOrigin;
+		const FInt64Vector Home = WorldToCell(Center);
+
+		// Ближайшая грань домашней ячейки: от неё считается минимум до оболочки s
+		const FVector Frac = (Local - SRG_CellCorner(Home, CellUU)) * InvCellUU;
+		const double FaceGap = FMath::Min3(
+			FMath::Min(Frac.X, 1.0 - Frac.X),
+			FMath::Min(Frac.Y, 1.0 - Frac.Y),
+			FMath::Min(Frac.Z, 1.0 - Frac.Z)) * CellUU;
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters));
+
+		// Текущая граница отсечения: K-й лучший или MaxRadius
+		auto BoundSq = [&]()
+		{
+			return (Heap.Num() >= K) ? FMath::Min(Heap.HeapTop().DistSq, MaxRadiusSq) : MaxRadiusSq;
+		};
+
+		auto VisitCell = [&](const FInt64Vector& Cell)
+		{
+			double NxSq, FxSq, NySq, FySq, NzSq, FzSq;
+			SRG_AxisCellDistSq(Local.X, Cell.X, CellUU, LooseUU, NxSq, FxSq);
+			SRG_AxisCellDistSq(Local.Y, Cell.Y, CellUU, LooseUU, NySq, FySq);
+			SRG_AxisCellDistSq(Local.Z, Cell.Z, CellUU, LooseUU, NzSq, FzSq);
+			if (NxSq + NySq + NzSq > BoundSq()) return;
+
+			const int32 Slot = Cells.FindSlot(Cell);
+			SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+			if (Slot == INDEX_NONE) return;
+
+			const FVector3f C(Local - SRG_CellCorner(Cell, CellUU));
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				const float Rsq = RadiusSqByCat[PC[Idx]];
+				if (Rsq < 0.f) continue;  // категория вне маски
+
+				const float dx = PX[Idx] - C.X;
+				const float dy = PY[Idx] - C.Y;
+				const float dz = PZ[Idx] - C.Z;
+				const float DistSqF = dx*dx + dy*dy + dz*dz;
+				if (DistSqF > Rsq) continue;
+				const double DistSq = double(DistSqF);
+
+				if (Heap.Num() < K)
+				{
+					Heap.HeapPush(FHeapItem{ DistSq, Idx }, HeapPred);
+				}
+				else if (DistSq < Heap.HeapTop().DistSq)
+				{
+					Heap.HeapPopDiscard(HeapPred, EAllowShrinking::No);
+					Heap.HeapPush(FHeapItem{ DistSq, Idx }, HeapPred);
+				}
+			}
+		};
+
+		const int32 MaxShell = FMath::CeilToInt32((MaxRadiusUU + LooseUU) * InvCellUU) + 1;
+		for (int32 sh = 0; sh <= MaxShell; ++sh)
+		{
+			// Минимальная дистанция до любого актёра оболочки sh (рыхлые ячейки — ближе на LooseUU)
+			if (sh > 0)
+			{
+				const double ShellMin = FaceGap + double(sh - 1) * CellUU - LooseUU;
+				if (ShellMin > 0.0 && ShellMin * ShellMin > BoundSq()) break;
+			}
+
+			for (int32 dz = -sh; dz <= sh; ++dz)
+			for (int32 dy = -sh; dy <= sh; ++dy)
+			{
+				const bool bFace = (FMath::Abs(dz) == sh) || (FMath::Abs(dy) == sh);
+				const int32 Step = bFace ? 1 : FMath::Max(1, 2 * sh); // внутри куба — только грани по X
+				for (int32 dx = -sh; dx <= sh; dx += Step)
+				{
+					VisitCell(Home + FInt64Vector(dx, dy, dz));
+				}
+			}
+		}
+
+		Heap.Sort([](const FHeapItem& L, const FHeapItem& R){ return L.DistSq < R.DistSq; });
+		for (const FHeapItem& It : Heap)
+		{
+			if (const FResolved R = Policy.Resolve(Cells.GetItem(It.SlabIndex).Handle))
+			{
+				Out.Add(R);
+			}
+		}
+		SRG_TALLY(Tally.V.Accepted = Out.Num());
+	}
+
+	/** Попадание упреждающего запроса: объект и оценка времени входа в сферу, с */
+	struct FApproachHit
+	{
+		FResolved Object       = FResolved();
+		float     EntryTimeSec = 0.f;
+	};
+
+	void QueryApproaching(const FVector& Center, const FVector& ViewerVel, double RadiusUU, float HorizonSec,
+	                      TArray<FApproachHit>& Out) const
+	{
+		QueryApproaching(Center, ViewerVel, FSRGCategoryRadii::All(RadiusUU), HorizonSec, Out);
+	}
+
+	/**
+	 * Упреждающий запрос (swept sphere): объекты, которые сейчас вне радиуса своей
+	 * категории, но при текущей относительной скорости войдут в сферу вокруг
+	 * Center за HorizonSec. Скорости — из записей (читаются в Refresh), позиции —
+	 * SoA-кэш. Диапазон ячеек — радиус + (MaxSpeed + |ViewerVel|) * Horizon;
+	 * ячейки целиком внутри наименьшего радиуса пропускаются — там все уже внутри.
+	 * Out — по возрастанию времени входа.
+	 */
+	void QueryApproaching(const FVector& Center, const FVector& ViewerVel, const FSRGCategoryRadii& Radii, float HorizonSec,
+	                      TArray<FApproachHit>& Out) const
+	{
+		Out.Reset();
+		const double MaxRadiusUU = Radii.GetMaxRadius();
+		if (MaxRadiusUU <= 0.0 || HorizonSec <= 0.f) return;
+
+		const double MinRadiusSq = FMath::Square(Radii.GetMinRadius());
+		const double ReachUU     = MaxRadiusUU + (double(MaxSpeedUU) + ViewerVel.Size()) * HorizonSec;
+
+		float RadiusSq[SRG_MaxCategories];
+		Radii.MakeRadiusSqTable(RadiusSq);
+		const FVector   Local = Center - GridOrigin;
+		const FVector3f VV(ViewerVel);
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters));
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		SRG_ForEachSphereCell(Local, ReachUU, CellUU, LooseUU, [&](const FInt64Vector& Cell, bool /*bInsideReach*/)
+		{
+			if (SRG_ClassifyCell(Local, Cell, CellUU, LooseUU, MinRadiusSq) == ESRGCellOverlap::Inside) return;
+
+			const int32 Slot = Cells.FindSlot(Cell);
+			SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+			if (Slot == INDEX_NONE) return;
+
+			const FVector3f C(Local - SRG_CellCorner(Cell, CellUU));
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				const float Rsq = RadiusSq[PC[Idx]];
+				if (Rsq < 0.f) continue;  // категория вне маски
+
+				const float dx = PX[Idx] - C.X;
+				const float dy = PY[Idx] - C.Y;
+				const float dz = PZ[Idx] - C.Z;
+				const float Cq = dx*dx + dy*dy + dz*dz - Rsq;
+				if (Cq <= 0.f) continue;  // уже внутри
+
+				// |d + v t|^2 = R^2: t = (-b - sqrt(b^2 - a c)) / a, b = d·v (половинный)
+				const FVector3f V = Cells.GetItem(Idx).Vel - VV;
+				const float B = dx*V.X + dy*V.Y + dz*V.Z;
+				if (B >= 0.f) continue;   // удаляется или идёт по касательной
+
+				const float A    = V.SizeSquared();
+				const float Disc = B*B - A*Cq;
+				if (Disc < 0.f) continue; // пролетает мимо сферы
+
+				const float T = (-B - FMath::Sqrt(Disc)) / A;
+				if (T > HorizonSec) continue;
+
+				if (const FResolved R = Policy.Resolve(Cells.GetItem(Idx).Handle))
+				{
+					Out.Add(FApproachHit{ R, T });
+				}
+			}
+		});
+
+		Out.Sort([](const FApproachHit& L, const FApproachHit& R){ return L.EntryTimeSec < R.EntryTimeSec; });
+		SRG_TALLY(Tally.V.Accepted = Out.Num());
+	}
+
+	/** Попадание запроса по обзору: объект, угол от оси взгляда и дистанция (по кэшу позиций) */
+	struct FViewHit
+	{
+		FResolved Object   = FResolved();
+		float     AngleRad = 0.f;
+		float     DistUU   = 0.f;
+	};
+
+	void QueryCone(const FVector& Origin, const FVector& Forward, float HalfAngleRad, double RangeUU,
+	               TArray<FViewHit>& Out, double AllAroundUU = 0.0) const
+	{
+		QueryCone(Origin, Forward, HalfAngleRad, FSRGCategoryRadii::All(RangeUU), Out, AllAroundUU);
+	}
+
+	/**
+	 * Отбор по конусу обзора: апекс Origin, ось Forward, полуугол HalfAngleRad,
+	 * дальность — по категориям (Radii). Ближе AllAroundUU объекты берутся при
+	 * любом угле — «страховка» за спиной. Ячейки вне конуса и вне этой сферы
+	 * отсекаются целиком (по описанной сфере куба), в хэше не ищутся.
+	 */
+	void QueryCone(const FVector& Origin, const FVector& Forward, float HalfAngleRad, const FSRGCategoryRadii& Radii,
+	               TArray<FViewHit>& Out, double AllAroundUU = 0.0) const
+	{
+		Out.Reset();
+		const double  MaxRangeUU = Radii.GetMaxRadius();
+		const FVector Axis       = Forward.GetSafeNormal();
+		if (MaxRangeUU <= 0.0 || Axis.IsZero()) return;
+
+		const double    HalfAngle = FMath::Clamp(double(HalfAngleRad), 0.0, UE_DOUBLE_PI);
+		const float     CosHalf   = float(FMath::Cos(HalfAngle));
+		const double    NearUU    = FMath::Clamp(AllAroundUU, 0.0, MaxRangeUU);
+		const float     NearSq    = float(NearUU * NearUU);
+		const FVector3f AxisF(Axis);
+
+		float RadiusSq[SRG_MaxCategories];
+		Radii.MakeRadiusSqTable(RadiusSq);
+		const FVector Local = Origin - GridOrigin;
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters));
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		SRG_ForEachSphereCell(Local, MaxRangeUU, CellUU, LooseUU, [&](const FInt64Vector& Cell, bool /*bInsideRange*/)
+		{
+			const ESRGCellOverlap Cone = SRG_ClassifyCellCone(Local, Axis, HalfAngle, Cell, CellUU, LooseUU);
+			if (Cone == ESRGCellOverlap::Outside
+				&& (NearUU <= 0.0 || SRG_ClassifyCell(Local, Cell, CellUU, LooseUU, NearUU * NearUU) == ESRGCellOverlap::Outside))
+			{
+				return;
+			}
+
+			const int32 Slot = Cells.FindSlot(Cell);
+			SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+			if (Slot == INDEX_NONE) return;
+
+			const bool bConeInside = (Cone == ESRGCellOverlap::Inside);
+			const FVector3f C(Local - SRG_CellCorner(Cell, CellUU));
+			const int32 Start = Cells.GetSlot(Slot).Start;
+			const int32 End   = Start + Cells.GetSlot(Slot).Num;
+			for (int32 Idx = Start; Idx < End; ++Idx)
+			{
+				const float Rsq = RadiusSq[PC[Idx]];
+				if (Rsq < 0.f) continue;  // категория вне маски
+
+				const float dx = PX[Idx] - C.X;
+				const float dy = PY[Idx] - C.Y;
+				const float dz = PZ[Idx] - C.Z;
+				const float DistSq = dx*dx + dy*dy + dz*dz;
+				if (DistSq > Rsq) continue;
+
+				const float Dist  = FMath::Sqrt(DistSq);
+				const float Along = dx*AxisF.X + dy*AxisF.Y + dz*AxisF.Z;
+				if (!bConeInside && DistSq > NearSq && Along < CosHalf * Dist) continue;
+
+				if (const FResolved R = Policy.Resolve(Cells.GetItem(Idx).Handle))
+				{
+					const float Angle = (Dist > UE_KINDA_SMALL_NUMBER) ? FMath::Acos(FMath::Clamp(Along / Dist, -1.f, 1.f)) : 0.f;
+					Out.Add(FViewHit{ R, Angle, Dist });
+				}
+			}
+		});
+		SRG_TALLY(Tally.V.Accepted = Out.Num());
+	}
+
+	/**
+	 * Отбор по пирамиде обзора (FSRGViewFrustum::Make). Диапазон ячеек — AABB
+	 * пирамиды; слои и ряды ячеек вне неё отсекаются целиком, ячейки «целиком
+	 * внутри» берутся без теста плоскостей. Угол в FViewHit — от Frustum.Forward.
+	 */
+	void QueryFrustum(const FSRGViewFrustum& Frustum, TArray<FViewHit>& Out, uint8 CategoryMask = 0xFF) const
+	{
+		Out.Reset();
+		if (Frustum.NumPlanes == 0 || Frustum.RangeUU <= 0.0 || CategoryMask == 0) return;
+
+		const FVector   Local = Frustum.Origin - GridOrigin;
+		const FVector3f AxisF(Frustum.Forward);
+		const FVector   Loose(LooseUU);
+
+		const FInt64Vector MinC(
+			int64(FMath::FloorToDouble((Local.X + Frustum.BoundsMin.X - LooseUU) * InvCellUU)),
+			int64(FMath::FloorToDouble((Local.Y + Frustum.BoundsMin.Y - LooseUU) * InvCellUU)),
+			int64(FMath::FloorToDouble((Local.Z + Frustum.BoundsMin.Z - LooseUU) * InvCellUU)));
+		const FInt64Vector MaxC(
+			int64(FMath::FloorToDouble((Local.X + Frustum.BoundsMax.X + LooseUU) * InvCellUU)),
+			int64(FMath::FloorToDouble((Local.Y + Frustum.BoundsMax.Y + LooseUU) * InvCellUU)),
+			int64(FMath::FloorToDouble((Local.Z + Frustum.BoundsMax.Z + LooseUU) * InvCellUU)));
+
+		SRG_TALLY(FSRGQueryTally Tally(QueryCounters));
+
+		// Коробка диапазона ячеек (с рыхлым запасом) относительно Origin
+		auto CellBox = [&](const FInt64Vector& Lo, const FInt64Vector& Hi)
+		{
+			return Frustum.ClassifyBox(
+				SRG_CellCorner(Lo, CellUU) - Local - Loose,
+				SRG_CellCorner(Hi + FInt64Vector(1, 1, 1), CellUU) - Local + Loose);
+		};
+
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		for (int64 cz = MinC.Z; cz <= MaxC.Z; ++cz)
+		{
+			if (CellBox(FInt64Vector(MinC.X, MinC.Y, cz), FInt64Vector(MaxC.X, MaxC.Y, cz)) == ESRGCellOverlap::Outside) continue;
+
+			for (int64 cy = MinC.Y; cy <= MaxC.Y; ++cy)
+			{
+				if (CellBox(FInt64Vector(MinC.X, cy, cz), FInt64Vector(MaxC.X, cy, cz)) == ESRGCellOverlap::Outside) continue;
+
+				for (int64 cx = MinC.X; cx <= MaxC.X; ++cx)
+				{
+					const FInt64Vector Cell(cx, cy, cz);
+					const ESRGCellOverlap Overlap = CellBox(Cell, Cell);
+					if (Overlap == ESRGCellOverlap::Outside) continue;
+
+					const int32 Slot = Cells.FindSlot(Cell);
+					SRG_TALLY(Tally.Visit(Slot == INDEX_NONE ? INDEX_NONE : Cells.GetSlot(Slot).Num));
+					if (Slot == INDEX_NONE) continue;
+
+					// Плоскости в координатах ячейки: N·p <= Dist + N·C
+					const FVector C = Local - SRG_CellCorner(Cell, CellUU);
+					FVector3f N[FSRGViewFrustum::MaxPlanes];
+					float     Lim[FSRGViewFrustum::MaxPlanes];
+					for (int32 p = 0; p < Frustum.NumPlanes; ++p)
+					{
+						N[p]   = FVector3f(Frustum.Normal[p]);
+						Lim[p] = float(Frustum.Dist[p] + FVector::DotProduct(Frustum.Normal[p], C));
+					}
+					const FVector3f CF(C);
+					const bool bInside = (Overlap == ESRGCellOverlap::Inside);
+
+					const int32 Start = Cells.GetSlot(Slot).Start;
+					const int32 End   = Start + Cells.GetSlot(Slot).Num;
+					for (int32 Idx = Start; Idx < End; ++Idx)
+					{
+						if (!(CategoryMask & (1u << PC[Idx]))) continue;
+
+						if (!bInside)
+						{
+							bool bOut = false;
+							for (int32 p = 0; p < Frustum.NumPlanes && !bOut; ++p)
+							{
+								bOut = N[p].X * PX[Idx] + N[p].Y * PY[Idx] + N[p].Z * PZ[Idx] > Lim[p];
+							}
+							if (bOut) continue;
+						}
+
+						if (const FResolved R = Policy.Resolve(Cells.GetItem(Idx).Handle))
+						{
+							const float dx = PX[Idx] - CF.X;
+							const float dy = PY[Idx] - CF.Y;
+							const float dz = PZ[Idx] - CF.Z;
+							const float Dist  = FMath::Sqrt(dx*dx + dy*dy + dz*dz);
+							const float Along = dx*AxisF.X + dy*AxisF.Y + dz*AxisF.Z;
+							const float Angle = (Dist > UE_KINDA_SMALL_NUMBER) ? FMath::Acos(FMath::Clamp(Along / Dist, -1.f, 1.f)) : 0.f;
+							Out.Add(FViewHit{ R, Angle, Dist });
+						}
+					}
+				}
+			}
+		}
+		SRG_TALLY(Tally.V.Accepted = Out.Num());
+	}
+
+	/**
+	 * Все пары записей ближе RadiusUU за один проход: каждая ячейка сверяется с
+	 * собой и с «передней» половиной соседей (при RadiusUU <= CellUU — 13 ячеек),
+	 * так что каждая пара встречается ровно один раз — O(N * плотность) вместо O(N^2).
+	 * Пара отдаётся, если одна запись из MaskA, а другая из MaskB:
+	 * Fn(HandleType A, HandleType B, float DistSq), где A — из MaskA.
+	 * Хэндлы не резолвятся; дистанция — по SoA-кэшу (точность RefreshToleranceUU).
+	 * Scratch — свой на вызывающего; после прогрева без аллокаций.
+	 */
+	template<typename FuncType>
+	void ForEachPairWithin(double RadiusUU, FuncType&& Fn, FSRGPairScratch& Scratch, uint8 MaskA = 0xFF, uint8 MaskB = 0xFF) const
+	{
+		if (!MakePairStencil(RadiusUU, Scratch.Stencil) || MaskA == 0 || MaskB == 0) return;
+
+		const float RadiusSq = float(RadiusUU * RadiusUU);
+		Cells.ForEachCell([&](const FInt64Vector& Cell, int32 Slot)
+		{
+			SweepCellPairs(Slot, Scratch.Stencil, RadiusSq, MaskA, MaskB, Fn);
+		});
+	}
+
+	/**
+	 * Параллельный ForEachPairWithin: непустые ячейки делятся на NumTasks кусков
+	 * (ParallelFor). Fn(int32 TaskIndex, HandleType A, HandleType B, float DistSq)
+	 * зовётся с воркеров — накопление per-task или атомарное. Только между двумя
+	 * Refresh(), как и остальные запросы. Scratch читают все задачи, пишет только вызов.
+	 */
+	template<typename FuncType>
+	void ParallelForEachPairWithin(double RadiusUU, FuncType&& Fn, FSRGPairScratch& Scratch, uint8 MaskA = 0xFF, uint8 MaskB = 0xFF, int32 NumTasks = 0) const
+	{
+		if (!MakePairStencil(RadiusUU, Scratch.Stencil) || MaskA == 0 || MaskB == 0) return;
+
+		TArray<int32>& Slots = Scratch.Slots;
+		Slots.Reset();
+		Cells.ForEachCell([&Slots](const FInt64Vector&, int32 Slot){ Slots.Add(Slot); });
+		const TArray<FInt64Vector>& Stencil = Scratch.Stencil;
+		if (Slots.Num() == 0) return;
+
+		if (NumTasks <= 0) NumTasks = FMath::Max(1, FPlatformMisc::NumberOfWorkerThreadsToSpawn());
+		NumTasks = FMath::Clamp(NumTasks, 1, Slots.Num());
+
+		const float RadiusSq = float(RadiusUU * RadiusUU);
+		ParallelFor(NumTasks, [&](int32 Task)
+		{
+			const int32 First = int32(int64(Slots.Num()) * Task / NumTasks);
+			const int32 Last  = int32(int64(Slots.Num()) * (Task + 1) / NumTasks);
+			for (int32 k = First; k < Last; ++k)
+			{
+				SweepCellPairs(Slots[k], Stencil, RadiusSq, MaskA, MaskB,
+					[&Fn, Task](HandleType A, HandleType B, float DistSq){ Fn(Task, A, B, DistSq); });
+			}
+		});
+	}
+
+	/** Убрать все невалидные хэндлы (полезно после массовых удалений). Возвращает их число. */
+	int32 RemoveInvalids()
+	{
+		// Чистим ячейки
+		const int32 Removed = Cells.RemoveAll([this](const FEntry& E){ return !Policy.Resolve(E.Handle); });
+		// Чистим записи хэндлов
+		for (int32 H = 0; H < Records.Num(); ++H)
+		{
+			if (Records[H].bLinked && !Policy.Resolve(HandleType(H)))
+			{
+				Records[H].bLinked = false;
+				--NumLinked;
+			}
+		}
+		return Removed;
+	}
+
+	FORCEINLINE const PositionPolicy& GetPolicy() const { return Policy; }
+	FORCEINLINE PositionPolicy& GetPolicy() { return Policy; }
+
+private:
+	/** Запись ячейки: холодные данные; горячие позиции — в SoA таблицы */
+	struct FEntry
+	{
+		HandleType Handle = HandleType(INDEX_NONE);
+		FVector3f  Vel             = FVector3f::ZeroVector; // см/с на момент выборки
+		double     NextRefreshTime = 0.0;                   // раньше — перечитывать незачем
+	};
+
+	// Параметры (double: ячейка 1e12/CellUU должна считаться без потерь)
+	double  CellUU    = 1000.0;
+	double  InvCellUU = 1.0 / 1000.0;
+	FVector Bias      = FVector::ZeroVector;
+
+	// Ленивый ребиас: ключи хранятся в сетке с началом GridOrigin (Bias на момент
+	// последнего ре-хеша); хранимая ячейка = логическая + CellOffset,
+	// GridOrigin == Bias - CellOffset * CellUU.
+	FInt64Vector BiasCellsAtRehash = FInt64Vector::ZeroValue;
+	FInt64Vector CellOffset        = FInt64Vector::ZeroValue;
+	FVector      GridOrigin        = FVector::ZeroVector;
+
+	// Рыхлая сетка: запас за гранью ячейки, внутри которого актёр не перекладывается
+	double LooseUU = 0.0;
+
+	// Счётчик релинков (смен ячейки) и его окно
+	int32  RelinkCount       = 0;
+	double RelinkWindowStart = 0.0;
+	float  RelinksPerSec     = 0.f;
+
+	// Верхняя оценка скорости записей (см/с) — запас диапазона ячеек в QueryApproaching
+	float MaxSpeedUU = 0.f;
+
+	// Инструментирование: запросы пишут с любых потоков, Refresh — game thread
+	mutable FSRGQueryCounters QueryCounters;
+	FSRGRefreshStats          LastRefreshStats;
+
+	// Грязный трекинг Refresh()
+	float  RefreshToleranceUU = 5000.f; // 50 м
+	float  FullSweepPeriodSec = 1.f;
+	double LastFullSweepTime  = -1e30;
+	static constexpr float RefreshSpeedMargin = 1.5f;   // запас на разгон между выборками
+	static constexpr float RefreshMinSpeedUU  = 100.f;  // 1 м/с: «стоящих» тоже иногда проверяем
+
+	PositionPolicy Policy;
+
+	// Хранилище: ячейки (64-битные координаты → прогон в общем Slab)
+	TSRGCellTable<FEntry> Cells;
+
+	/** Запись хэндла: где он лежит и где был на последнем чтении */
+	struct FRecord
+	{
+		FInt64Vector Cell     = FInt64Vector::ZeroValue;
+		FVector      Location = FVector::ZeroVector;
+		uint8        Category = 0;
+		bool         bLinked  = false;
+	};
+	TArray<FRecord> Records;   // по индексу хэндла
+	int32           NumLinked = 0;
+
+	// Скретч Refresh() (переиспользуется между кадрами)
+	struct FPendingMove
+	{
+		FEntry       Entry;
+		FInt64Vector OldCell = FInt64Vector::ZeroValue;
+		FInt64Vector NewCell = FInt64Vector::ZeroValue;
+		FVector      Loc     = FVector::ZeroVector;
+	};
+	TArray<FPendingMove> PendingMoves;
+
+	// Вспомогательные
+	/** Хранимая ячейка точки: логическая (от текущего Bias) + CellOffset; всё в double/int64 */
+	FORCEINLINE FInt64Vector WorldToCell(const FVector& P) const
+	{
+		const FVector Q = (P - Bias) * InvCellUU;
+		return FInt64Vector(
+			int64(FMath::FloorToDouble(Q.X)),
+			int64(FMath::FloorToDouble(Q.Y)),
+			int64(FMath::FloorToDouble(Q.Z))
+		) + CellOffset;
+	}
+
+	/** Актёр в Loc остаётся в ячейке Cell: строго внутри или в пределах запаса рыхлой сетки */
+	FORCEINLINE bool StaysInCell(const FVector& Loc, const FInt64Vector& Cell) const
+	{
+		if (WorldToCell(Loc) == Cell) return true;
+		if (LooseUU <= 0.0) return false;
+
+		const FVector3f L  = ToCellLocal(Loc, Cell);
+		const float     Lo = -float(LooseUU);
+		const float     Hi = float(CellUU + LooseUU);
+		return L.X >= Lo && L.X < Hi
+			&& L.Y >= Lo && L.Y < Hi
+			&& L.Z >= Lo && L.Z < Hi;
+	}
+
+	/** Позиция относительно угла хранимой ячейки — то, что лежит в SoA */
+	FORCEINLINE FVector3f ToCellLocal(const FVector& P, const FInt64Vector& Cell) const
+	{
+		return FVector3f((P - GridOrigin) - SRG_CellCorner(Cell, CellUU));
+	}
+
+	static FEntry MakeEntry(HandleType H)
+	{
+		FEntry E;
+		E.Handle = H;
+		return E; // NextRefreshTime = 0 → ближайший Refresh перечитает
+	}
+
+	/** Через сколько секунд запись может стать «грязной» */
+	float ComputeRefreshDelay(const FVector& Loc, const FInt64Vector& Cell, const FVector& Vel) const
+	{
+		// Расстояние до ближайшей (рыхлой) грани своей ячейки
+		const FVector Local = FVector(ToCellLocal(Loc, Cell)) * InvCellUU;
+		const double  M     = LooseUU * InvCellUU;
+		const double  FaceT = FMath::Min3(
+			FMath::Min(Local.X + M, 1.0 + M - Local.X),
+			FMath::Min(Local.Y + M, 1.0 + M - Local.Y),
+			FMath::Min(Local.Z + M, 1.0 + M - Local.Z));
+		const float Slack = FMath::Min(float(FaceT * CellUU), RefreshToleranceUU);
+
+		const float Speed = FMath::Max(float(Vel.Size()) * RefreshSpeedMargin, RefreshMinSpeedUU);
+		return FMath::Max(0.f, Slack) / Speed;
+	}
+
+	void RemoveEntry(const FInt64Vector& Cell, HandleType H)
+	{
+		Cells.RemoveFirstIf(Cell, [&H](const FEntry& E){ return E.Handle == H; });
+	}
+
+	void RehashAll()
+	{
+		// Полный ре-хеш сбрасывает накопленный сдвиг: сетка снова начинается в Bias
+		BiasCellsAtRehash = FInt64Vector(
+			int64(FMath::RoundToDouble(Bias.X * InvCellUU)),
+			int64(FMath::RoundToDouble(Bias.Y * InvCellUU)),
+			int64(FMath::RoundToDouble(Bias.Z * InvCellUU)));
+		Bias       = SRG_CellCorner(BiasCellsAtRehash, CellUU);
+		CellOffset = FInt64Vector::ZeroValue;
+		GridOrigin = Bias;
+
+		Cells.Reset();
+		for (int32 H = 0; H < Records.Num(); ++H)
+		{
+			FRecord& Rec = Records[H];
+			if (!Rec.bLinked) continue;
+
+			const FResolved R = Policy.Resolve(HandleType(H));
+			if (!R)
+			{
+				Rec.bLinked = false;
+				--NumLinked;
+				continue;
+			}
+			Rec.Location = Policy.GetLocation(R);
+			Rec.Cell     = WorldToCell(Rec.Location);
+			Cells.Add(Rec.Cell, MakeEntry(HandleType(H)), ToCellLocal(Rec.Location, Rec.Cell), Rec.Category);
+		}
+		Cells.Compact();
+	}
+
+	/**
+	 * Смещения соседей для перебора пар: «передняя» половина куба [-r, r]^3
+	 * (лексикографически после (0,0,0)), r — сколько ячеек может разделять пару
+	 * с учётом рыхлого запаса. Соседи, ближний зазор до которых больше радиуса, — прочь.
+	 */
+	bool MakePairStencil(double RadiusUU, TArray<FInt64Vector>& Out) const
+	{
+		Out.Reset();
+		if (RadiusUU <= 0.0) return false;
+
+		const double Reach = RadiusUU + 2.0 * LooseUU;
+		const int32  R     = FMath::Max(1, FMath::CeilToInt32(Reach * InvCellUU));
+		for (int32 dz = 0; dz <= R; ++dz)
+		for (int32 dy = (dz > 0 ? -R : 0); dy <= R; ++dy)
+		for (int32 dx = ((dz > 0 || dy > 0) ? -R : 1); dx <= R; ++dx)
+		{
+			auto Gap = [this](int32 d){ return FMath::Max(0.0, double(FMath::Abs(d) - 1) * CellUU - 2.0 * LooseUU); };
+			if (FMath::Square(Gap(dx)) + FMath::Square(Gap(dy)) + FMath::Square(Gap(dz)) > RadiusUU * RadiusUU) continue;
+			Out.Add(FInt64Vector(dx, dy, dz));
+		}
+		return true;
+	}
+
+	/** Пары ячейки Slot: внутри неё и с соседями по Stencil. Fn(A, B, DistSq), A — из MaskA. */
+	template<typename FuncType>
+	void SweepCellPairs(int32 Slot, TConstArrayView<FInt64Vector> Stencil, float RadiusSq, uint8 MaskA, uint8 MaskB, FuncType&& Fn) const
+	{
+		const float* PX = Cells.GetSlabX();
+		const float* PY = Cells.GetSlabY();
+		const float* PZ = Cells.GetSlabZ();
+		const uint8* PC = Cells.GetSlabCategory();
+
+		auto Emit = [&](int32 I, int32 J, float DistSq)
+		{
+			const uint32 BitI = 1u << PC[I];
+			const uint32 BitJ = 1u << PC[J];
+			if      ((BitI & MaskA) && (BitJ & MaskB)) Fn(Cells.GetItem(I).Handle, Cells.GetItem(J).Handle, DistSq);
+			else if ((BitJ & MaskA) && (BitI & MaskB)) Fn(Cells.GetItem(J).Handle, Cells.GetItem(I).Handle, DistSq);
+		};
+
+		const FCellSlotView Home = ViewOf(Slot);
+		for (int32 I = Home.Start; I < Home.End; ++I)
+		{
+			for (int32 J = I + 1; J < Home.End; ++J)
+			{
+				const float dx = PX[J] - PX[I];
+				const float dy = PY[J] - PY[I];
+				const float dz = PZ[J] - PZ[I];
+				const float DistSq = dx*dx + dy*dy + dz*dz;
+				if (DistSq <= RadiusSq) Emit(I, J, DistSq);
+			}
+		}
+
+		const FInt64Vector& Cell = Cells.GetSlot(Slot).Cell;
+		const float CellF = float(CellUU);
+		for (const FInt64Vector& D : Stencil)
+		{
+			const int32 Other = Cells.FindSlot(Cell + D);
+			if (Other == INDEX_NONE) continue;
+
+			// Позиции соседа — в координатах нашей ячейки
+			const FVector3f Off(float(D.X) * CellF, float(D.Y) * CellF, float(D.Z) * CellF);
+			const FCellSlotView Nb = ViewOf(Other);
+			for (int32 I = Home.Start; I < Home.End; ++I)
+			{
+				const float ix = PX[I] - Off.X;
+				const float iy = PY[I] - Off.Y;
+				const float iz = PZ[I] - Off.Z;
+				for (int32 J = Nb.Start; J < Nb.End; ++J)
+				{
+					const float dx = PX[J] - ix;
+					const float dy = PY[J] - iy;
+					const float dz = PZ[J] - iz;
+					const float DistSq = dx*dx + dy*dy + dz*dz;
+					if (DistSq <= RadiusSq) Emit(I, J, DistSq);
+				}
+			}
+		}
+	}
+
+	struct FCellSlotView { int32 Start; int32 End; };
+	FORCEINLINE FCellSlotView ViewOf(int32 Slot) const
+	{
+		const int32 Start = Cells.GetSlot(Slot).Start;
+		return { Start, Start + Cells.GetSlot(Slot).Num };
+	}
+
+	/** Абсолютный индекс записи объекта в Slab (поиск по прогону его ячейки) или INDEX_NONE */
+	int32 FindEntryIndex(const FInt64Vector& Cell, HandleType H) const
+	{
+		const int32 Slot = Cells.FindSlot(Cell);
+		if (Slot == INDEX_NONE) return INDEX_NONE;
+
+		const int32 Start = Cells.GetSlot(Slot).Start;
+		const int32 End   = Start + Cells.GetSlot(Slot).Num;
+		for (int32 Idx = Start; Idx < End; ++Idx)
+		{
+			if (Cells.GetItem(Idx).Handle == H) return Idx;
+		}
+		return INDEX_NONE;
+	}
+
+	/** Обновить кэш позиции объекта в его текущей ячейке */
+	void SetCachedLocation(const FInt64Vector& Cell, HandleType H, const FVector& Loc)
+	{
+		const int32 Idx = FindEntryIndex(Cell, H);
+		if (Idx == INDEX_NONE) return;
+
+		Cells.SetLocalPosition(Idx, ToCellLocal(Loc, Cell));
+		Cells.GetItemMutable(Idx).NextRefreshTime = 0.0;
+	}
+};
+
+/* ===================== Многоуровневый индекс ===================== */
+
+/** Наибольшее число уровней TSRGSpatialLevels */
+static constexpr int32 SRG_MaxLevels = 4;
+
+/**
+ * TSRGSpatialLevels — иерархия хэшей с размерами ячеек Base, Base/F, Base/F^2...
+ * Каждый уровень — полноценный TSpatialHash3D с теми же хэндлами: мутации
+ * уходят во все уровни, запрос — в один, чья ячейка ближе всего к
+ * CellPerRadius * радиус запроса (в логарифмической шкале). Малые запросы
+ * (AlwaysInclude, пары ближнего боя) не сканируют огромные ячейки, большие
+ * (дальняя отсечка) — не перебирают тысячи мелких.
+ * Разреженность — из самих хэшей: пустые ячейки не хранятся ни на одном уровне,
+ * у занятых Num — счётчик узла. Один уровень — ровно прежний TSpatialHash3D.
+ * Цена — Refresh/релинк на каждом уровне (мелкие уровни перечитываются чаще).
+ */
+template<typename HandleType, typename PositionPolicy>
+class TSRGSpatialLevels
+{
+public:
+	using FLevel    = TSpatialHash3D<HandleType, PositionPolicy>;
+	using FResolved = typename FLevel::FResolved;
+
+	TSRGSpatialLevels() { Levels.SetNum(1); }
+	explicit TSRGSpatialLevels(const PositionPolicy& InPolicy) : Policy(InPolicy) { Levels.Emplace(InPolicy); }
+
+	/** Стратегия для всех уровней (у обёртки — после конструирования) */
+	void SetPolicy(const PositionPolicy& InPolicy)
+	{
+		Policy = InPolicy;
+		for (FLevel& L : Levels) L.GetPolicy() = InPolicy;
+	}
+
+	/** Инициализация: ячейка базового (самого крупного) уровня; остальные уровни — с нуля */
+	void Init(float InCellUU)
+	{
+		Levels.SetNum(1);
+		Levels[0].Init(InCellUU);
+		RebuildLevels();
+	}
+
+	/** Размер базовой ячейки (полный ре-хеш всех уровней) */
+	void SetCellSize(float InCellUU)
+	{
+		Levels[0].SetCellSize(InCellUU);
+		for (int32 l = 1; l < Levels.Num(); ++l) Levels[l].SetCellSize(float(LevelCellSize(l)));
+	}
+
+	/**
+	 * Число уровней (1..SRG_MaxLevels) и шаг F между ними (2..16).
+	 * Без изменений — no-op; иначе мелкие уровни собираются заново из базового.
+	 */
+	void SetLevels(int32 InNumLevels, int32 InFactor)
+	{
+		InNumLevels = FMath::Clamp(InNumLevels, 1, SRG_MaxLevels);
+		InFactor    = FMath::Clamp(InFactor, 2, 16);
+		if (InNumLevels == NumLevelsWanted && InFactor == Factor) return;
+
+		NumLevelsWanted = InNumLevels;
+		Factor          = InFactor;
+		RebuildLevels();
+	}
+
+	/** Выбор уровня: целевая ячейка = CellPerRadius * радиус запроса */
+	void SetCellPerRadius(float InCellPerRadius) { CellPerRadius = FMath::Max(0.01f, InCellPerRadius); }
+
+	void SetBias(const FVector& NewBias)
+	{
+		for (FLevel& L : Levels) L.SetBias(NewBias);
+	}
+
+	void SetRefreshParams(float ToleranceUU, float InFullSweepSec)
+	{
+		RefreshToleranceUU = ToleranceUU;
+		FullSweepSec       = InFullSweepSec;
+		for (FLevel& L : Levels) L.SetRefreshParams(ToleranceUU, InFullSweepSec);
+	}
+
+	/** Запас рыхлой сетки задаётся для базового уровня, мелким — пропорционально ячейке */
+	void SetLooseMargin(float MarginUU)
+	{
+		LooseMarginUU = MarginUU;
+		for (int32 l = 0; l < Levels.Num(); ++l)
+		{
+			Levels[l].SetLooseMargin(float(MarginUU * LevelCellSize(l) / Levels[0].GetCellSize()));
+		}
+	}
+
+	void Add(HandleType H, uint8 Category = 0)
+	{
+		for (FLevel& L : Levels) L.Add(H, Category);
+	}
+
+	void Remove(HandleType H)
+	{
+		for (FLevel& L : Levels) L.Remove(H);
+	}
+
+	void Update(HandleType H)
+	{
+		for (FLevel& L : Levels) L.Update(H);
+	}
+
+	void SetCategory(HandleType H, uint8 Category)
+	{
+		for (FLevel& L : Levels) L.SetCategory(H, Category);
+	}
+
+	/** Refresh всех уровней; возвращает наибольшее число выброшенных на одном уровне */
+	int32 Refresh(double NowSeconds)
+	{
+		int32 Dropped = 0;
+		for (FLevel& L : Levels) Dropped = FMath::Max(Dropped, L.Refresh(NowSeconds));
+		return Dropped;
+	}
+
+	int32 RemoveInvalids()
+	{
+		int32 Dropped = 0;
+		for (FLevel& L : Levels) Dropped = FMath::Max(Dropped, L.RemoveInvalids());
+		return Dropped;
+	}
+
+	/** Уровень для запроса радиуса RadiusUU: |log(ячейка / (CellPerRadius * R))| — минимален */
+	const FLevel& ForRadius(double RadiusUU) const
+	{
+		if (Levels.Num() == 1 || RadiusUU <= 0.0) return Levels[0];
+
+		const double Target = FMath::Max(1.0, RadiusUU * CellPerRadius);
+		int32  Best     = 0;
+		double BestDist = TNumericLimits<double>::Max();
+		for (int32 l = 0; l < Levels.Num(); ++l)
+		{
+			const double Dist = FMath::Abs(FMath::Loge(Levels[l].GetCellSize() / Target));
+			if (Dist < BestDist)
+			{
+				BestDist = Dist;
+				Best     = l;
+			}
+		}
+		return Levels[Best];
+	}
+
+	/** Стоимость запросов всех уровней с прошлого вызова */
+	FSRGQueryCounters::FValues ConsumeQueryCounters() const
+	{
+		FSRGQueryCounters::FValues Sum;
+		for (const FLevel& L : Levels) Sum += L.ConsumeQueryCounters();
+		return Sum;
+	}
+
+	FORCEINLINE const FLevel& GetBase() const { return Levels[0]; }
+	FORCEINLINE const FLevel& GetLevel(int32 l) const { return Levels[l]; }
+	FORCEINLINE int32 NumLevels() const { return Levels.Num(); }
+
+private:
+	TArray<FLevel, TInlineAllocator<SRG_MaxLevels>> Levels;
+	PositionPolicy Policy;
+	int32 NumLevelsWanted    = 1;
+	int32 Factor             = 8;
+	float CellPerRadius      = 0.5f;
+	float LooseMarginUU      = 0.f;
+	float RefreshToleranceUU = 5000.f;  // как у TSpatialHash3D по умолчанию
+	float FullSweepSec       = 1.f;
+
+	FORCEINLINE double LevelCellSize(int32 l) const
+	{
+		return Levels[0].GetCellSize() / FMath::Pow(double(Factor), double(l));
+	}
+
+	/** Мелкие уровни заново: сетка от базового Bias, записи — все связанные хэндлы базового */
+	void RebuildLevels()
+	{
+		Levels.SetNum(1);
+		for (int32 l = 1; l < NumLevelsWanted; ++l)
+		{
+			const int32 Idx = Levels.Emplace(Policy);
+			Levels[Idx].Init(float(LevelCellSize(l)));
+			Levels[Idx].SetBias(Levels[0].GetBias());
+			Levels[Idx].SetRefreshParams(RefreshToleranceUU, FullSweepSec);
+			Levels[Idx].SetLooseMargin(float(LooseMarginUU * LevelCellSize(l) / Levels[0].GetCellSize()));
+		}
+
+		const FLevel& Base = Levels[0];
+		for (int32 H = 0; H < Base.GetHandleCapacity(); ++H)
+		{
+			if (!Base.Contains(HandleType(H))) continue;
+			const uint8 Category = Base.GetCategory(HandleType(H));
+			for (int32 l = 1; l < Levels.Num(); ++l) Levels[l].Add(HandleType(H), Category);
+		}
+	}
+};
@@ -12,6 +12,7 @@
 #include "Engine/Engine.h"
 #include "DrawDebugHelpers.h"
 #include "EngineUtils.h" // TActorIterator
+#include "SpaceReplicationGraph.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogShipBot, Log, All);
 
@@ -465,11 +466,22 @@ AActor* UShipAIPilotComponent::FindBestPlayerShip() const
 	AActor* Ow    = GetOwner();
 	if (!World || !Ow) return nullptr;
 
+	// Сервер: ближайший игрок уже посчитан одним проходом по парам кораблей
+	// в spatial hash репграфа — без перебора всех пешек на каждого ИИ
+	if (const USpaceReplicationGraph* Graph = USpaceReplicationGraph::Get(World))
+	{
+		AActor* Nearest = nullptr;
+		if (Graph->FindNearestPlayerShip(Ow, Nearest))
+		{
+			return Nearest;
+		}
+	}
+
 	const FVector SelfLoc = Ow->GetActorLocation();
 	AActor* Best          = nullptr;
 	float   BestDistSq    = TNumericLimits<float>::Max();
 
-	// UE5: используем TActorIterator вместо GetPawnIterator
+	// Фолбэк (клиент/standalone, корабль не в графе): TActorIterator вместо GetPawnIterator
 	for (TActorIterator<APawn> It(World); It; ++It)
 	{
 		APawn* P = *It;
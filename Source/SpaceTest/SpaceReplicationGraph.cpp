@@ -4,9 +4,15 @@
 #include "ShipPawn.h"
 #include "Engine/World.h"
 #include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
 #include "EngineUtils.h"
 #include "HAL/IConsoleManager.h"
-#include "Containers/Ticker.h"
+#include "HAL/PlatformTime.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
 #include "DrawDebugHelpers.h"
 #include "PhysicsEngine/BodyInstance.h"
 #include "Components/PrimitiveComponent.h"
@@ -19,6 +25,7 @@
 #include "SRG_SpatialHash3D.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "ReplicationGraph.h"
+#include <atomic>
 
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_AlwaysIncludeMeters(
 	TEXT("space.RepGraph.AlwaysIncludeMeters"),
@@ -42,6 +49,13 @@ static TAutoConsoleVariable<float> CVar_SpaceRepGraph_NPCCullMeters(
 
 DEFINE_LOG_CATEGORY_STATIC(LogSpaceRepGraph, Log, All);
 
+DECLARE_CYCLE_STAT(TEXT("Per-connection query"), STAT_SRG_ConnQuery, STATGROUP_SpaceSpatialHash);
+
+DECLARE_STATS_GROUP(TEXT("SpaceRepGraph"), STATGROUP_SpaceRepGraph, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ship replications"),    STAT_SRG_ShipReplications, STATGROUP_SpaceRepGraph);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ship bytes"),           STAT_SRG_ShipBytes,        STATGROUP_SpaceRepGraph);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Ship replicate ms"),    STAT_SRG_ShipReplicateMs,  STATGROUP_SpaceRepGraph);
+
 namespace
 {
 	struct FShipTypeCounts
@@ -59,6 +73,11 @@ namespace
 		const AController* Ctrl = Pawn->GetController();
 		return Ctrl && Ctrl->IsPlayerController();
 	}
+
+	static ESRGActorCategory GetShipCategory(const AShipPawn* Ship)
+	{
+		return IsPlayerControlledShip(Ship) ? ESRGActorCategory::PlayerShip : ESRGActorCategory::NPCShip;
+	}
 	
 	template<typename ContainerType>
 	static FShipTypeCounts CalcShipTypeCounts(const ContainerType& TrackedShips)
@@ -89,6 +108,54 @@ static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_UseKNearest(
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_MaxQueryRadiusMeters(
 	TEXT("space.RepGraph.MaxQueryRadiusMeters"), 0.f, TEXT("Optional hard cap on query radius"));
 
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_ViewCone(
+	TEXT("space.RepGraph.ViewCone"), 0,
+	TEXT("Gather candidates with a view-cone query instead of a full sphere (0/1)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_ViewConeFOVMul(
+	TEXT("space.RepGraph.ViewCone.FOVMul"), 1.5f,
+	TEXT("Cone half-angle as a multiple of FOVdeg (w_fov at that angle is ~1%)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_ViewConeRearMeters(
+	TEXT("space.RepGraph.ViewCone.RearMeters"), 2000.f,
+	TEXT("Safety radius (meters) gathered at any angle, incl. behind the camera"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_PrewarmHorizonSec(
+	TEXT("space.RepGraph.Prewarm.HorizonSec"), 1.f,
+	TEXT("Pre-warm channels of ships predicted to enter the cull radius within this time (0 = off)"));
+
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_PrewarmMaxPerTick(
+	TEXT("space.RepGraph.Prewarm.MaxPerTick"), 4,
+	TEXT("Max NEW pre-warmed ships per connection per live tick (spreads initial bunches)"));
+
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_PeriodMaxFrames(
+	TEXT("space.RepGraph.Period.MaxFrames"), 8,
+	TEXT("Max per-connection replication period (net frames) for low-score selected ships; also capped by Tau.Max. 1 = every frame"));
+
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_SelectWorkers(
+	TEXT("space.RepGraph.SelectWorkers"), 0,
+	TEXT("Workers for per-connection scoring/selection (0 = task graph workers + game thread, 1 = serial on game thread)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_AwarenessRadiusMeters(
+	TEXT("space.RepGraph.Awareness.RadiusMeters"), 50000.f,
+	TEXT("Ship-to-player awareness radius (meters) for AI target acquisition (0 = off)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_AwarenessPeriodSec(
+	TEXT("space.RepGraph.Awareness.PeriodSec"), 0.25f,
+	TEXT("Period (s) of the all-pairs awareness pass over Spatial3D"));
+
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_SpatialLevels(
+	TEXT("space.RepGraph.Spatial.Levels"), 1,
+	TEXT("Spatial3D hash levels (1 = single CellMeters grid, up to 4): queries pick the level matching their radius"));
+
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_SpatialLevelFactor(
+	TEXT("space.RepGraph.Spatial.LevelFactor"), 8,
+	TEXT("Cell size ratio between consecutive Spatial3D levels (CellMeters, /F, /F^2...)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_SpatialLevelCellPerRadius(
+	TEXT("space.RepGraph.Spatial.LevelCellPerRadius"), 0.5f,
+	TEXT("Target cell size as a fraction of the query radius when picking a Spatial3D level"));
+
 static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_Debug(
 	TEXT("space.RepGraph.Debug"), 1, TEXT("Verbose logging"));
 
@@ -101,6 +168,18 @@ static TAutoConsoleVariable<float> CVar_SpaceRepGraph_CellMeters(
 	50000.f,  // 50 км вместо 500 км - лучше для точности
 	TEXT("Spatial grid cell size (meters)"));
 
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_SpatialRefreshTolMeters(
+	TEXT("space.RepGraph.Spatial.RefreshToleranceMeters"), 50.f,
+	TEXT("Max drift (meters) of cached positions in Spatial3D before an actor is re-read"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_SpatialFullSweepSec(
+	TEXT("space.RepGraph.Spatial.FullSweepSec"), 1.f,
+	TEXT("Period (s) of a full Spatial3D refresh pass (catches teleports)"));
+
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_SpatialLooseMarginMeters(
+	TEXT("space.RepGraph.Spatial.LooseMarginMeters"), 0.f,
+	TEXT("Loose-grid margin (meters): an actor changes Spatial3D cell only after leaving its cell by more than this. 0 = strict grid"));
+
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_DefaultCullMeters(
 	TEXT("space.RepGraph.DefaultCullMeters"), 100000.f, TEXT("Default cull (meters)"));
 
@@ -144,15 +223,27 @@ static TAutoConsoleVariable<float> CVar_SpaceRepGraph_ScoreExit(
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_BudgetKBs(
 	TEXT("space.RepGraph.BudgetKBs"), 28.f, TEXT("Base per-connection budget (kB/s)"));
 static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_TickHz(
-	TEXT("space.RepGraph.TickHz"), 4, TEXT("Live scheduler tick frequency"));
+	TEXT("space.RepGraph.TickHz"), 4,
+	TEXT("Per-connection perceptual selection rate (Hz). Runs inside ServerReplicateActors: connections are rescored round-robin, ~TickHz/NetHz of them per net frame"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_Safety(
 	TEXT("space.RepGraph.Safety"), 0.8f, TEXT("Safety factor for bandwidth"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_AIMD_Alpha(
-	TEXT("space.RepGraph.AIMD.Alpha"), 400.f, TEXT("AIMD additive increase"));
+	TEXT("space.RepGraph.AIMD.Alpha"), 1600.f, TEXT("AIMD additive increase (bytes/s per second of uncongested, non-app-limited link)"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_AIMD_Beta(
 	TEXT("space.RepGraph.AIMD.Beta"), 0.85f, TEXT("AIMD multiplicative decrease"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_RTTmsStart(
-	TEXT("space.RepGraph.RTTms.Start"), 80.f, TEXT("Initial RTT estimate"));
+	TEXT("space.RepGraph.RTTms.Start"), 80.f, TEXT("Initial RTT estimate until the connection reports AvgLag"));
+static TAutoConsoleVariable<int32> CVar_SpaceRepGraph_BudgetController(
+	TEXT("space.RepGraph.Budget.Controller"), 0,
+	TEXT("Per-connection budget controller: 0=AIMD (loss/queue), 1=BBR-style (delivery rate + minRTT), 2=Delay (queueing delay target). Switching recreates controllers"));
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_BudgetMinKBs(
+	TEXT("space.RepGraph.Budget.MinKBs"), 8.f, TEXT("Controller lower bound (kB/s)"));
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_BudgetMaxKBs(
+	TEXT("space.RepGraph.Budget.MaxKBs"), 80.f, TEXT("Controller upper bound (kB/s); also capped by the connection's CurrentNetSpeed"));
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_BudgetLossThreshold(
+	TEXT("space.RepGraph.Budget.LossThreshold"), 0.02f, TEXT("Outgoing packet loss fraction treated as congestion"));
+static TAutoConsoleVariable<float> CVar_SpaceRepGraph_BudgetDelayTargetMs(
+	TEXT("space.RepGraph.Budget.DelayTargetMs"), 25.f, TEXT("Delay controller: target queueing delay above min RTT (ms)"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_TauMin(
 	TEXT("space.RepGraph.Tau.Min"), 1.f/30.f, TEXT("Min staleness seconds"));
 static TAutoConsoleVariable<float> CVar_SpaceRepGraph_TauMax(
@@ -244,15 +335,9 @@ void USpaceReplicationGraph::InitGlobalGraphNodes()
 	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
 	AddGlobalGraphNode(AlwaysRelevantNode);
 
-	// LiveLog ticker
-	const int32 TickHz = FMath::Max(1, CVar_SpaceRepGraph_TickHz.GetValueOnAnyThread());
-	const float TickInterval = 1.f / TickHz;
-	if (!LiveLogTickerHandle.IsValid())
-	{
-		LiveLogTickerHandle = FTSTicker::GetCoreTicker().AddTicker(
-			FTickerDelegate::CreateUObject(this, &USpaceReplicationGraph::LiveLog_Tick),
-			TickInterval);
-	}
+	// Перцептуальный отбор кораблей (списки по соединениям)
+	PerceptualNode = CreateNewNode<UReplicationGraphNode_PerceptualShips>();
+	AddGlobalGraphNode(PerceptualNode);
 
 	// ИСПРАВЛЕНО: Инициализация для 3D rebias
 	LastAppliedCellX = INT64_MIN;
@@ -332,6 +417,8 @@ void USpaceReplicationGraph::RemoveClientConnection(UNetConnection* NetConnectio
 			PerConnAlwaysMap.Remove(ConnMgr);
 		}
 
+		if (PerceptualNode) PerceptualNode->RemoveConnection(ConnMgr);
+
 		LiveLog_OnConnRemoved(ConnMgr);
 		ConnStates.Remove(ConnMgr);
 	}
@@ -345,6 +432,64 @@ void USpaceReplicationGraph::RemoveClientConnection(UNetConnection* NetConnectio
 	}
 }
 
+// ============= UReplicationGraphNode_PerceptualShips =============
+
+bool UReplicationGraphNode_PerceptualShips::NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound)
+{
+	bool bRemoved = false;
+	for (auto& KV : Selections)
+	{
+		bRemoved |= KV.Value.RemoveFast(ActorInfo.Actor);
+	}
+	return bRemoved;
+}
+
+void UReplicationGraphNode_PerceptualShips::NotifyResetAllNetworkActors()
+{
+	Selections.Reset();
+}
+
+void UReplicationGraphNode_PerceptualShips::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	const FActorRepListRefView* List = Selections.Find(&Params.ConnectionManager);
+	if (List && List->Num() > 0)
+	{
+		Params.OutGatheredReplicationLists.AddReplicationActorList(*List);
+	}
+}
+
+void UReplicationGraphNode_PerceptualShips::GetAllActorsInNode_Debugging(TArray<FActorRepListType>& OutArray) const
+{
+	for (const auto& KV : Selections)
+	{
+		KV.Value.AppendToTArray(OutArray);
+	}
+}
+
+void UReplicationGraphNode_PerceptualShips::SetSelection(const UNetReplicationGraphConnection* ConnMgr, const TSet<TWeakObjectPtr<AActor>>& Selected)
+{
+	FActorRepListRefView& List = Selections.FindOrAdd(ConnMgr);
+	List.Reset(Selected.Num());
+	for (const TWeakObjectPtr<AActor>& APtr : Selected)
+	{
+		if (AActor* A = APtr.Get())
+		{
+			List.Add(A);
+		}
+	}
+}
+
+void UReplicationGraphNode_PerceptualShips::RemoveConnection(const UNetReplicationGraphConnection* ConnMgr)
+{
+	Selections.Remove(ConnMgr);
+}
+
+int32 UReplicationGraphNode_PerceptualShips::GetNumSelected(const UNetReplicationGraphConnection* ConnMgr) const
+{
+	const FActorRepListRefView* List = Selections.Find(ConnMgr);
+	return List ? List->Num() : 0;
+}
+
 // ============= RouteAddNetworkActorToNodes - ИСПРАВЛЕНО =============
 
 void USpaceReplicationGraph::RouteAddNetworkActorToNodes(
@@ -365,7 +510,7 @@ void USpaceReplicationGraph::RouteAddNetworkActorToNodes(
 		// КРИТИЧНО: Добавляем в Spatial3D независимо от того, есть ли контроллер
 		if (Spatial3D)
 		{
-			Spatial3D->Add(Ship);
+			Spatial3D->Add(Ship, GetShipCategory(Ship));
 		}
 
 		if (SRG_ShouldLog())
@@ -422,10 +567,11 @@ void USpaceReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicated
 	{
 		TrackedShips.Remove(Ship);
 
-		// Очистка per-connection AlwaysRelevant
+		// Очистка per-connection AlwaysRelevant (пешка владельца) и списков отбора
 		for (auto& KV : PerConnAlwaysMap)
 			if (UReplicationGraphNode_AlwaysRelevant_ForConnection* Node = KV.Value.Get())
-				Node->NotifyRemoveNetworkActor(ActorInfo);
+				Node->NotifyRemoveNetworkActor(ActorInfo, false);
+		if (PerceptualNode) PerceptualNode->NotifyRemoveNetworkActor(ActorInfo, false);
 
 		// Очистка состояний
 		for (auto& CKV : ConnStates)
@@ -463,13 +609,235 @@ void USpaceReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicated
 	}
 }
 
-void USpaceReplicationGraph::BeginDestroy()
+int32 USpaceReplicationGraph::ServerReplicateActors(float DeltaSeconds)
 {
-	if (LiveLogTickerHandle.IsValid())
+	// Раз в серверный кадр: SoA-кэш позиций + релинк в Spatial3D до любых запросов.
+	// После этого запросы к хэшу const и могут идти с воркеров.
+	if (Spatial3D)
 	{
-		FTSTicker::GetCoreTicker().RemoveTicker(LiveLogTickerHandle);
-		LiveLogTickerHandle.Reset();
+		Spatial3D->SetRefreshParams(
+			FMath::Max(0.f, CVar_SpaceRepGraph_SpatialRefreshTolMeters.GetValueOnGameThread()) * 100.f,
+			CVar_SpaceRepGraph_SpatialFullSweepSec.GetValueOnGameThread());
+		Spatial3D->SetLooseMargin(
+			FMath::Max(0.f, CVar_SpaceRepGraph_SpatialLooseMarginMeters.GetValueOnGameThread()) * 100.f);
+		Spatial3D->SetLevels(
+			CVar_SpaceRepGraph_SpatialLevels.GetValueOnGameThread(),
+			CVar_SpaceRepGraph_SpatialLevelFactor.GetValueOnGameThread(),
+			CVar_SpaceRepGraph_SpatialLevelCellPerRadius.GetValueOnGameThread());
+
+		// Категории (игрок/NPC): контроллер меняется и без HandlePawnPossessed (боты,
+		// отложенный possess) — сверяем раз в кадр, а не на каждого кандидата каждого соединения
+		for (const TWeakObjectPtr<AShipPawn>& ShipPtr : TrackedShips)
+		{
+			if (AShipPawn* Ship = ShipPtr.Get())
+			{
+				Spatial3D->SetCategory(Ship, GetShipCategory(Ship));
+			}
+		}
+
+		const UWorld* W = GetWorld();
+		const double Now = W ? W->GetTimeSeconds() : FPlatformTime::Seconds();
+		Spatial3D->Refresh(Now);
+		UpdateShipKinematics(Now);
+		UpdateAwareness(Now);
 	}
+
+	// Отбор — в том же кадре, до Gather: списки PerceptualNode свежие на этот кадр
+	UpdateSelection(DeltaSeconds);
+
+	return Super::ServerReplicateActors(DeltaSeconds);
+}
+
+int64 USpaceReplicationGraph::ReplicateSingleActor(AActor* Actor, FConnectionReplicationActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalActorInfo,
+	FPerConnectionActorInfoMap& ConnectionActorInfoMap, UNetReplicationGraphConnection& ConnectionManager, const uint32 FrameNum)
+{
+	const double T0   = FPlatformTime::Seconds();
+	const int64  Bits = Super::ReplicateSingleActor(Actor, ActorInfo, GlobalActorInfo, ConnectionActorInfoMap, ConnectionManager, FrameNum);
+
+	// Реальная стоимость корабля для этого соединения: биты из канала и время
+	// сериализации+отправки; свернётся в FActorEMA при следующем отборе соединения
+	if (Bits > 0 && Actor && Actor->IsA<AShipPawn>())
+	{
+		const float Ms    = float((FPlatformTime::Seconds() - T0) * 1000.0);
+		const float Bytes = float(Bits) / 8.f;
+
+		if (FConnState* CS = ConnStates.Find(&ConnectionManager))
+		{
+			CS->ReplicatedBytes += Bytes;
+			CS->ReplicatedMs    += Ms;
+			if (FActorEMA* AStat = CS->ActorStats.Find(Actor))
+			{
+				AStat->PendingBytes += Bytes;
+				AStat->PendingMs    += Ms;
+				AStat->PendingReps++;
+			}
+		}
+
+		INC_DWORD_STAT(STAT_SRG_ShipReplications);
+		INC_DWORD_STAT_BY(STAT_SRG_ShipBytes, uint32(Bytes));
+		INC_FLOAT_STAT_BY(STAT_SRG_ShipReplicateMs, Ms);
+	}
+	return Bits;
+}
+
+// ============= Кинематика кораблей: раз в кадр, общая для всех соединений =============
+
+void USpaceReplicationGraph::UpdateShipKinematics(double NowSeconds)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(SRG_UpdateShipKinematics);
+
+	ShipKinematics.SetNum(Spatial3D->GetHandleTable().GetCapacity());
+
+	// σa/σj — разности по окну 1/TickHz (интервал отбора), как до переноса в кадр:
+	// по одному сетевому кадру шум разностей растёт как 1/dt, и Theta0 уехал бы
+	const double SampleSec = 1.0 / double(FMath::Max(1, CVar_SpaceRepGraph_TickHz.GetValueOnGameThread()));
+
+	for (const TWeakObjectPtr<AShipPawn>& ShipPtr : TrackedShips)
+	{
+		AShipPawn* Ship = ShipPtr.Get();
+		if (!Ship) continue;
+
+		const FSRGActorHandle H = Spatial3D->FindHandle(Ship);
+		if (!H.IsSet() || !ShipKinematics.IsValidIndex(H.Index)) continue;
+
+		FShipKinematics& K = ShipKinematics[H.Index];
+		if (K.Generation != H.Generation)
+		{
+			K = FShipKinematics();  // слот хэндла переиспользован — история не наша
+			K.Generation = H.Generation;
+		}
+		if (K.bInit && NowSeconds <= K.Stamp) continue;
+
+		const FVector Pos = Ship->GetActorLocation();
+		const FVector Vel = GetActorVelocity(Ship);
+
+		if (!K.bInit)
+		{
+			K.RadiusUU    = GetActorRadiusUU(Ship);
+			K.SampleVel   = Vel;
+			K.SampleStamp = NowSeconds;
+			K.bInit       = true;
+		}
+		else if (NowSeconds - K.SampleStamp >= SampleSec)
+		{
+			const float dt = float(NowSeconds - K.SampleStamp);
+			const FVector Accel = (Vel - K.SampleVel) / dt;
+
+			const FVector VDir   = Vel.GetSafeNormal();
+			const FVector APred  = FVector::DotProduct(Accel, VDir) * VDir;
+			const FVector ANoise = Accel - APred;
+
+			K.SigmaA      = EMA(K.SigmaA, float(ANoise.Size()), 0.3f);
+			K.SigmaJ      = EMA(K.SigmaJ, float(((ANoise - K.PrevAccel) / dt).Size()), 0.2f);
+			K.PrevAccel   = ANoise;
+			K.SampleVel   = Vel;
+			K.SampleStamp = NowSeconds;
+		}
+
+		K.Pos     = Pos;
+		K.Vel     = Vel;
+		K.AngVel  = GetActorAngularVel(Ship);
+		K.Stamp   = NowSeconds;
+		K.bPlayer = IsPlayerControlledShip(Ship);
+	}
+}
+
+const USpaceReplicationGraph::FShipKinematics* USpaceReplicationGraph::FindShipKinematics(const AActor* Ship) const
+{
+	const FSRGActorHandle H = Spatial3D ? Spatial3D->FindHandle(Ship) : FSRGActorHandle();
+	if (!H.IsSet() || !ShipKinematics.IsValidIndex(H.Index)) return nullptr;
+
+	const FShipKinematics& K = ShipKinematics[H.Index];
+	return (K.bInit && K.Generation == H.Generation) ? &K : nullptr;
+}
+
+// ============= Awareness: ближайший игрок для ИИ из одного прохода по парам =============
+
+void USpaceReplicationGraph::UpdateAwareness(double NowSeconds)
+{
+	const float RadiusUU = FMath::Max(0.f, CVar_SpaceRepGraph_AwarenessRadiusMeters.GetValueOnGameThread()) * 100.f;
+	if (!Spatial3D || RadiusUU <= 0.f)
+	{
+		bAwarenessValid = false;
+		return;
+	}
+	if (bAwarenessValid && NowSeconds - LastAwarenessTime < CVar_SpaceRepGraph_AwarenessPeriodSec.GetValueOnGameThread())
+	{
+		return;
+	}
+	LastAwarenessTime = NowSeconds;
+
+	// Минимум по кораблю — атомарно: DistSq >= 0, его биты как uint32 монотонны
+	const int32 Capacity = Spatial3D->GetHandleTable().GetCapacity();
+	AwarenessPacked.SetNumUninitialized(Capacity);
+	for (int64& P : AwarenessPacked) P = MAX_int64;
+
+	auto Offer = [this](int32 Self, int32 Player, float DistSq)
+	{
+		const int64 Value = (int64(FMath::AsUInt(DistSq)) << 32) | int64(uint32(Player));
+		volatile int64* Slot = &AwarenessPacked[Self];
+		int64 Cur = *Slot;
+		while (Value < Cur)
+		{
+			const int64 Prev = FPlatformAtomics::InterlockedCompareExchange(Slot, Value, Cur);
+			if (Prev == Cur) break;
+			Cur = Prev;
+		}
+	};
+
+	const uint8 PlayerBit = uint8(1u << uint8(ESRGActorCategory::PlayerShip));
+	const uint8 ShipBits  = PlayerBit | uint8(1u << uint8(ESRGActorCategory::NPCShip));
+	const USRG_SpatialHash3D::FCore& Core = Spatial3D->GetCore();
+
+	// A — любой корабль, B — игрок; пара игрок–игрок приходит один раз, отдаём обоим
+	Spatial3D->ParallelForEachPairWithin(RadiusUU, [&](int32 /*Task*/, int32 A, int32 B, float DistSq)
+	{
+		Offer(A, B, DistSq);
+		if (Core.GetCategory(A) == uint8(ESRGActorCategory::PlayerShip))
+		{
+			Offer(B, A, DistSq);
+		}
+	}, AwarenessPairScratch, ShipBits, PlayerBit);
+
+	const FSRGActorHandleTable& Handles = Spatial3D->GetHandleTable();
+	NearestPlayerByHandle.SetNum(Capacity);
+	for (int32 i = 0; i < Capacity; ++i)
+	{
+		const int64 P = AwarenessPacked[i];
+		NearestPlayerByHandle[i].Self   = Handles.GetHandle(i);
+		NearestPlayerByHandle[i].Player = (P == MAX_int64) ? FSRGActorHandle() : Handles.GetHandle(int32(uint32(P)));
+	}
+	bAwarenessValid = true;
+}
+
+bool USpaceReplicationGraph::FindNearestPlayerShip(const AActor* Ship, AActor*& OutPlayerShip) const
+{
+	OutPlayerShip = nullptr;
+	if (!bAwarenessValid || !Spatial3D) return false;
+
+	const FSRGActorHandle H = Spatial3D->FindHandle(Ship);
+	if (!H.IsSet()) return false;
+
+	// Зарегистрирован после прохода — ещё не посчитан; в том числе в слоте, освобождённом
+	// другим кораблём после прохода: его цель не наследуем
+	if (!NearestPlayerByHandle.IsValidIndex(H.Index)) return false;
+	const FNearestPlayer& N = NearestPlayerByHandle[H.Index];
+	if (N.Self != H) return false;
+
+	// В радиусе никого (или игрок уже исчез): пусть вызывающий ищет дальше радиуса
+	OutPlayerShip = N.Player.IsSet() ? Spatial3D->ResolveHandle(N.Player) : nullptr;
+	return OutPlayerShip != nullptr;
+}
+
+USpaceReplicationGraph* USpaceReplicationGraph::Get(const UWorld* World)
+{
+	const UNetDriver* Driver = World ? World->GetNetDriver() : nullptr;
+	return Driver ? Cast<USpaceReplicationGraph>(Driver->GetReplicationDriver()) : nullptr;
+}
+
+void USpaceReplicationGraph::BeginDestroy()
+{
+	ConnStates.Reset();
 	Super::BeginDestroy();
 }
 
@@ -479,6 +847,14 @@ void USpaceReplicationGraph::HandlePawnPossessed(APawn* Pawn)
 {
 	if (!Pawn) return;
 
+	if (Spatial3D)
+	{
+		if (AShipPawn* Ship = Cast<AShipPawn>(Pawn))
+		{
+			Spatial3D->SetCategory(Ship, GetShipCategory(Ship));
+		}
+	}
+
 	AController* Ctrl = Pawn->GetController();
 	if (!Ctrl || !Ctrl->IsPlayerController())
 	{
@@ -546,7 +922,8 @@ void USpaceReplicationGraph::Rebias3D(const FVector& WorldLoc)
 		bNeedsRebias = true;
 	}
 
-	// Синхронизируем 3D Spatial Hash с полным 3D bias
+	// Синхронизируем 3D Spatial Hash с полным 3D bias.
+	// SetBias — O(1) сдвиг ключей (без ре-хеша), и no-op, если ячейка bias не сменилась.
 	if (Spatial3D)
 	{
 		Spatial3D->SetBias(NewBias3D);  // ИСПРАВЛЕНО: Полный 3D bias
@@ -597,7 +974,8 @@ void USpaceReplicationGraph::RebiasToXY(const FVector& WorldLoc)
 void USpaceReplicationGraph::LiveLog_OnConnAdded(UNetReplicationGraphConnection* ConnMgr)
 {
 	if (!ConnMgr) return;
-	ConnStates.FindOrAdd(ConnMgr);
+	// Фазы по кругу: соседние соединения пересчитываются в разных кадрах
+	ConnStates.FindOrAdd(ConnMgr).SelectPhase = NextSelectPhase++;
 	if (SRG_ShouldLog())
 		UE_LOG(LogSpaceRepGraph, Log, TEXT("LiveLog: track conn %p"), ConnMgr);
 }
@@ -615,14 +993,28 @@ static FVector GetPawnForward(const APawn* P)
 	return P ? P->GetActorForwardVector() : FVector::ForwardVector;
 }
 
-// ============= LiveLog_Tick - ИСПРАВЛЕНО для больших координат =============
+void USpaceReplicationGraph::SetConnectionSelectHz(UNetReplicationGraphConnection* ConnMgr, float Hz)
+{
+	if (FConnState* CS = ConnStates.Find(ConnMgr))
+	{
+		CS->SelectHz = FMath::Max(0.f, Hz);
+		// Новая частота — со следующего кадра, а не после старого (возможно, длинного) периода
+		CS->NextSelectFrame = SelectFrame + 1;
+	}
+}
+
+// ============= UpdateSelection: перцептуальный отбор в сетевом кадре =============
 
-bool USpaceReplicationGraph::LiveLog_Tick(float DeltaTime)
+void USpaceReplicationGraph::UpdateSelection(float DeltaSeconds)
 {
 	UWorld* W = GetWorld();
-	if (!W) return true;
+	if (!W) return;
+
+	++SelectFrame;
+	NetFrameHzEMA = (NetFrameHzEMA > 0.f)
+		? EMA(NetFrameHzEMA, 1.f / FMath::Max(1e-3f, DeltaSeconds), 0.1f)
+		: 1.f / FMath::Max(1e-3f, DeltaSeconds);
 
-	const bool bDoLiveLog  = (CVar_SpaceRepGraph_LiveLog.GetValueOnAnyThread() != 0);
 	const bool bDoDebugLog = SRG_ShouldLog();
 
 	const float ShipCullM = FMath::Max(1.f, CVar_SpaceRepGraph_ShipCullMeters.GetValueOnAnyThread());
@@ -732,6 +1124,33 @@ bool USpaceReplicationGraph::LiveLog_Tick(float DeltaTime)
 	// Остальной код приоритизации (без изменений, но с улучшенной диагностикой)
 	const float Theta0 = FMath::Max(0.01f, CVar_SpaceRepGraph_Theta0Deg.GetValueOnAnyThread()) * (PI/180.f);
 	const float TickHz = float(FMath::Max(1, CVar_SpaceRepGraph_TickHz.GetValueOnAnyThread()));
+	const double SelectNow = W->GetTimeSeconds();
+
+	// Кого пересчитываем в этом кадре: соединение с частотой Hz — раз в
+	// Period = NetHz/Hz сетевых кадров от своего прошлого отбора. Срок хранится в
+	// соединении, поэтому дрожание Period на границе округления его не сдвигает
+	// дальше одного периода. Новое соединение — сразу, следующий срок сдвинут на
+	// фазу (фазы розданы по кругу), так что за кадр пересчитывается ~1/Period соединений.
+	TArray<TPair<UNetReplicationGraphConnection*, float>, TInlineAllocator<16>> DueConns;  // соединение, dt с прошлого отбора
+	for (auto& CKV : ConnStates)
+	{
+		UNetReplicationGraphConnection* ConnMgr = CKV.Key.Get();
+		if (!ConnMgr || !ConnMgr->NetConnection) continue;
+
+		FConnState& CS     = CKV.Value;
+		const float SelHz  = (CS.SelectHz > 0.f) ? CS.SelectHz : TickHz;
+		const uint32 Period = uint32(FMath::Max(1, FMath::RoundToInt(NetFrameHzEMA / SelHz)));
+		const bool bFirst  = (CS.LastSelectTime < 0.0);
+		if (!bFirst && int32(SelectFrame - CS.NextSelectFrame) < 0) continue;
+
+		CS.NextSelectFrame = SelectFrame + (bFirst ? 1u + uint32(CS.SelectPhase) % Period : Period);
+
+		const float SelDt = bFirst ? 1.f / SelHz : FMath::Max(1e-3f, float(SelectNow - CS.LastSelectTime));
+		CS.LastSelectTime = SelectNow;
+		DueConns.Emplace(ConnMgr, SelDt);
+	}
+	if (DueConns.Num() == 0) return;
+
 	const float GroupCellUU = FMath::Max(1.f, CVar_SpaceRepGraph_GroupCellMeters.GetValueOnAnyThread()) * 100.f;
 	const float HeaderCost = FMath::Max(0.f, CVar_SpaceRepGraph_HeaderCostBytes.GetValueOnAnyThread());
 	const float S_enter = CVar_SpaceRepGraph_ScoreEnter.GetValueOnAnyThread();
@@ -743,278 +1162,498 @@ bool USpaceReplicationGraph::LiveLog_Tick(float DeltaTime)
 	const int32 KNearest   = CVar_SpaceRepGraph_UseKNearest.GetValueOnAnyThread();
 	const float MaxQueryCapM = CVar_SpaceRepGraph_MaxQueryRadiusMeters.GetValueOnAnyThread();
 
-	for (auto& CKV : ConnStates)
+	// ИСПРАВЛЕНО: Увеличенный радиус запроса для надёжности
+	const float QueryRadiusUU = [ShipCullM, MaxQueryCapM]()
 	{
-		UNetReplicationGraphConnection* ConnMgr = CKV.Key.Get();
-		if (!ConnMgr || !ConnMgr->NetConnection) continue;
-
-		APlayerController* PC = ConnMgr->NetConnection->PlayerController;
+		const float Base = ShipCullM * 100.f * 1.2f;  // +20% запас
+		if (MaxQueryCapM > 0.f) return FMath::Min(Base, MaxQueryCapM * 100.f);
+		return Base;
+	}();
+
+	// Радиусы отсечения по категориям: игроки и NPC отбираются хэшем в один проход,
+	// по категории из SoA-дорожки, без Cast и поиска контроллера на кандидата.
+	// Дистанция — по кэшу позиций хэша (точность — RefreshToleranceMeters).
+	FSRGCategoryRadii CullRadii;
+	CullRadii.Set(uint8(ESRGActorCategory::PlayerShip), FMath::Min(FMath::Sqrt(CullSqUU), QueryRadiusUU));
+	CullRadii.Set(uint8(ESRGActorCategory::NPCShip),    FMath::Min(FMath::Sqrt(NPCCullSqUU), QueryRadiusUU));
+
+	FSelectParams P;
+	P.Now               = SelectNow;
+	P.ShipCullM         = ShipCullM;
+	P.CullSqUU          = CullSqUU;
+	P.NPCCullSqUU       = NPCCullSqUU;
+	P.AlwaysInclSqUU    = AlwaysInclSqUU;
+	P.QueryRadiusUU     = QueryRadiusUU;
+	P.CullRadii         = CullRadii;
+	P.GroupCellUU       = GroupCellUU;
+	P.HeaderCost        = HeaderCost;
+	P.S_enter           = S_enter;
+	P.S_exit            = CVar_SpaceRepGraph_ScoreExit.GetValueOnAnyThread();
+	P.Safety            = CVar_SpaceRepGraph_Safety.GetValueOnAnyThread();
+	P.BaseKBs           = CVar_SpaceRepGraph_BudgetKBs.GetValueOnAnyThread();
+	P.bUseSpatial       = bUseSpatial && Spatial3D;
+	P.KNearest          = KNearest;
+	P.bDoDebugLog       = bDoDebugLog;
+	P.NumTrackedShips   = NumTrackedShipsWorld;
+	// Конус обзора: ослабленные w_fov корабли за спиной не тянем и не скорим,
+	// кроме страховочной сферы RearMeters (не меньше AlwaysIncludeMeters)
+	P.bUseViewCone      = (CVar_SpaceRepGraph_ViewCone.GetValueOnAnyThread() != 0);
+	P.ViewConeHalfRad   = FMath::Clamp(
+		CVar_SpaceRepGraph_FOVdeg.GetValueOnAnyThread() * CVar_SpaceRepGraph_ViewConeFOVMul.GetValueOnAnyThread(), 1.f, 180.f) * (PI/180.f);
+	P.ViewConeRearUU    = FMath::Max(CVar_SpaceRepGraph_ViewConeRearMeters.GetValueOnAnyThread(), AlwaysInclM) * 100.f;
+	// Упреждение: корабли, которые войдут в радиус отсечения за горизонт
+	P.PrewarmHorizonSec = FMath::Max(0.f, CVar_SpaceRepGraph_PrewarmHorizonSec.GetValueOnAnyThread());
+	P.PrewarmMaxPerTick = FMath::Max(0, CVar_SpaceRepGraph_PrewarmMaxPerTick.GetValueOnAnyThread());
+	// Реже, чем раз в Tau.Max, корабль не обновляется даже при низком Score
+	P.MaxPeriodFrames   = FMath::Clamp(
+		FMath::FloorToInt(CVar_SpaceRepGraph_TauMax.GetValueOnAnyThread() * FMath::Max(1.f, NetFrameHzEMA)),
+		1, FMath::Max(1, CVar_SpaceRepGraph_PeriodMaxFrames.GetValueOnAnyThread()));
+
+	// Задания кадра: всё, что требует game thread (пешка, узел), — здесь
+	SelectJobs.SetNum(DueConns.Num(), EAllowShrinking::No);
+	int32 NumJobs = 0;
+	for (const auto& Due : DueConns)
+	{
+		APlayerController* PC = Due.Key->NetConnection->PlayerController;
 		APawn* ViewerPawn = PC ? PC->GetPawn() : nullptr;
-		if (!ViewerPawn) continue;
-
-		FConnState& CS = CKV.Value;
-		UReplicationGraphNode_AlwaysRelevant_ForConnection* ARNode = PerConnAlwaysMap.FindRef(ConnMgr).Get();
-		if (!ARNode) continue;
-
-		const FVector ViewLoc = ViewerPawn->GetActorLocation();
+		if (!ViewerPawn || !PerceptualNode) continue;
+
+		FSelectJob& Job = SelectJobs[NumJobs++];
+		Job.ConnMgr    = Due.Key;
+		Job.CS         = &ConnStates.FindChecked(Due.Key);
+		Job.ViewerPawn = ViewerPawn;
+		Job.ViewLoc    = ViewerPawn->GetActorLocation();
+		Job.SelDt      = Due.Value;  // реальный интервал отбора этого соединения
+		Job.bBatched   = false;
+		Job.BatchUs    = 0.0;
+	}
+	TArrayView<FSelectJob> Jobs(SelectJobs.GetData(), NumJobs);
 
-		// Обновление EMA зрителя
+	// Пакетный запрос по всем зрителям сразу: радиусы общие, в «собачьих свалках»
+	// соседние зрители делят ячейки, и каждая ячейка обходится один раз.
+	if (P.bUseSpatial && KNearest <= 0 && !P.bUseViewCone && Jobs.Num() > 0)
+	{
+		TArray<FVector> BatchCenters;
+		BatchCenters.Reserve(Jobs.Num());
+		for (const FSelectJob& Job : Jobs) BatchCenters.Add(Job.ViewLoc);
+
+		TArray<TArray<AActor*>> BatchResults;
+		BatchResults.SetNum(BatchCenters.Num());
+		FSRGBatchQueryScratch Scratch;
+		const double BatchT0 = FPlatformTime::Seconds();
+		Spatial3D->QuerySpheresBatch(BatchCenters, CullRadii, BatchResults, Scratch);
+		// Батч общий: соединениям — поровну
+		const double BatchQueryUsPerConn = (FPlatformTime::Seconds() - BatchT0) * 1e6 / FMath::Max(1, BatchCenters.Num());
+
+		for (int32 j = 0; j < Jobs.Num(); ++j)
 		{
-			const double Now = W->GetTimeSeconds();
-			if (!CS.Viewer.bInit)
-			{
-				CS.Viewer.PrevPos = ViewLoc;
-				CS.Viewer.PrevVel = FVector::ZeroVector;
-				CS.Viewer.PrevStamp = Now;
-				CS.Viewer.RTTmsEMA = CVar_SpaceRepGraph_RTTmsStart.GetValueOnAnyThread();
-				CS.Viewer.bInit = true;
-			}
-			else
-			{
-				const float dt = FMath::Max(1e-3f, float(Now - CS.Viewer.PrevStamp));
-				const FVector vel = (ViewLoc - CS.Viewer.PrevPos) / dt;
-				CS.Viewer.PrevVel = EMA(CS.Viewer.PrevVel, vel, 0.5f);
-				CS.Viewer.PrevPos = ViewLoc;
-				CS.Viewer.PrevStamp = Now;
-				CS.Viewer.RTTmsEMA = EMA(CS.Viewer.RTTmsEMA, CVar_SpaceRepGraph_RTTmsStart.GetValueOnAnyThread(), 0.05f);
-			}
+			Jobs[j].BatchNear = MoveTemp(BatchResults[j]);
+			Jobs[j].bBatched  = true;
+			Jobs[j].BatchUs   = BatchQueryUsPerConn;
 		}
+	}
 
-		// Сбор кандидатов
-		TArray<FCandidate> Candidates;
-		Candidates.Reserve(TrackedShips.Num());
+	// Фаза 1 (воркеры): скоринг и жадный отбор — только чтение мира, запись в своё FConnState
+	RunSelectJobs(P, Jobs, CVar_SpaceRepGraph_SelectWorkers.GetValueOnGameThread());
+
+	// Фаза 2 (game thread): каналы, списки узла, бюджет, логи
+	for (FSelectJob& Job : Jobs)
+	{
+		CommitSelection(P, Job);
+	}
+}
+
+void USpaceReplicationGraph::RunSelectJobs(const FSelectParams& P, TArrayView<FSelectJob> Jobs, int32 NumWorkers)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(SRG_RunSelectJobs);
+
+	NumWorkers = ResolveSelectWorkers(NumWorkers, Jobs.Num());
+	if (SelectScratch.Num() < NumWorkers)
+	{
+		SelectScratch.SetNum(NumWorkers);
+	}
+
+	DispatchSelectJobs(Jobs.Num(), NumWorkers, [this, &P, Jobs](int32 Worker, int32 j)
+	{
+		SelectForConnection(P, Jobs[j], SelectScratch[Worker]);
+	});
+}
+
+int32 USpaceReplicationGraph::ResolveSelectWorkers(int32 Requested, int32 NumJobs)
+{
+	if (Requested <= 0)
+	{
+		Requested = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	}
+	return FMath::Clamp(Requested, 1, FMath::Max(1, NumJobs));
+}
 
-		// ИСПРАВЛЕНО: Более надёжный запрос из Spatial3D
-		if (bUseSpatial && Spatial3D)
+void USpaceReplicationGraph::DispatchSelectJobs(int32 NumJobs, int32 NumWorkers, TFunctionRef<void(int32 Worker, int32 Job)> Fn)
+{
+	// Соединения с сотней кандидатов и с тысячей — вперемешку: задания раздаются
+	// по одному из общего счётчика, каждый воркер — со своей памятью
+	std::atomic<int32> NextJob{0};
+	ParallelFor(NumWorkers, [&](int32 Worker)
+	{
+		for (int32 j = NextJob.fetch_add(1, std::memory_order_relaxed); j < NumJobs; j = NextJob.fetch_add(1, std::memory_order_relaxed))
 		{
-			TArray<AActor*> Near;
-			
-			// ИСПРАВЛЕНО: Увеличенный радиус запроса для надёжности
-			const float QueryRadiusUU = [ShipCullM, MaxQueryCapM]()
-			{
-				const float Base = ShipCullM * 100.f * 1.2f;  // +20% запас
-				if (MaxQueryCapM > 0.f) return FMath::Min(Base, MaxQueryCapM * 100.f);
-				return Base;
-			}();
+			Fn(Worker, j);
+		}
+	}, NumWorkers == 1 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+}
 
-			if (KNearest > 0)
-				Spatial3D->QueryKNearest(ViewLoc, KNearest, QueryRadiusUU, Near);
-			else
-				Spatial3D->QuerySphere(ViewLoc, QueryRadiusUU, Near);
+bool USpaceReplicationGraph::MakeCandidate(const FSelectParams& P, const FShipKinematics& K, const FVector& ViewLoc, const FVector& ViewFwd,
+	FActorEMA& AStat, const FViewerEMA& VStat, FCandidate& Out)
+{
+	float CostB = 0.f, U = 0.f;
+	const float Score = ComputePerceptualScore(K, ViewLoc, ViewFwd, AStat, VStat, CostB, U);
+	AStat.LastScore = Score;
+	if (Score <= 0.f) return false;
+
+	Out.Cost     = CostB;
+	Out.U        = U;
+	Out.Score    = Score;
+	Out.DistSq   = float(FVector::DistSquared(ViewLoc, K.Pos));
+	Out.GroupKey = MakeGroupKey(ViewLoc, K.Pos, P.GroupCellUU);
+	return true;
+}
 
-			// ДИАГНОСТИКА: Логируем, что нашли
-			if (bDoDebugLog && Near.Num() == 0)
-			{
-				UE_LOG(LogSpaceRepGraph, Warning,
-					TEXT("[SPATIAL] PC=%s ViewLoc=(%.0f,%.0f,%.0f) QueryRadius=%.0fm Found=0 ships!"),
-					*GetNameSafe(PC),
-					ViewLoc.X, ViewLoc.Y, ViewLoc.Z,
-					QueryRadiusUU / 100.f);
-			}
+int32 USpaceReplicationGraph::SelectWithinBudget(const FSelectParams& P, TArray<FCandidate>& Candidates, float BudgetBytes,
+	TMap<int32, int32>& GroupCounts, float& InOutUsedBytes, int32& OutGroupsFormed)
+{
+	Candidates.Sort([](const FCandidate& A, const FCandidate& B){ return A.Score > B.Score; });
 
-			for (AActor* A : Near)
-			{
-				AShipPawn* Ship = Cast<AShipPawn>(A);
-				if (!Ship || Ship == ViewerPawn) continue;
-				if (!IsValid(Ship) || !Ship->GetIsReplicated()) continue;
+	int32 NumChosen = 0;
+	for (FCandidate& C : Candidates)
+	{
+		C.bChosen = false;
 
-				const bool  bIsPlayerShip = IsPlayerControlledShip(Ship);
-				const float DistSq        = FVector::DistSquared(ViewLoc, Ship->GetActorLocation());
+		const bool bGroupEmpty = !GroupCounts.Contains(C.GroupKey);
+		const float CostWithHeader = C.Cost + (bGroupEmpty ? P.HeaderCost : 0.f);
 
-				if (bIsPlayerShip)
-				{
-					if (DistSq > CullSqUU) continue;
-				}
-				else
-				{
-					if (DistSq > NPCCullSqUU) continue;
-				}
+		const bool bInAlwaysZone = (P.AlwaysInclSqUU > 0.f) && (C.DistSq <= P.AlwaysInclSqUU);
 
-				FActorEMA& AStat = CS.ActorStats.FindOrAdd(Ship);
-				float CostB = 0.f, U = 0.f;
-				float Score = ComputePerceptualScore(Ship, ViewerPawn, AStat, CS.Viewer, DeltaTime, CostB, U);
-				if (Score <= 0.f) continue;
-
-				FCandidate C;
-				C.Actor    = Ship;
-				C.Cost     = CostB;
-				C.U        = U;
-				C.Score    = Score;
-				C.GroupKey = MakeGroupKey(ViewLoc, Ship->GetActorLocation(), GroupCellUU);
-				Candidates.Add(C);
-			}
+		bool bPassHyst = false;
+		if (bInAlwaysZone)
+		{
+			bPassHyst = (C.Score > 0.f);
 		}
-		else  // Fallback без Spatial3D
+		else
 		{
-			for (TWeakObjectPtr<AShipPawn> ShipPtr : TrackedShips)
-			{
-				AShipPawn* Ship = ShipPtr.Get();
-				if (!Ship || Ship == ViewerPawn) continue;
-				if (!IsValid(Ship) || !Ship->GetIsReplicated()) continue;
+			bPassHyst = (C.Score >= P.S_enter) || (C.bWasVisible && C.Score >= P.S_exit);
+		}
 
-				const bool  bIsPlayerShip = IsPlayerControlledShip(Ship);
-				const float DistSq        = FVector::DistSquared(ViewLoc, Ship->GetActorLocation());
+		if (!bPassHyst)
+			continue;
 
-				if (bIsPlayerShip)
-				{
-					if (DistSq > CullSqUU) continue;
-				}
-				else
-				{
-					if (DistSq > NPCCullSqUU) continue;
-				}
+		if (InOutUsedBytes + CostWithHeader > BudgetBytes)
+			continue;
 
-				FActorEMA& AStat = CS.ActorStats.FindOrAdd(Ship);
-				float CostB = 0.f, U = 0.f;
-				float Score = ComputePerceptualScore(Ship, ViewerPawn, AStat, CS.Viewer, DeltaTime, CostB, U);
-				if (Score <= 0.f) continue;
-
-				FCandidate C;
-				C.Actor    = Ship;
-				C.Cost     = CostB;
-				C.U        = U;
-				C.Score    = Score;
-				C.GroupKey = MakeGroupKey(ViewLoc, Ship->GetActorLocation(), GroupCellUU);
-				Candidates.Add(C);
-			}
-		}
+		InOutUsedBytes += CostWithHeader;
+		C.bChosen = true;
+		++NumChosen;
 
-		// ДИАГНОСТИКА: Если нет кандидатов - детальный лог
-		if (Candidates.Num() == 0 && bDoDebugLog)
+		if (bGroupEmpty)
 		{
-			UE_LOG(LogSpaceRepGraph, Warning,
-				TEXT("[NO_CANDIDATES] PC=%s ViewLoc=(%.0f,%.0f,%.0f) TrackedShips=%d UseSpatial=%d ShipCullM=%.0f"),
-				*GetNameSafe(PC),
-				ViewLoc.X, ViewLoc.Y, ViewLoc.Z,
-				NumTrackedShipsWorld,
-				bUseSpatial ? 1 : 0,
-				ShipCullM);
+			GroupCounts.Add(C.GroupKey, 1);
+			++OutGroupsFormed;
 		}
+		else
+		{
+			GroupCounts.FindChecked(C.GroupKey)++;
+		}
+	}
+	return NumChosen;
+}
 
-		// Батчинг и выбор (код без изменений)
-		TMap<int32, bool> GroupHasAny;
-		TMap<int32, int32> GroupCounts;
-		CS.GroupsFormed = 0;
-
-		Candidates.Sort([](const FCandidate& A, const FCandidate& B){ return A.Score > B.Score; });
+void USpaceReplicationGraph::SelectForConnection(const FSelectParams& P, FSelectJob& Job, FSelectScratch& Scratch)
+{
+	FConnState&   CS         = *Job.CS;
+	const APawn*  ViewerPawn = Job.ViewerPawn;
+	const FVector ViewLoc    = Job.ViewLoc;
+	const float   SelDt      = Job.SelDt;
 
-		const float Safety = CVar_SpaceRepGraph_Safety.GetValueOnAnyThread();
-		const float BaseKBs= CVar_SpaceRepGraph_BudgetKBs.GetValueOnAnyThread();
-		const float TickBudgetBase = (BaseKBs * 1024.f) * Safety / TickHz;
+	// Обновление EMA зрителя
+	{
+		const double Now = P.Now;
+		if (!CS.Viewer.bInit)
+		{
+			CS.Viewer.PrevPos = ViewLoc;
+			CS.Viewer.PrevVel = FVector::ZeroVector;
+			CS.Viewer.PrevStamp = Now;
+			CS.Viewer.RTTmsEMA = CVar_SpaceRepGraph_RTTmsStart.GetValueOnAnyThread();
+			CS.Viewer.bInit = true;
+		}
+		else
+		{
+			const float dt = FMath::Max(1e-3f, float(Now - CS.Viewer.PrevStamp));
+			const FVector vel = (ViewLoc - CS.Viewer.PrevPos) / dt;
+			CS.Viewer.PrevVel = EMA(CS.Viewer.PrevVel, vel, 0.5f);
+			CS.Viewer.PrevPos = ViewLoc;
+			CS.Viewer.PrevStamp = Now;
+		}
+	}
 
-		float BudgetBytes = 0.f;
+	// Замеры прошлого интервала → стоимость выбранных тогда кораблей. Невыбранные
+	// не реплицировались — их оценка остаётся с последнего раза, когда были в наборе.
+	// Интервал входа в набор — это открытие канала и полное начальное состояние, в разы
+	// дороже установившегося: его не учитываем, дальше EMA от стартовой оценки.
+	// Корабль с периодом длиннее интервала мог не реплицироваться ни разу — нулевой
+	// замер удешевил бы его, поднял Score и укоротил период; такой интервал пропускаем.
+	for (const TWeakObjectPtr<AActor>& APtr : CS.Selected)
+	{
+		if (FActorEMA* AStat = CS.ActorStats.Find(APtr))
 		{
-			const float Blend = 0.5f;
-			const float Adapt = FMath::Max(2000.f, CS.Viewer.BudgetBytesPerTick);
-			BudgetBytes = FMath::Lerp(TickBudgetBase, Adapt, Blend);
+			if (AStat->PendingReps == 0) continue;
+			if (!AStat->bEntering)
+			{
+				AStat->BytesEMA       = EMA(AStat->BytesEMA, AStat->PendingBytes, 0.3f);
+				AStat->SerializeMsEMA = EMA(AStat->SerializeMsEMA, AStat->PendingMs, 0.3f);
+			}
+			AStat->PendingBytes   = 0.f;
+			AStat->PendingMs      = 0.f;
+			AStat->PendingReps    = 0;
+			AStat->bEntering      = false;
 		}
+	}
 
-		TSet<TWeakObjectPtr<AActor>> NowSelected;
-		float UsedBytes = 0.f;
-		int32 NumChosen = 0;
+	// Сбор кандидатов
+	TArray<FCandidate>& Candidates = Scratch.Candidates;
+	Candidates.Reset();
+	Candidates.Reserve(P.NumTrackedShips);
+	TArray<USRG_SpatialHash3D::FApproachHit>& Approaching = Scratch.Approaching;
+	Approaching.Reset();
 
-		const float S_exit  = CVar_SpaceRepGraph_ScoreExit.GetValueOnAnyThread();
+	// Кинематика корабля — из общей таблицы кадра; здесь только зависящее от зрителя
+	const FVector ViewFwd = GetViewerForward(ViewerPawn);
+	auto AddCandidate = [&](AActor* Ship)
+	{
+		const FShipKinematics* K = FindShipKinematics(Ship);
+		if (!K) return;  // добавлен после прохода кинематики — возьмём в следующем кадре
 
-		for (FCandidate& C : Candidates)
-		{
-			const bool bGroupEmpty = !GroupHasAny.FindRef(C.GroupKey);
-			const float CostWithHeader = C.Cost + (bGroupEmpty ? HeaderCost : 0.f);
+		FCandidate C;
+		if (!MakeCandidate(P, *K, ViewLoc, ViewFwd, CS.ActorStats.FindOrAdd(Ship), CS.Viewer, C)) return;
 
-			const bool bWasVisible = CS.Visible.Contains(C.Actor);
+		C.Actor       = Ship;
+		C.bWasVisible = CS.Visible.Contains(Ship);
+		Candidates.Add(C);
+	};
 
-			FVector TargetLoc = ViewLoc;
-			if (C.Actor.IsValid())
-			{
-				TargetLoc = C.Actor->GetActorLocation();
-			}
+	// ИСПРАВЛЕНО: Более надёжный запрос из Spatial3D
+	if (P.bUseSpatial)
+	{
+		TArray<AActor*>& Near = Scratch.Near;
+		Near.Reset();
+		double QueryUs = 0.0;  // запрос + упреждение этого соединения
 
-			const float DistSq = FVector::DistSquared(ViewLoc, TargetLoc);
-			const bool bInAlwaysZone = (AlwaysInclSqUU > 0.f) && (DistSq <= AlwaysInclSqUU);
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(SRG_ConnQuery);
+			SCOPE_CYCLE_COUNTER(STAT_SRG_ConnQuery);
+			const double QueryT0 = FPlatformTime::Seconds();
 
-			bool bPassHyst = false;
-			if (bInAlwaysZone)
+			if (P.KNearest > 0)
+				Spatial3D->QueryKNearest(ViewLoc, P.KNearest, P.CullRadii, Near, Scratch.Knn);
+			else if (P.bUseViewCone)
 			{
-				bPassHyst = (C.Score > 0.f);
+				Spatial3D->QueryCone(ViewLoc, ViewFwd, P.ViewConeHalfRad, P.CullRadii, Scratch.ConeHits, P.ViewConeRearUU);
+				Near.Reserve(Scratch.ConeHits.Num());
+				for (const USRG_SpatialHash3D::FViewHit& Hit : Scratch.ConeHits) Near.Add(Hit.Object);
 			}
-			else
+			else if (Job.bBatched)
 			{
-				bPassHyst = (C.Score >= S_enter) || (bWasVisible && C.Score >= S_exit);
+				Swap(Near, Job.BatchNear);
+				QueryUs += Job.BatchUs;
 			}
+			else
+				Spatial3D->QuerySphere(ViewLoc, P.CullRadii, Near);
 
-			if (!bPassHyst)
-				continue;
+			QueryUs += (FPlatformTime::Seconds() - QueryT0) * 1e6;
+		}
 
-			if (UsedBytes + CostWithHeader > BudgetBytes)
-				continue;
+		// ДИАГНОСТИКА: Логируем, что нашли
+		if (P.bDoDebugLog && Near.Num() == 0)
+		{
+			UE_LOG(LogSpaceRepGraph, Warning,
+				TEXT("[SPATIAL] Conn=%p ViewLoc=(%.0f,%.0f,%.0f) QueryRadius=%.0fm Found=0 ships!"),
+				Job.ConnMgr,
+				ViewLoc.X, ViewLoc.Y, ViewLoc.Z,
+				P.QueryRadiusUU / 100.f);
+		}
+
+		// В хэше только корабли, категория и радиус уже проверены запросом
+		for (AActor* Ship : Near)
+		{
+			if (Ship == ViewerPawn || !Ship->GetIsReplicated()) continue;
+			AddCandidate(Ship);
+		}
+
+		// Кто пересечёт границу отсечения до следующих тиков: каналы откроем заранее
+		if (P.PrewarmHorizonSec > 0.f && P.PrewarmMaxPerTick > 0)
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(SRG_ConnQuery);
+			SCOPE_CYCLE_COUNTER(STAT_SRG_ConnQuery);
+			const double PrewarmT0 = FPlatformTime::Seconds();
+			Spatial3D->QueryApproaching(ViewLoc, CS.Viewer.PrevVel, P.CullRadii, P.PrewarmHorizonSec, Approaching);
+			QueryUs += (FPlatformTime::Seconds() - PrewarmT0) * 1e6;
+		}
+
+		CS.LastQueryUs = float(QueryUs);
+		CS.QueryUsEMA  = (CS.QueryUsEMA > 0.f) ? EMA(CS.QueryUsEMA, CS.LastQueryUs, 0.1f) : CS.LastQueryUs;
+	}
+	else  // Fallback без Spatial3D
+	{
+		for (TWeakObjectPtr<AShipPawn> ShipPtr : TrackedShips)
+		{
+			AShipPawn* Ship = ShipPtr.Get();
+			if (!Ship || Ship == ViewerPawn) continue;
+			if (!IsValid(Ship) || !Ship->GetIsReplicated()) continue;
 
-			UsedBytes += CostWithHeader;
-			NowSelected.Add(C.Actor);
-			++NumChosen;
+			const bool  bIsPlayerShip = IsPlayerControlledShip(Ship);
+			const float DistSq        = FVector::DistSquared(ViewLoc, Ship->GetActorLocation());
 
-			if (bGroupEmpty)
+			if (bIsPlayerShip)
 			{
-				GroupHasAny.Add(C.GroupKey, true);
-				GroupCounts.FindOrAdd(C.GroupKey) = 1;
-				++CS.GroupsFormed;
+				if (DistSq > P.CullSqUU) continue;
 			}
 			else
 			{
-				GroupCounts.FindOrAdd(C.GroupKey)++;
+				if (DistSq > P.NPCCullSqUU) continue;
 			}
+
+			AddCandidate(Ship);
 		}
+	}
 
-		// Обновление per-connection AlwaysRelevant
-		{
-			for (TWeakObjectPtr<AActor> APtr : NowSelected)
-			{
-				AActor* A = APtr.Get();
-				if (!A) continue;
-				if (!CS.Selected.Contains(APtr))
-				{
-					if (A->NetDormancy != DORM_Awake)
-						A->SetNetDormancy(DORM_Awake);
+	Job.NumCand = Candidates.Num();
 
-					A->ForceNetUpdate();
+	// ДИАГНОСТИКА: Если нет кандидатов - детальный лог
+	if (Candidates.Num() == 0 && P.bDoDebugLog)
+	{
+		UE_LOG(LogSpaceRepGraph, Warning,
+			TEXT("[NO_CANDIDATES] Conn=%p ViewLoc=(%.0f,%.0f,%.0f) TrackedShips=%d UseSpatial=%d ShipCullM=%.0f"),
+			Job.ConnMgr,
+			ViewLoc.X, ViewLoc.Y, ViewLoc.Z,
+			P.NumTrackedShips,
+			P.bUseSpatial ? 1 : 0,
+			P.ShipCullM);
+	}
 
-					ARNode->NotifyAddNetworkActor(FNewReplicatedActorInfo(A));
-					LogChannelState(ConnMgr, A, TEXT("+ADD"));
-				}
-			}
+	// Батчинг и выбор
+	TMap<int32, int32>& GroupCounts = Scratch.GroupCounts;
+	GroupCounts.Reset();
+	CS.GroupsFormed = 0;
 
-			for (TWeakObjectPtr<AActor> Prev : CS.Selected)
-			{
-				if (!Prev.IsValid())
-					continue;
+	const float TickBudgetBase = (P.BaseKBs * 1024.f) * P.Safety * SelDt;
 
-				if (!NowSelected.Contains(Prev))
-				{
-					AActor* A = Prev.Get();
-					if (!A) continue;
+	// Регулятор уже видел канал — его скорость; до первого отсчёта — базовый бюджет
+	const float BudgetBytes = (CS.Viewer.BudgetBytesPerSec > 0.f)
+		? CS.Viewer.BudgetBytesPerSec * P.Safety * SelDt
+		: TickBudgetBase;
 
-					if (A->NetDormancy != DORM_DormantAll)
-						A->SetNetDormancy(DORM_DormantAll);
+	float UsedBytes = 0.f;
+	int32 NumChosen = SelectWithinBudget(P, Candidates, BudgetBytes, GroupCounts, UsedBytes, CS.GroupsFormed);
+	Job.TopScore = Candidates.Num() ? Candidates[0].Score : 0.f;
 
-					ARNode->NotifyRemoveNetworkActor(FNewReplicatedActorInfo(A));
-					LogChannelState(ConnMgr, A, TEXT("-REM"));
-				}
-			}
+	TSet<TWeakObjectPtr<AActor>>& NowSelected = Job.NowSelected;
+	NowSelected.Reset();
+	for (const FCandidate& C : Candidates)
+	{
+		if (C.bChosen) NowSelected.Add(C.Actor);
+	}
 
-			CS.Selected = MoveTemp(NowSelected);
-			CS.Visible  = CS.Selected;
-		}
+	// Упреждающий прогрев: подходящие к границе корабли берём до входа в радиус,
+	// чтобы открытие канала и начальный бандл не совпали в одном кадре.
+	// Уже прогретые держим без лимита, новых — не больше PrewarmMaxPerTick за тик.
+	int32 NumPrewarmNew = 0;
+	for (const USRG_SpatialHash3D::FApproachHit& Hit : Approaching)
+	{
+		AActor* Ship = Hit.Object;
+		if (Ship == ViewerPawn || !Ship->GetIsReplicated()) continue;
+		if (NowSelected.Contains(Ship)) continue;
+
+		const bool bAlreadyWarm = CS.Selected.Contains(Ship);
+		if (!bAlreadyWarm && NumPrewarmNew >= P.PrewarmMaxPerTick) continue;
+
+		const float CostB = FMath::Max(16.f, CS.ActorStats.FindOrAdd(Ship).BytesEMA) + P.HeaderCost;
+		if (UsedBytes + CostB > BudgetBytes) continue;
+
+		UsedBytes += CostB;
+		NowSelected.Add(Ship);
+		++NumChosen;
+		NumPrewarmNew += bAlreadyWarm ? 0 : 1;
+	}
 
-		UpdateAdaptiveBudget(ConnMgr, CS, UsedBytes, 1.f/TickHz);
+	Job.UsedBytes = UsedBytes;
+	Job.NumChosen = NumChosen;
+}
+
+void USpaceReplicationGraph::CommitSelection(const FSelectParams& P, FSelectJob& Job)
+{
+	UNetReplicationGraphConnection* ConnMgr = Job.ConnMgr;
+	FConnState& CS = *Job.CS;
 
-		if (bDoLiveLog)
+	// Входящие/выходящие корабли и период каждого — только в данных этого соединения:
+	// ни дормантности, ни ForceNetUpdate (оба глобальны и задевают других зрителей).
+	// Выбывший просто уходит из списка PerceptualNode, канал закроет таймаут графа.
+	{
+		for (TWeakObjectPtr<AActor> APtr : Job.NowSelected)
 		{
-			LogPerConnTick(ConnMgr, CS, NumTrackedShipsWorld, Candidates.Num(), NumChosen, UsedBytes, 1.f/TickHz);
+			AActor* A = APtr.Get();
+			if (!A) continue;
+
+			FActorEMA& AStat = CS.ActorStats.FindOrAdd(APtr);
+			FConnectionReplicationActorInfo& Info = ConnMgr->ActorInfoMap.FindOrAdd(A);
+			Info.ReplicationPeriodFrame = CalcReplicationPeriod(AStat.LastScore, Job.TopScore, P.MaxPeriodFrames);
+			// Отсекает сам отбор: классовая дистанция (ShipCullMeters) выкинула бы
+			// из списка прогретые корабли — они по определению ещё за границей
+			Info.SetCullDistanceSquared(0.f);
+
+			if (!CS.Selected.Contains(APtr))
+			{
+				// Новый — в ближайшем кадре, дальше по своему периоду
+				Info.NextReplicationFrameNum = 0;
+				AStat.bEntering = true;
+				LogChannelState(ConnMgr, A, TEXT("+ADD"));
+			}
 		}
-		
-		if (bDoDebugLog)
-			DrawDebugSphere(W, ViewLoc, ShipCullM*100.f, 32, FColor::Cyan, false, 0.1f, 0, 2.f);
+
+		for (TWeakObjectPtr<AActor> Prev : CS.Selected)
+		{
+			AActor* A = Prev.Get();
+			if (A && !Job.NowSelected.Contains(Prev))
+			{
+				LogChannelState(ConnMgr, A, TEXT("-REM"));
+			}
+		}
+
+		// Swap, а не Move: память набора остаётся заданию следующего кадра
+		Swap(CS.Selected, Job.NowSelected);
+		CS.Visible = CS.Selected;
+		PerceptualNode->SetSelection(ConnMgr, CS.Selected);
 	}
 
-	return true;
+	// Регулятор бюджета — по фактически отправленному за прошлый интервал; до первых замеров — по оценке
+	CS.LastReplicatedBytes = CS.ReplicatedBytes;
+	CS.LastReplicatedMs    = CS.ReplicatedMs;
+	CS.ReplicatedBytes     = 0.f;
+	CS.ReplicatedMs        = 0.f;
+	UpdateAdaptiveBudget(ConnMgr, CS, (CS.LastReplicatedBytes > 0.f) ? CS.LastReplicatedBytes : Job.UsedBytes, Job.SelDt);
+
+	if (CVar_SpaceRepGraph_LiveLog.GetValueOnGameThread() != 0)
+	{
+		LogPerConnTick(ConnMgr, CS, P.NumTrackedShips, Job.NumCand, Job.NumChosen, Job.UsedBytes, Job.SelDt);
+	}
+
+	if (P.bDoDebugLog)
+		DrawDebugSphere(GetWorld(), Job.ViewLoc, P.ShipCullM*100.f, 32, FColor::Cyan, false, 0.1f, 0, 2.f);
+}
+
+uint16 USpaceReplicationGraph::CalcReplicationPeriod(float Score, float TopScore, int32 MaxPeriodFrames)
+{
+	if (MaxPeriodFrames <= 1 || TopScore <= 0.f) return 1;
+	// Score <= 0 — прогретый корабль ещё за радиусом отсечения: самый редкий период
+	if (Score <= 0.f) return uint16(MaxPeriodFrames);
+	return uint16(FMath::Clamp(FMath::RoundToInt(TopScore / Score), 1, MaxPeriodFrames));
 }
 
 // ====================== Приоритизация: расчёт Score =========================
@@ -1045,19 +1684,14 @@ FVector USpaceReplicationGraph::GetActorAngularVel(const AActor* A) const
 	return FVector::ZeroVector;
 }
 
-float USpaceReplicationGraph::GetActorRadiusUU(AActor* A, FActorEMA& Cache)
+float USpaceReplicationGraph::GetActorRadiusUU(const AActor* A) const
 {
 	if (!A) return 100.f;
 
-	if (Cache.bInit && Cache.RadiusUU > 0.f)
-		return Cache.RadiusUU;
-
 	FVector Origin, Extent;
 	A->GetActorBounds(true, Origin, Extent);
 
-	const float Radius = Extent.Size();
-	Cache.RadiusUU = FMath::Clamp(Radius, 50.f, 5000.f);
-	return Cache.RadiusUU;
+	return FMath::Clamp(float(Extent.Size()), 50.f, 5000.f);
 }
 
 FVector USpaceReplicationGraph::GetViewerForward(const APawn* ViewerPawn) const
@@ -1065,7 +1699,7 @@ FVector USpaceReplicationGraph::GetViewerForward(const APawn* ViewerPawn) const
 	return GetPawnForward(ViewerPawn);
 }
 
-int32 USpaceReplicationGraph::MakeGroupKey(const FVector& ViewLoc, const FVector& ActorLoc, float CellUU) const
+int32 USpaceReplicationGraph::MakeGroupKey(const FVector& ViewLoc, const FVector& ActorLoc, float CellUU)
 {
 	const FVector Rel = ActorLoc - ViewLoc;
 	const int32 gx = int32(FMath::FloorToFloat(Rel.X / CellUU));
@@ -1074,44 +1708,41 @@ int32 USpaceReplicationGraph::MakeGroupKey(const FVector& ViewLoc, const FVector
 }
 
 float USpaceReplicationGraph::ComputePerceptualScore(
-	const AActor* Actor,
-	const APawn* ViewerPawn,
-	FActorEMA& AStat,
-	FViewerEMA& VStat,
-	float DeltaTime,
+	const FShipKinematics& Ship,
+	const FVector& ViewLoc,
+	const FVector& ViewFwd,
+	const FActorEMA& AStat,
+	const FViewerEMA& VStat,
 	float& OutCostB,
 	float& OutU)
 {
 	OutCostB = 0.f; OutU = 0.f;
-	if (!Actor || !ViewerPawn) return 0.f;
 
-	const FVector Apos = Actor->GetActorLocation();
-	const FVector Vpos = ViewerPawn->GetActorLocation();
+	const FVector Apos = Ship.Pos;
+	const FVector Vpos = ViewLoc;
 
 	const FVector dvec = Apos - Vpos;
 	float d = dvec.Size();
 	if (d < 1.f) d = 1.f;
 	const FVector n = dvec / d;
 
-	const FVector Avel  = GetActorVelocity(Actor);
+	const FVector Avel  = Ship.Vel;
 	const FVector Vvel  = VStat.PrevVel;
 
 	FVector vrel = (Avel - Vvel);
 	vrel -= FVector::DotProduct(vrel, n) * n;
 	const float vtan = vrel.Size();
 
-	const FVector Aang = GetActorAngularVel(Actor);
-	const float wSelf = Aang.Size();
+	const float wSelf = Ship.AngVel.Size();
 
 	const float FOVdeg  = CVar_SpaceRepGraph_FOVdeg.GetValueOnAnyThread();
 	const float FOVrad  = FOVdeg * (PI/180.f);
-	const FVector CamF  = GetViewerForward(ViewerPawn);
 
-	const float cosφ = FVector::DotProduct(CamF.GetSafeNormal(), n);
+	const float cosφ = FVector::DotProduct(ViewFwd.GetSafeNormal(), n);
 	const float φ = FMath::Acos(FMath::Clamp(cosφ, -1.f, 1.f));
 	const float w_fov = FMath::Exp( - FMath::Square( φ / (FOVrad*0.7f) ) );
 
-	const float R = GetActorRadiusUU(const_cast<AActor*>(Actor), AStat);
+	const float R = Ship.RadiusUU;
 	const float K_size = CVar_SpaceRepGraph_KSize.GetValueOnAnyThread();
 	const float w_size = FMath::Clamp(K_size * FMath::Square(R / d), 0.f, 1.f);
 
@@ -1119,36 +1750,13 @@ float USpaceReplicationGraph::ComputePerceptualScore(
 	const float w_los = 1.f;
 	const float W = w_fov * w_size * w_aff * w_los;
 
-	{
-		const double Now = Actor->GetWorld()->GetTimeSeconds();
-		const float dt = AStat.bInit ? FMath::Max(1e-3f, float(Now - AStat.PrevStamp)) : FMath::Max(DeltaTime, 1e-3f);
-		const FVector vel = Avel;
-		const FVector accel = (AStat.bInit ? (vel - AStat.PrevVel)/dt : FVector::ZeroVector);
-
-		const FVector vdir = vel.GetSafeNormal();
-		const FVector a_pred = FVector::DotProduct(accel, vdir) * vdir;
-		const FVector a_noise = accel - a_pred;
-
-		const float aN = a_noise.Size();
-		const float jN = AStat.bInit ? ((a_noise - AStat.PrevAccel)/dt).Size() : 0.f;
-
-		AStat.SigmaA = EMA(AStat.SigmaA, aN, 0.3f);
-		AStat.SigmaJ = EMA(AStat.SigmaJ, jN, 0.2f);
-
-		AStat.PrevPos = Apos;
-		AStat.PrevVel = vel;
-		AStat.PrevAccel = a_noise;
-		AStat.PrevStamp = Now;
-		AStat.bInit = true;
-	}
-
 	const float RTTs = VStat.RTTmsEMA * 0.001f;
 	const float TauMin = CVar_SpaceRepGraph_TauMin.GetValueOnAnyThread();
 	const float TauMax = CVar_SpaceRepGraph_TauMax.GetValueOnAnyThread();
 	const float T_sched = FMath::Clamp(0.5f * (TauMin + TauMax), TauMin, TauMax);
 	const float τ = FMath::Clamp(RTTs * 0.5f + T_sched, TauMin, TauMax);
 
-	const float e_pos = vtan*τ + 0.5f*AStat.SigmaA*τ*τ + (1.f/6.f)*AStat.SigmaJ*τ*τ*τ;
+	const float e_pos = vtan*τ + 0.5f*Ship.SigmaA*τ*τ + (1.f/6.f)*Ship.SigmaJ*τ*τ*τ;
 	const float θ_pos = e_pos / d;
 	const float θ_self= (R / d) * (wSelf * τ);
 
@@ -1161,14 +1769,7 @@ float USpaceReplicationGraph::ComputePerceptualScore(
 	const float U_base   = FMath::Max(0.5f, ShipCullM / FMath::Max(1.f, d_meters));
 	const float U_dynamic = W * Eang;
 
-	bool bIsPlayerShip = false;
-	if (const APawn* Pawn = Cast<const APawn>(Actor))
-	{
-		if (const AController* Ctrl = Pawn->GetController())
-		{
-			bIsPlayerShip = Ctrl->IsPlayerController();
-		}
-	}
+	const bool bIsPlayerShip = Ship.bPlayer;
 
 	const float PlayerPriority = CVar_SpaceRepGraph_PlayerShipPriority.GetValueOnAnyThread();
 	const float NPCPriority    = CVar_SpaceRepGraph_NPCShipPriority.GetValueOnAnyThread();
@@ -1189,36 +1790,42 @@ void USpaceReplicationGraph::UpdateAdaptiveBudget(UNetReplicationGraphConnection
 {
 	CS.Viewer.UsedBytesEMA = EMA(CS.Viewer.UsedBytesEMA, UsedBytesThisTick, 0.25f);
 
-	const float BaseKBs = CVar_SpaceRepGraph_BudgetKBs.GetValueOnAnyThread();
-	const float Safety  = CVar_SpaceRepGraph_Safety.GetValueOnAnyThread();
-	const float TickHz  = float(FMath::Max(1, CVar_SpaceRepGraph_TickHz.GetValueOnAnyThread()));
-	const float BasePerTick = (BaseKBs * 1024.f) * Safety / TickHz;
-
-	float B = CS.Viewer.BudgetBytesPerTick;
-	if (B <= 0.f) B = BasePerTick;
-
-	const float SatFrac = (B > 1.f) ? (UsedBytesThisTick / B) : 0.f;
+	UNetConnection* NC = ConnMgr ? ConnMgr->NetConnection : nullptr;
+	if (!NC) return;
 
-	const float Alpha = CVar_SpaceRepGraph_AIMD_Alpha.GetValueOnAnyThread();
-	const float Beta  = CVar_SpaceRepGraph_AIMD_Beta .GetValueOnAnyThread();
+	FSRGLinkSample& L = CS.LastLink;
+	L.DtSec           = FMath::Max(1e-3f, TickDt);
+	L.SentBytes       = UsedBytesThisTick;
+	L.RTTms           = float(NC->AvgLag * 1000.0);
+	L.LossFrac        = FMath::Clamp(NC->GetOutLossPercentage().GetAvgLossPercentage(), 0.f, 1.f);
+	// QueuedBits > 0 — движок ушёл в долг по кредиту отправки (насыщение канала)
+	L.QueuedBytes     = float(FMath::Max<int64>(0, NC->QueuedBits)) / 8.f;
+	L.LinkBytesPerSec = float(FMath::Max(0, NC->CurrentNetSpeed));
 
-	if (SatFrac > 0.95f)
+	if (L.RTTms > 0.f)
 	{
-		B *= FMath::Clamp(Beta, 0.5f, 0.98f);
-		CS.Viewer.OkTicks = 0;
+		CS.Viewer.RTTmsEMA = EMA(CS.Viewer.RTTmsEMA, L.RTTms, 0.2f);
 	}
-	else
+	CS.Viewer.LossEMA = EMA(CS.Viewer.LossEMA, L.LossFrac, 0.2f);
+
+	FSRGBudgetParams BP;
+	BP.MinBytesPerSec   = CVar_SpaceRepGraph_BudgetMinKBs.GetValueOnAnyThread() * 1024.f;
+	BP.MaxBytesPerSec   = FMath::Max(BP.MinBytesPerSec, CVar_SpaceRepGraph_BudgetMaxKBs.GetValueOnAnyThread() * 1024.f);
+	BP.StartBytesPerSec = FMath::Clamp(CVar_SpaceRepGraph_BudgetKBs.GetValueOnAnyThread() * 1024.f, BP.MinBytesPerSec, BP.MaxBytesPerSec);
+	BP.LossThreshold    = CVar_SpaceRepGraph_BudgetLossThreshold.GetValueOnAnyThread();
+	BP.AIMDAlpha        = CVar_SpaceRepGraph_AIMD_Alpha.GetValueOnAnyThread();
+	BP.AIMDBeta         = CVar_SpaceRepGraph_AIMD_Beta .GetValueOnAnyThread();
+	BP.DelayTargetMs    = CVar_SpaceRepGraph_BudgetDelayTargetMs.GetValueOnAnyThread();
+
+	const ESRGBudgetController Type =
+		(ESRGBudgetController)FMath::Clamp(CVar_SpaceRepGraph_BudgetController.GetValueOnAnyThread(), 0, 2);
+	if (!CS.Budget || CS.Budget->GetType() != Type)
 	{
-		CS.Viewer.OkTicks++;
-		if (CS.Viewer.OkTicks >= 4)
-		{
-			B += Alpha;
-			CS.Viewer.OkTicks = 0;
-		}
+		CS.Budget = FSRGBudgetController::Make(Type, BP);
 	}
+	CS.Budget->SetParams(BP);
 
-	B = FMath::Clamp(B, 2000.f, 20000.f);
-	CS.Viewer.BudgetBytesPerTick = EMA(CS.Viewer.BudgetBytesPerTick, B, 0.3f);
+	CS.Viewer.BudgetBytesPerSec = CS.Budget->Update(L);
 }
 
 void USpaceReplicationGraph::LogPerConnTick(
@@ -1236,17 +1843,34 @@ void USpaceReplicationGraph::LogPerConnTick(
 
 	const float UsedKB    = UsedBytes / 1024.f;
 	const float UsedKBs   = UsedBytes / 1024.f / FMath::Max(1e-3f, TickDt);
-	const float BudgetKBs = CS.Viewer.BudgetBytesPerTick / 1024.f / FMath::Max(1e-3f, TickDt);
+	const float BudgetKBs = CS.Viewer.BudgetBytesPerSec / 1024.f;
 
 	const FShipTypeCounts Counts = CalcShipTypeCounts(TrackedShips);
 
 	UE_LOG(LogSpaceRepGraph, Display,
-		TEXT("[REP] PC=%s | Ships(Total=%d Players=%d NPC=%d) | Cand=%d -> Chosen=%d (Groups=%d) | Used=%.1f KB (%.1f KB/s) / Budget=%.1f KB/s | RTT=%.0f ms"),
+		TEXT("[REP] PC=%s | Ships(Total=%d Players=%d NPC=%d) | Cand=%d -> Chosen=%d (Groups=%d) | Used=%.1f KB (%.1f KB/s) / Budget=%.1f KB/s | Sent=%.1f KB/s Rep=%.2f ms | %s %s RTT=%.0f ms (min %.0f) Loss=%.1f%% Queue=%.0f B Link=%.0f KB/s | Relinks=%.1f/s | Query=%.1f us (avg %.1f)"),
 		*GetNameSafe(PC),
 		Counts.Total, Counts.Players, Counts.NPCs,
 		NumCand, NumChosen, CS.GroupsFormed,
 		UsedKB, UsedKBs, BudgetKBs,
-		CS.Viewer.RTTmsEMA);
+		CS.LastReplicatedBytes / 1024.f / FMath::Max(1e-3f, TickDt), CS.LastReplicatedMs,
+		CS.Budget ? CS.Budget->GetName() : TEXT("-"),
+		CS.Budget ? *CS.Budget->Describe() : TEXT(""),
+		CS.Viewer.RTTmsEMA, CS.Budget ? CS.Budget->GetMinRTTms() : 0.f,
+		CS.Viewer.LossEMA * 100.f, CS.LastLink.QueuedBytes, CS.LastLink.LinkBytesPerSec / 1024.f,
+		Spatial3D ? Spatial3D->GetRelinksPerSecond() : 0.f,
+		CS.LastQueryUs, CS.QueryUsEMA);
+
+	if (Spatial3D)
+	{
+		const FSRGSpatialFrameStats& FS = Spatial3D->GetFrameStats();
+		UE_LOG(LogSpaceRepGraph, Verbose,
+			TEXT("[SPATIAL] Cells=%d/%d slots Entries=%d Mean=%.2f Max=%d | Reads=%d Relinks=%d Dropped=%d | Queries=%lld Visited=%lld Hit=%lld Tested=%lld Accepted=%lld"),
+			FS.Occupancy.NumCells, FS.Occupancy.NumSlots, FS.Occupancy.NumEntries,
+			FS.Occupancy.GetMeanPerCell(), FS.Occupancy.MaxPerCell,
+			FS.Refresh.Reads, FS.Refresh.Relinks, FS.Refresh.Dropped,
+			FS.Queries.Queries, FS.Queries.CellsVisited, FS.Queries.CellsHit, FS.Queries.Tested, FS.Queries.Accepted);
+	}
 
 	if (CVar_SpaceRepGraph_LiveLog.GetValueOnAnyThread() >= 2 && PC)
 	{
@@ -1283,5 +1907,199 @@ void USpaceReplicationGraph::LogPerConnTick(
 	}
 }
 
+// space.RepGraph.Spatial.DumpCells [Level=0]
+static FAutoConsoleCommandWithWorldAndArgs CCmd_SpaceRepGraph_SpatialDumpCells(
+	TEXT("space.RepGraph.Spatial.DumpCells"),
+	TEXT("Dump occupied Spatial3D cells (per-category counts) to Saved/Profiling/SpatialCells/*.csv and log occupancy. Args: [Level]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const USpaceReplicationGraph* Graph = USpaceReplicationGraph::Get(World);
+		if (!Graph || !Graph->Spatial3D)
+		{
+			UE_LOG(LogSpaceRepGraph, Warning, TEXT("[SPATIAL] DumpCells: no SpaceReplicationGraph/Spatial3D in this world (server only)"));
+			return;
+		}
+
+		const int32 Level = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 0;
+		FString Csv;
+		Graph->Spatial3D->WriteCellsCsv(Level, Csv);
+
+		const FString Path = FPaths::ProfilingDir() / TEXT("SpatialCells") /
+			FString::Printf(TEXT("Cells_L%d_%s.csv"), Level, *FDateTime::Now().ToString());
+		const bool bSaved = FFileHelper::SaveStringToFile(Csv, *Path);
+
+		const FSRGSpatialFrameStats& FS = Graph->Spatial3D->GetFrameStats();
+		FString Hist;
+		for (int32 b = 0; b < FSRGOccupancy::NumBuckets; ++b)
+		{
+			Hist += FString::Printf(TEXT(" %d+:%d"), FSRGOccupancy::BucketFloor(b), FS.Occupancy.Histogram[b]);
+		}
+		UE_LOG(LogSpaceRepGraph, Display,
+			TEXT("[SPATIAL] DumpCells %s %s | Cells=%d Slots=%d Entries=%d Mean=%.2f Max=%d | Histogram(entries per cell):%s"),
+			bSaved ? TEXT("->") : TEXT("FAILED"), *Path,
+			FS.Occupancy.NumCells, FS.Occupancy.NumSlots, FS.Occupancy.NumEntries,
+			FS.Occupancy.GetMeanPerCell(), FS.Occupancy.MaxPerCell, *Hist);
+	}));
+
+// ============= BenchSelect: масштабирование отбора по воркерам =============
+
+namespace
+{
+	/** Синтетический флот бенча: хэндл — индекс строки кинематики */
+	struct FBenchKinematicsPolicy
+	{
+		using FResolved = const USpaceReplicationGraph::FShipKinematics*;
+
+		const TArray<USpaceReplicationGraph::FShipKinematics>* Ships = nullptr;
+
+		FORCEINLINE FResolved Resolve(int32 H) const { return Ships->IsValidIndex(H) ? &(*Ships)[H] : nullptr; }
+		FORCEINLINE FVector GetLocation(FResolved S) const { return S->Pos; }
+		FORCEINLINE FVector GetVelocity(FResolved S) const { return S->Vel; }
+	};
+}
+
+void USpaceReplicationGraph::BenchSelectScaling(int32 NumShips, int32 NumViewers, double RadiusUU, int32 Iters)
+{
+	FRandomStream Rng(4242 + NumShips);
+
+	// Отряды по ~500 кораблей; кинематика — как после UpdateShipKinematics
+	const int32 NumSquads = FMath::Max(1, NumShips / 500);
+	TArray<FVector> Centers;
+	for (int32 s = 0; s < NumSquads; ++s)
+	{
+		Centers.Add(Rng.GetUnitVector() * Rng.FRandRange(0.f, 2.f) * RadiusUU);
+	}
+	TArray<FShipKinematics> Ships;
+	Ships.SetNum(NumShips);
+	for (int32 i = 0; i < NumShips; ++i)
+	{
+		FShipKinematics& K = Ships[i];
+		K.bInit    = true;
+		K.bPlayer  = (i % 10) == 0;
+		K.RadiusUU = Rng.FRandRange(200.f, 3000.f);
+		K.SigmaA   = Rng.FRandRange(0.f, 2000.f);
+		K.SigmaJ   = Rng.FRandRange(0.f, 4000.f);
+		K.Pos      = Centers[i % NumSquads] + Rng.GetUnitVector() * Rng.FRandRange(0.f, 0.25f) * RadiusUU;
+		K.Vel      = Rng.GetUnitVector() * Rng.FRandRange(0.f, 30000.f);
+		K.AngVel   = Rng.GetUnitVector() * Rng.FRandRange(0.f, 1.f);
+	}
+
+	FBenchKinematicsPolicy Policy;
+	Policy.Ships = &Ships;
+	TSpatialHash3D<int32, FBenchKinematicsPolicy> Hash(Policy);
+	Hash.Init(float(RadiusUU * 0.5));
+	for (int32 i = 0; i < NumShips; ++i) Hash.Add(i);
+	Hash.Refresh(0.0);
+
+	// Параметры — из тех же CVar'ов, что у UpdateSelection; бюджет — базовый на интервал отбора
+	FSelectParams P;
+	const float AlwaysInclM = FMath::Max(0.f, CVar_SpaceRepGraph_AlwaysIncludeMeters.GetValueOnAnyThread());
+	P.AlwaysInclSqUU = (AlwaysInclM > 0.f) ? FMath::Square(AlwaysInclM * 100.f) : 0.f;
+	P.GroupCellUU    = FMath::Max(1.f, CVar_SpaceRepGraph_GroupCellMeters.GetValueOnAnyThread()) * 100.f;
+	P.HeaderCost     = FMath::Max(0.f, CVar_SpaceRepGraph_HeaderCostBytes.GetValueOnAnyThread());
+	P.S_enter        = CVar_SpaceRepGraph_ScoreEnter.GetValueOnAnyThread();
+	P.S_exit         = CVar_SpaceRepGraph_ScoreExit.GetValueOnAnyThread();
+	P.Safety         = CVar_SpaceRepGraph_Safety.GetValueOnAnyThread();
+	P.BaseKBs        = CVar_SpaceRepGraph_BudgetKBs.GetValueOnAnyThread();
+	const float SelDt       = 1.f / float(FMath::Max(1, CVar_SpaceRepGraph_TickHz.GetValueOnAnyThread()));
+	const float BudgetBytes = (P.BaseKBs * 1024.f) * P.Safety * SelDt;
+
+	struct FBenchViewer
+	{
+		int32      Ship    = 0;
+		FVector    Forward = FVector::ForwardVector;
+		FViewerEMA Viewer;
+		TMap<int32, FActorEMA> Stats;
+		int32      NumChosen = 0;
+	};
+	struct FBenchScratch
+	{
+		TArray<const FShipKinematics*> Near;
+		TArray<FCandidate> Candidates;
+		TMap<int32, int32> GroupCounts;
+	};
+
+	TArray<FBenchViewer> Viewers;
+	Viewers.SetNum(NumViewers);
+	for (FBenchViewer& V : Viewers)
+	{
+		V.Ship           = Rng.RandHelper(NumShips);
+		V.Forward        = Rng.GetUnitVector();
+		V.Viewer.bInit   = true;
+		V.Viewer.PrevPos = Ships[V.Ship].Pos;
+		V.Viewer.PrevVel = Ships[V.Ship].Vel;
+	}
+
+	// Тело задания — как SelectForConnection без UObject'ов: запрос, MakeCandidate, SelectWithinBudget.
+	// Гистерезиса между итерациями нет (bWasVisible = false), Chosen одинаков во всех строках.
+	auto SelectOne = [&](FBenchViewer& V, FBenchScratch& S)
+	{
+		const FShipKinematics& Me = Ships[V.Ship];
+		Hash.QuerySphere(Me.Pos, RadiusUU, S.Near);
+		S.Candidates.Reset();
+		for (const FShipKinematics* K : S.Near)
+		{
+			const int32 h = int32(K - Ships.GetData());
+			if (h == V.Ship) continue;
+
+			FCandidate C;
+			if (MakeCandidate(P, *K, Me.Pos, V.Forward, V.Stats.FindOrAdd(h), V.Viewer, C))
+			{
+				S.Candidates.Add(C);
+			}
+		}
+		S.GroupCounts.Reset();
+		float UsedBytes = 0.f;
+		int32 Groups    = 0;
+		V.NumChosen = SelectWithinBudget(P, S.Candidates, BudgetBytes, S.GroupCounts, UsedBytes, Groups);
+	};
+
+	TArray<FBenchScratch> Scratch;
+	const int32 PoolThreads = FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	double SerialMs = 0.0;
+	for (int32 Workers : { 1, 2, 4, 8, 16, 32 })
+	{
+		Workers = FMath::Min(Workers, NumViewers);
+		if (Scratch.Num() < Workers) Scratch.SetNum(Workers);
+		for (FBenchViewer& V : Viewers) V.Stats.Reset();
+
+		double Ms = 0.0;
+		for (int32 It = 0; It <= Iters; ++It)  // It == 0 — прогрев (ёмкости карт и скретча)
+		{
+			const double T0 = FPlatformTime::Seconds();
+			DispatchSelectJobs(NumViewers, Workers, [&](int32 Worker, int32 v)
+			{
+				SelectOne(Viewers[v], Scratch[Worker]);
+			});
+			Ms += (It > 0) ? (FPlatformTime::Seconds() - T0) * 1000.0 : 0.0;
+		}
+		Ms /= double(FMath::Max(1, Iters));
+		SerialMs = (Workers == 1) ? Ms : SerialMs;
+
+		int64 Chosen = 0;
+		for (const FBenchViewer& V : Viewers) Chosen += V.NumChosen;
+		const double Speedup = SerialMs / FMath::Max(1e-6, Ms);
+		UE_LOG(LogSpaceRepGraph, Display,
+			TEXT("[BENCH] Select Workers=%2d (pool %2d) | %8.3f ms/frame (%7.2f us/viewer) | x%5.2f eff %3.0f%% | Chosen=%lld"),
+			Workers, PoolThreads, Ms, Ms * 1000.0 / double(NumViewers), Speedup,
+			100.0 * Speedup / double(FMath::Min(Workers, PoolThreads)), (long long)Chosen);
+	}
+}
+
+// space.RepGraph.Spatial.BenchSelect [Ships=20000] [Viewers=100] [RadiusMeters=20000] [Iters=8]
+static FAutoConsoleCommand CCmd_SpaceRepGraph_SpatialBenchSelect(
+	TEXT("space.RepGraph.Spatial.BenchSelect"),
+	TEXT("Scaling of per-connection perceptual scoring/selection over 1..32 workers (the graph's DispatchSelectJobs/MakeCandidate/SelectWithinBudget on a synthetic fleet). Args: [Ships] [Viewers] [RadiusMeters] [Iters]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32  Ships   = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 20000;
+		const int32  Viewers = (Args.Num() > 1) ? FCString::Atoi(*Args[1]) : 100;
+		const double RadiusM = (Args.Num() > 2) ? FCString::Atod(*Args[2]) : 20000.0;
+		const int32  Iters   = (Args.Num() > 3) ? FCString::Atoi(*Args[3]) : 8;
+
+		UE_LOG(LogSpaceRepGraph, Display, TEXT("[BENCH] Select Ships=%d Viewers=%d Radius=%.0fm Iters=%d"), Ships, Viewers, RadiusM, Iters);
+		USpaceReplicationGraph::BenchSelectScaling(FMath::Max(2, Ships), FMath::Max(1, Viewers), FMath::Max(1.0, RadiusM) * 100.0, FMath::Max(1, Iters));
+	}));
+
 // Остальные функции (ComputePerceptualScore, UpdateAdaptiveBudget, LogPerConnTick и т.д.) 
 // остаются БЕЗ ИЗМЕНЕНИЙ из исходного кода
\ No newline at end of file
@@ -3,12 +3,43 @@
 
 #include "CoreMinimal.h"
 #include "ReplicationGraph.h"
+#include "SRG_SpatialHash3D.h"
+#include "SRG_BudgetController.h"
 #include "SpaceReplicationGraph.generated.h"
 
 // Forward declarations
 class AShipPawn;
 class USRG_SpatialHash3D;
 
+/**
+ * Отбор кораблей по соединениям: глобальный узел, на каждое соединение — плоский
+ * список из последнего прохода перцептуального отбора. Gather отдаёт его как есть;
+ * отбор заменяет список целиком (SetSelection), без поштучных add/remove в
+ * AlwaysRelevant_ForConnection — тот остаётся только под пешку владельца.
+ */
+UCLASS()
+class SPACETEST_API UReplicationGraphNode_PerceptualShips : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+	// Корабли приходят не через роутинг, а из отбора (SetSelection)
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override {}
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override;
+	virtual void NotifyResetAllNetworkActors() override;
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+	virtual void GetAllActorsInNode_Debugging(TArray<FActorRepListType>& OutArray) const override;
+
+	/** Заменить список соединения результатом отбора (невалидные пропускаются) */
+	void SetSelection(const UNetReplicationGraphConnection* ConnMgr, const TSet<TWeakObjectPtr<AActor>>& Selected);
+
+	void  RemoveConnection(const UNetReplicationGraphConnection* ConnMgr);
+	int32 GetNumSelected(const UNetReplicationGraphConnection* ConnMgr) const;
+
+private:
+	TMap<const UNetReplicationGraphConnection*, FActorRepListRefView> Selections;
+};
+
 /**
  * Перцептуальный ReplicationGraph для космических боёв на огромных дистанциях
  * 
@@ -32,6 +63,9 @@ public:
 	virtual void RemoveClientConnection(UNetConnection* NetConnection) override;
 	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
 	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+	virtual int64 ReplicateSingleActor(AActor* Actor, FConnectionReplicationActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalActorInfo,
+		FPerConnectionActorInfoMap& ConnectionActorInfoMap, UNetReplicationGraphConnection& ConnectionManager, const uint32 FrameNum) override;
 	virtual void BeginDestroy() override;
 
 	// ========== Custom API ==========
@@ -43,6 +77,17 @@ public:
 	// УСТАРЕЛО: Оставлено для совместимости, вызывает Rebias3D
 	void RebiasToXY(const FVector& WorldLoc);
 
+	/**
+	 * Ближайший корабль игрока к Ship по последнему проходу осведомлённости
+	 * (пары из Spatial3D, раз в Awareness.PeriodSec). true — OutPlayerShip не nullptr.
+	 * false — граф Ship не ведёт, проход выключен или игроков ближе
+	 * Awareness.RadiusMeters нет: вызывающий ищет сам, на любой дистанции.
+	 */
+	bool FindNearestPlayerShip(const AActor* Ship, AActor*& OutPlayerShip) const;
+
+	/** Граф мира, если это USpaceReplicationGraph (сервер) */
+	static USpaceReplicationGraph* Get(const UWorld* World);
+
 	// ========== Nodes ==========
 	UPROPERTY()
 	TObjectPtr<UReplicationGraphNode_GridSpatialization2D> GridNode;
@@ -50,6 +95,9 @@ public:
 	UPROPERTY()
 	TObjectPtr<UReplicationGraphNode_ActorList> AlwaysRelevantNode;
 
+	UPROPERTY()
+	TObjectPtr<UReplicationGraphNode_PerceptualShips> PerceptualNode;
+
 	TMap<TWeakObjectPtr<UNetReplicationGraphConnection>, TWeakObjectPtr<UReplicationGraphNode_AlwaysRelevant_ForConnection>> PerConnAlwaysMap;
 
 	// ========== 3D Spatial Hash ==========
@@ -59,31 +107,78 @@ public:
 	// ========== Tracking ==========
 	TSet<TWeakObjectPtr<AShipPawn>> TrackedShips;
 
+	// ========== Awareness (пары кораблей из Spatial3D) ==========
+	void UpdateAwareness(double NowSeconds);
+
+	TArray<int64>           AwarenessPacked;         // по индексу хэндла: (биты DistSq << 32) | индекс игрока
+	FSRGPairScratch         AwarenessPairScratch;    // скретч прохода по парам
+	/** Результат прохода для корабля: Self — его хэндл на момент прохода (слот мог перейти новому кораблю) */
+	struct FNearestPlayer
+	{
+		FSRGActorHandle Self;
+		FSRGActorHandle Player;
+	};
+	TArray<FNearestPlayer>  NearestPlayerByHandle;   // по индексу хэндла
+	double                  LastAwarenessTime = -1e30;
+	bool                    bAwarenessValid   = false;
+
 	// ========== Per-Connection State ==========
+	/**
+	 * Стоимость корабля для конкретного соединения за интервал отбора (кинематика —
+	 * в FShipKinematics). Pending* копит ReplicateSingleActor, в EMA сворачивается
+	 * при следующем отборе соединения; до первого замера — стартовые оценки.
+	 */
 	struct FActorEMA
 	{
-		bool  bInit             = false;
-		float RadiusUU          = 0.f;
 		float BytesEMA          = 128.f;
 		float SerializeMsEMA    = 0.001f;
-		float SigmaA            = 0.f;
-		float SigmaJ            = 0.f;
-		FVector PrevPos         = FVector::ZeroVector;
-		FVector PrevVel         = FVector::ZeroVector;
-		FVector PrevAccel       = FVector::ZeroVector;
-		double  PrevStamp       = 0.0;
+		float PendingBytes      = 0.f;
+		float PendingMs         = 0.f;
+		int32 PendingReps       = 0;      // репликаций за интервал; при периоде > интервала бывает 0
+		bool  bEntering         = false;  // интервал входа в набор: открытие канала, полный начальный бандл
+		float LastScore         = 0.f;  // на последнем отборе соединения → период репликации
+	};
+
+	/**
+	 * Кинематика корабля — общая для всех соединений, обновляется раз в кадр
+	 * (UpdateShipKinematics) по индексу хэндла Spatial3D. Поколение хэндла отличает
+	 * переиспользованный слот.
+	 */
+	struct FShipKinematics
+	{
+		bool    bInit      = false;
+		bool    bPlayer    = false;
+		uint32  Generation = 0;
+		float   RadiusUU   = 0.f;
+		float   SigmaA     = 0.f;
+		float   SigmaJ     = 0.f;
+		FVector Pos        = FVector::ZeroVector;
+		FVector Vel        = FVector::ZeroVector;
+		FVector AngVel     = FVector::ZeroVector;
+		FVector PrevAccel  = FVector::ZeroVector;
+		double  Stamp      = 0.0;
+		// Отсчёт для σa/σj: скорость и время на прошлой границе окна 1/TickHz
+		FVector SampleVel   = FVector::ZeroVector;
+		double  SampleStamp = 0.0;
 	};
 
+	TArray<FShipKinematics> ShipKinematics;  // по индексу хэндла
+
+	/** Раз в кадр после Refresh: позиция, скорость, σa/σj, радиус, игрок/NPC */
+	void UpdateShipKinematics(double NowSeconds);
+	/** nullptr — корабля нет в Spatial3D или кинематика ещё не снята */
+	const FShipKinematics* FindShipKinematics(const AActor* Ship) const;
+
 	struct FViewerEMA
 	{
 		bool    bInit                = false;
 		FVector PrevPos              = FVector::ZeroVector;
 		FVector PrevVel              = FVector::ZeroVector;
 		double  PrevStamp            = 0.0;
-		float   RTTmsEMA             = 80.f;
-		float   BudgetBytesPerTick   = 0.f;
+		float   RTTmsEMA             = 80.f;   // UNetConnection::AvgLag
+		float   LossEMA              = 0.f;    // исходящие потери, [0..1]
+		float   BudgetBytesPerSec    = 0.f;    // 0 — регулятор ещё не отработал
 		float   UsedBytesEMA         = 0.f;
-		int32   OkTicks              = 0;
 	};
 
 	struct FCandidate
@@ -92,7 +187,10 @@ public:
 		float Cost  = 0.f;
 		float U     = 0.f;
 		float Score = 0.f;
+		float DistSq = 0.f;  // до зрителя, по таблице кинематики кадра
 		int32 GroupKey = 0;
+		bool  bWasVisible = false;  // был в наборе прошлого отбора (гистерезис)
+		bool  bChosen     = false;  // выход SelectWithinBudget
 	};
 
 	struct FConnState
@@ -102,13 +200,135 @@ public:
 		TSet<TWeakObjectPtr<AActor>> Visible;
 		TMap<TWeakObjectPtr<AActor>, FActorEMA> ActorStats;
 		int32 GroupsFormed = 0;
+		float LastQueryUs  = 0.f;  // пространственный запрос + упреждение прошлого тика, мкс
+		float QueryUsEMA   = 0.f;
+
+		// Фактическая репликация кораблей этому соединению (ReplicateSingleActor)
+		float ReplicatedBytes     = 0.f;  // с прошлого отбора
+		float ReplicatedMs        = 0.f;
+		float LastReplicatedBytes = 0.f;  // за прошлый интервал отбора
+		float LastReplicatedMs    = 0.f;
+
+		// Регулятор бюджета (space.RepGraph.Budget.Controller) и последний отсчёт канала
+		TUniquePtr<FSRGBudgetController> Budget;
+		FSRGLinkSample LastLink;
+
+		// Расписание отбора: раз в NetHz/SelectHz сетевых кадров; фаза сдвигает только первый срок
+		int32  SelectPhase     = 0;
+		float  SelectHz        = 0.f;     // 0 — space.RepGraph.TickHz
+		double LastSelectTime  = -1.0;    // < 0 — ещё не отбиралось
+		uint32 NextSelectFrame = 0;       // SelectFrame, с которого соединение снова к отбору
 	};
 
 	TMap<TWeakObjectPtr<UNetReplicationGraphConnection>, FConnState> ConnStates;
 
-	// ========== LiveLog / AutoRebias ==========
-	FTSTicker::FDelegateHandle LiveLogTickerHandle;
-	bool LiveLog_Tick(float DeltaTime);
+	// ========== Отбор / LiveLog / AutoRebias ==========
+	/** Из ServerReplicateActors: авторебиас и отбор по соединениям, чья очередь в этом кадре */
+	void UpdateSelection(float DeltaSeconds);
+
+	/** Частота отбора соединения, Hz (0 — space.RepGraph.TickHz) */
+	void SetConnectionSelectHz(UNetReplicationGraphConnection* ConnMgr, float Hz);
+
+	uint32 SelectFrame     = 0;
+	int32  NextSelectPhase = 0;
+	float  NetFrameHzEMA   = 0.f;
+
+	/** Параметры отбора кадра: CVar'ы и радиусы, общие для всех соединений */
+	struct FSelectParams
+	{
+		double Now               = 0.0;
+		float  ShipCullM         = 0.f;
+		float  CullSqUU          = 0.f;
+		float  NPCCullSqUU       = 0.f;
+		float  AlwaysInclSqUU    = 0.f;
+		float  QueryRadiusUU     = 0.f;
+		FSRGCategoryRadii CullRadii;
+		float  GroupCellUU       = 0.f;
+		float  HeaderCost        = 0.f;
+		float  S_enter           = 0.f;
+		float  S_exit            = 0.f;
+		float  Safety            = 0.f;
+		float  BaseKBs           = 0.f;
+		bool   bUseSpatial       = false;
+		int32  KNearest          = 0;
+		bool   bUseViewCone      = false;
+		float  ViewConeHalfRad   = 0.f;
+		float  ViewConeRearUU    = 0.f;
+		float  PrewarmHorizonSec = 0.f;
+		int32  PrewarmMaxPerTick = 0;
+		int32  MaxPeriodFrames   = 1;
+		bool   bDoDebugLog       = false;
+		int32  NumTrackedShips   = 0;
+	};
+
+	/** Отбор одного соединения: готовится на game thread, считается на воркере, применяется в CommitSelection */
+	struct FSelectJob
+	{
+		UNetReplicationGraphConnection* ConnMgr = nullptr;
+		FConnState*  CS         = nullptr;
+		const APawn* ViewerPawn = nullptr;
+		FVector      ViewLoc    = FVector::ZeroVector;
+		float        SelDt      = 0.f;
+		bool         bBatched   = false;   // BatchNear — результат общего пакетного запроса
+		double       BatchUs    = 0.0;
+		TArray<AActor*> BatchNear;
+
+		TSet<TWeakObjectPtr<AActor>> NowSelected;
+		float UsedBytes = 0.f;
+		float TopScore  = 0.f;
+		int32 NumCand   = 0;
+		int32 NumChosen = 0;
+	};
+
+	/** Память одного воркера отбора; живёт между кадрами, чтобы не аллоцировать на соединение */
+	struct FSelectScratch
+	{
+		TArray<FCandidate> Candidates;
+		TArray<AActor*>    Near;
+		TArray<USRG_SpatialHash3D::FViewHit>     ConeHits;
+		TArray<USRG_SpatialHash3D::FApproachHit> Approaching;
+		TMap<int32, int32> GroupCounts;
+		FSRGKnnScratch     Knn;
+	};
+
+	TArray<FSelectJob>     SelectJobs;
+	TArray<FSelectScratch> SelectScratch;
+
+	/** Фаза 1: скоринг и жадный отбор по заданиям на NumWorkers воркерах (0 — все) */
+	void RunSelectJobs(const FSelectParams& P, TArrayView<FSelectJob> Jobs, int32 NumWorkers);
+	/** Число воркеров отбора: 0 — все потоки пула, не больше числа заданий */
+	static int32 ResolveSelectWorkers(int32 Requested, int32 NumJobs);
+	/** Раздача заданий из общего счётчика: Fn(Worker, Job) на NumWorkers воркерах */
+	static void DispatchSelectJobs(int32 NumJobs, int32 NumWorkers, TFunctionRef<void(int32 Worker, int32 Job)> Fn);
+	/**
+	 * Кандидат из строки таблицы кинематики: скор, стоимость, дистанция, группа;
+	 * AStat.LastScore — для периода. false — Score <= 0, кандидата нет.
+	 * Actor и bWasVisible заполняет вызывающий.
+	 */
+	static bool MakeCandidate(const FSelectParams& P, const FShipKinematics& K, const FVector& ViewLoc, const FVector& ViewFwd,
+		FActorEMA& AStat, const FViewerEMA& VStat, FCandidate& Out);
+	/**
+	 * Жадный отбор по бюджету: сортировка по Score, гистерезис S_enter/S_exit (зона
+	 * AlwaysInclude — любой Score > 0), заголовок на новую группу. Выбранным — bChosen;
+	 * возвращает их число, InOutUsedBytes и OutGroupsFormed — накопленные.
+	 */
+	static int32 SelectWithinBudget(const FSelectParams& P, TArray<FCandidate>& Candidates, float BudgetBytes,
+		TMap<int32, int32>& GroupCounts, float& InOutUsedBytes, int32& OutGroupsFormed);
+	/**
+	 * space.RepGraph.Spatial.BenchSelect: масштабирование отбора по 1..32 воркерам на синтетическом
+	 * флоте — те же DispatchSelectJobs, MakeCandidate и SelectWithinBudget, что в RunSelectJobs
+	 */
+	static void BenchSelectScaling(int32 NumShips, int32 NumViewers, double RadiusUU, int32 Iters);
+	/** Только чтение мира; пишет в Job, Scratch и своё FConnState */
+	void SelectForConnection(const FSelectParams& P, FSelectJob& Job, FSelectScratch& Scratch);
+	/** Фаза 2 (game thread): каналы, списки узла, бюджет, логи */
+	void CommitSelection(const FSelectParams& P, FSelectJob& Job);
+	/**
+	 * Период репликации корабля этому соединению (сетевых кадров): лучший по Score — каждый
+	 * кадр, остальные реже пропорционально TopScore/Score, не больше MaxPeriodFrames
+	 */
+	static uint16 CalcReplicationPeriod(float Score, float TopScore, int32 MaxPeriodFrames);
+
 	void LiveLog_OnConnAdded(UNetReplicationGraphConnection* ConnMgr);
 	void LiveLog_OnConnRemoved(UNetReplicationGraphConnection* ConnMgr);
 
@@ -119,22 +339,24 @@ public:
 	double LastRebiasWall   = 0.0;
 
 	// ========== Prioritization ==========
-	float ComputePerceptualScore(
-		const AActor* Actor,
-		const APawn* ViewerPawn,
-		FActorEMA& AStat,
-		FViewerEMA& VStat,
-		float DeltaTime,
+	/** Только зависящее от зрителя: касательная скорость, угол к взгляду, угловой размер, стоимость */
+	static float ComputePerceptualScore(
+		const FShipKinematics& Ship,
+		const FVector& ViewLoc,
+		const FVector& ViewFwd,
+		const FActorEMA& AStat,
+		const FViewerEMA& VStat,
 		float& OutCostB,
 		float& OutU);
 
 	FVector GetActorVelocity(const AActor* A) const;
 	FVector GetActorAngularVel(const AActor* A) const;
-	float GetActorRadiusUU(AActor* A, FActorEMA& Cache);
+	float GetActorRadiusUU(const AActor* A) const;
 	FVector GetViewerForward(const APawn* ViewerPawn) const;
-	int32 MakeGroupKey(const FVector& ViewLoc, const FVector& ActorLoc, float CellUU) const;
+	static int32 MakeGroupKey(const FVector& ViewLoc, const FVector& ActorLoc, float CellUU);
 
 	// ========== Budget ==========
+	/** Отсчёт канала (AvgLag, потери, QueuedBits, CurrentNetSpeed) + отправленное → регулятор → BudgetBytesPerSec */
 	void UpdateAdaptiveBudget(UNetReplicationGraphConnection* ConnMgr, FConnState& CS, float UsedBytesThisTick, float TickDt);
 	void LogPerConnTick(UNetReplicationGraphConnection* ConnMgr, const FConnState& CS, int32 NumTracked, int32 NumCand, int32 NumChosen, float UsedBytes, float TickDt);
 
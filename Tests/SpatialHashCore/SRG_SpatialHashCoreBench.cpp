@@ -0,0 +1,127 @@
+// SRG_SpatialHashCoreBench.cpp
+// Пропускная способность TSpatialHash3D без движка (то же, что
+// space.RepGraph.Spatial.BenchCore в редакторе): вставка, Refresh после шага
+// флота, сфера, KNN. Флот и умолчания — как в RunCore: куб ±2R, ячейка 50 км, R 18 км.
+//
+//   SRG_SpatialHashCoreBench [NumShips...]   (по умолчанию 1000 10000 100000)
+
+#include "SRG_SpatialHashCore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace
+{
+	struct FBenchShip
+	{
+		FVector Pos = FVector::ZeroVector;
+		FVector Vel = FVector::ZeroVector;
+	};
+
+	struct FBenchFleetPolicy
+	{
+		using FResolved = const FBenchShip*;
+
+		const TArray<FBenchShip>* Ships = nullptr;
+
+		FORCEINLINE const FBenchShip* Resolve(int32 H) const { return Ships->IsValidIndex(H) ? &(*Ships)[H] : nullptr; }
+		FORCEINLINE FVector GetLocation(const FBenchShip* S) const { return S->Pos; }
+		FORCEINLINE FVector GetVelocity(const FBenchShip* S) const { return S->Vel; }
+	};
+
+	double Seconds()
+	{
+		using FClock = std::chrono::steady_clock;
+		return std::chrono::duration<double>(FClock::now().time_since_epoch()).count();
+	}
+
+	FVector RandUnit(std::mt19937& Rng)
+	{
+		std::normal_distribution<double> N(0.0, 1.0);
+		return FVector(N(Rng), N(Rng), N(Rng)).GetSafeNormal();
+	}
+
+	void RunCore(int32 NumShips, double CellUU, double RadiusUU, int32 NumQueries, int32 K)
+	{
+		std::mt19937 Rng(9001 + NumShips);
+		std::uniform_real_distribution<double> Spread(-2.0 * RadiusUU, 2.0 * RadiusUU);
+		std::uniform_real_distribution<double> Drift(0.0, 0.05);
+		std::uniform_int_distribution<int32>   Pick(0, NumShips - 1);
+
+		// Скорости — до 5% ячейки за шаг 0.25 с
+		constexpr double StepSec = 0.25;
+		TArray<FBenchShip> Ships;
+		Ships.SetNum(NumShips);
+		for (FBenchShip& S : Ships)
+		{
+			S.Pos = FVector(Spread(Rng), Spread(Rng), Spread(Rng));
+			S.Vel = RandUnit(Rng) * (Drift(Rng) * CellUU / StepSec);
+		}
+
+		TArray<int32> Viewers;
+		for (int32 q = 0; q < NumQueries; ++q) Viewers.Add(Pick(Rng));
+
+		FBenchFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		TSpatialHash3D<int32, FBenchFleetPolicy> Hash(Policy);
+		Hash.Init(float(CellUU));
+
+		double T0 = Seconds();
+		for (int32 i = 0; i < NumShips; ++i) Hash.Add(i);
+		const double InsertMs = (Seconds() - T0) * 1000.0;
+
+		// Первый Refresh — полный проход; второй — только «грязные» записи
+		Hash.Refresh(0.0);
+		for (FBenchShip& S : Ships) S.Pos += S.Vel * StepSec;
+		T0 = Seconds();
+		Hash.Refresh(StepSec);
+		const double RefreshMs = (Seconds() - T0) * 1000.0;
+
+		TArray<const FBenchShip*> Out;
+		int64 SphereHits = 0;
+		T0 = Seconds();
+		for (int32 v : Viewers)
+		{
+			Hash.QuerySphere(Ships[v].Pos, RadiusUU, Out);
+			SphereHits += Out.Num();
+		}
+		const double SphereMs = (Seconds() - T0) * 1000.0;
+
+		FSRGKnnScratch Scratch;
+		int64 KnnHits = 0;
+		T0 = Seconds();
+		for (int32 v : Viewers)
+		{
+			Hash.QueryKNearest(Ships[v].Pos, K, RadiusUU, Out, Scratch);
+			KnnHits += Out.Num();
+		}
+		const double KnnMs = (Seconds() - T0) * 1000.0;
+
+		std::printf("N=%7d cell=%6.0f R=%6.0f | insert %8.2f ms (%6.1f ns/ship) | refresh %7.2f ms"
+			" | sphere %7.2f us/q (%6.1f hits) | knn%d %7.2f us/q (%5.1f hits)\n",
+			NumShips, CellUU, RadiusUU,
+			InsertMs, InsertMs * 1.0e6 / NumShips, RefreshMs,
+			SphereMs * 1000.0 / NumQueries, double(SphereHits) / NumQueries,
+			K, KnnMs * 1000.0 / NumQueries, double(KnnHits) / NumQueries);
+	}
+}
+
+int main(int Argc, char** Argv)
+{
+	TArray<int32> Sizes;
+	for (int32 a = 1; a < Argc; ++a)
+	{
+		const int32 N = std::atoi(Argv[a]);
+		if (N > 0) Sizes.Add(N);
+	}
+	if (Sizes.Num() == 0) Sizes = { 1000, 10000, 100000 };
+
+	// Умолчания BenchCore: ячейка 50 км, радиус 18 км, 256 запросов, K=32
+	for (int32 N : Sizes)
+	{
+		RunCore(N, /*CellUU*/ 5.0e6, /*RadiusUU*/ 1.8e6, /*NumQueries*/ 256, /*K*/ 32);
+	}
+	return 0;
+}
@@ -0,0 +1,882 @@
+// SRG_SpatialHashCoreTests.cpp
+// Юнит-тесты TSpatialHash3D без движка: вставка, обновление, сфера, KNN,
+// ребиас, пакетный запрос, категории, конус/пирамида, упреждение, пары,
+// уровни. Эталон — полный перебор в double по тому же флоту; всё, кроме
+// первых тестов, — у ~1 а.е. от нуля, с ненулевым Bias и рыхлой сеткой.
+
+#include "SRG_SpatialHashCore.h"
+
+#include <cstdio>
+#include <random>
+
+namespace
+{
+	int32 NumFailed = 0;
+
+	#define SRG_TEST_CHECK(Expr) \
+		do { if (!(Expr)) { ++NumFailed; std::printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #Expr); } } while (0)
+
+	struct FTestShip
+	{
+		FVector Pos   = FVector::ZeroVector;
+		FVector Vel   = FVector::ZeroVector;
+		bool    bAlive = true;
+	};
+
+	struct FTestFleetPolicy
+	{
+		using FResolved = const FTestShip*;
+
+		const TArray<FTestShip>* Ships = nullptr;
+
+		FORCEINLINE const FTestShip* Resolve(int32 H) const
+		{
+			return Ships->IsValidIndex(H) && (*Ships)[H].bAlive ? &(*Ships)[H] : nullptr;
+		}
+		FORCEINLINE FVector GetLocation(const FTestShip* S) const { return S->Pos; }
+		FORCEINLINE FVector GetVelocity(const FTestShip* S) const { return S->Vel; }
+	};
+
+	using FTestHash = TSpatialHash3D<int32, FTestFleetPolicy>;
+
+	/** Флот в кубе ±Spread вокруг Origin; Origin далеко от нуля — проверка LWC */
+	void MakeFleet(TArray<FTestShip>& Ships, int32 Num, const FVector& Origin, double Spread, uint32 Seed)
+	{
+		std::mt19937 Rng(Seed);
+		std::uniform_real_distribution<double> U(-Spread, Spread);
+		Ships.SetNum(Num);
+		for (FTestShip& S : Ships)
+		{
+			S.Pos    = Origin + FVector(U(Rng), U(Rng), U(Rng));
+			S.Vel    = FVector::ZeroVector;
+			S.bAlive = true;
+		}
+	}
+
+	int32 ToIndex(const TArray<FTestShip>& Ships, const FTestShip* S) { return int32(S - Ships.GetData()); }
+
+	/**
+	 * Сфера против перебора. Кэш позиций во float в координатах ячейки, поэтому
+	 * точки в пределах Eps от границы допускаются в обе стороны.
+	 */
+	void CheckSphere(const FTestHash& Hash, const TArray<FTestShip>& Ships, const FVector& C, double R)
+	{
+		constexpr double Eps = 1.0;
+		TArray<const FTestShip*> Out;
+		Hash.QuerySphere(C, R, Out);
+
+		TArray<uint8> Seen;
+		Seen.SetNumZeroed(Ships.Num());
+		for (const FTestShip* S : Out)
+		{
+			const int32 i = ToIndex(Ships, S);
+			SRG_TEST_CHECK(Ships.IsValidIndex(i) && Ships[i].bAlive);
+			SRG_TEST_CHECK(Seen[i] == 0);  // без дублей
+			Seen[i] = 1;
+			SRG_TEST_CHECK(FVector::Dist(S->Pos, C) <= R + Eps);
+		}
+		for (int32 i = 0; i < Ships.Num(); ++i)
+		{
+			if (Ships[i].bAlive && FVector::Dist(Ships[i].Pos, C) < R - Eps)
+			{
+				SRG_TEST_CHECK(Seen[i] == 1);
+			}
+		}
+	}
+
+	/** KNN против перебора: тот же размер, по возрастанию, K-я дистанция совпадает */
+	void CheckKNearest(const FTestHash& Hash, const TArray<FTestShip>& Ships, const FVector& C, int32 K, double MaxR)
+	{
+		constexpr double Eps = 1.0;
+		FSRGKnnScratch Scratch;
+		TArray<const FTestShip*> Out;
+		Hash.QueryKNearest(C, K, MaxR, Out, Scratch);
+
+		TArray<double> Brute;
+		for (const FTestShip& S : Ships)
+		{
+			const double D = FVector::Dist(S.Pos, C);
+			if (S.bAlive && D <= MaxR) Brute.Add(D);
+		}
+		Brute.Sort();
+		const int32 Expected = FMath::Min(K, Brute.Num());
+
+		// На границе MaxR точность кэша может добавить/убрать одну точку
+		SRG_TEST_CHECK(FMath::Abs(Out.Num() - Expected) <= 1);
+		double Prev = 0.0;
+		for (int32 i = 0; i < Out.Num(); ++i)
+		{
+			const double D = FVector::Dist(Out[i]->Pos, C);
+			SRG_TEST_CHECK(D + Eps >= Prev);
+			SRG_TEST_CHECK(D <= MaxR + Eps);
+			if (i < Brute.Num()) SRG_TEST_CHECK(FMath::Abs(D - Brute[i]) <= Eps);
+			Prev = D;
+		}
+	}
+
+	/**
+	 * Результат запроса против перебора: обязаны попасть все живые, для кого
+	 * Must(i) (граница сдвинута внутрь на Eps), допустимы только те, для кого
+	 * May(i) (наружу на Eps). Дубли — ошибка.
+	 */
+	template<typename MustType, typename MayType>
+	void CheckFound(const TArray<FTestShip>& Ships, const TArray<int32>& Found, MustType&& Must, MayType&& May)
+	{
+		TArray<uint8> Seen;
+		Seen.SetNumZeroed(Ships.Num());
+		for (int32 i : Found)
+		{
+			SRG_TEST_CHECK(Ships.IsValidIndex(i) && Ships[i].bAlive);
+			if (!Ships.IsValidIndex(i)) continue;
+			SRG_TEST_CHECK(Seen[i] == 0);
+			Seen[i] = 1;
+			SRG_TEST_CHECK(May(i));
+		}
+		for (int32 i = 0; i < Ships.Num(); ++i)
+		{
+			if (Ships[i].bAlive && Must(i))
+			{
+				SRG_TEST_CHECK(Seen[i] == 1);
+			}
+		}
+	}
+
+	TArray<int32> ToIndices(const TArray<FTestShip>& Ships, const TArray<const FTestShip*>& Out)
+	{
+		TArray<int32> Found;
+		for (const FTestShip* S : Out) Found.Add(ToIndex(Ships, S));
+		return Found;
+	}
+
+	/** Флот у ~1 а.е.: вдали от нуля float-координаты мира уже не держат сантиметры */
+	const FVector FarOrigin(1.5e13, -4.0e12, 2.0e11);
+
+	/** Флот у FarOrigin со скоростями и категориями (i % 4); Policy смотрит на Ships */
+	struct FFarFleet
+	{
+		TArray<FTestShip> Ships;
+		TArray<uint8>     Categories;
+		FTestFleetPolicy  Policy;
+
+		FFarFleet(int32 Num, double Spread, double MaxSpeed, uint32 Seed)
+		{
+			MakeFleet(Ships, Num, FarOrigin, Spread, Seed);
+			std::mt19937 Rng(Seed + 1000);
+			std::uniform_real_distribution<double> V(-MaxSpeed, MaxSpeed);
+			Categories.SetNum(Num);
+			for (int32 i = 0; i < Num; ++i)
+			{
+				Ships[i].Vel  = FVector(V(Rng), V(Rng), V(Rng));
+				Categories[i] = uint8(i % 4);
+			}
+			Policy.Ships = &Ships;
+		}
+
+		FFarFleet(const FFarFleet&) = delete;
+		FFarFleet& operator=(const FFarFleet&) = delete;
+
+		/**
+		 * Вставка при Bias у флота, затем ребиас на дробное число ячеек (снэп,
+		 * ненулевой CellOffset), рыхлая сетка и шаг в 1 с с полным Refresh —
+		 * часть записей релинкуется уже в сдвинутой сетке.
+		 */
+		template<typename HashType>
+		void Populate(HashType& Hash, double CellUU)
+		{
+			Hash.SetBias(FarOrigin);
+			for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i, Categories[i]);
+			Hash.SetBias(FarOrigin + FVector(37.3, -12.8, 5.1) * CellUU);
+			Hash.SetLooseMargin(float(0.25 * CellUU));
+			Hash.SetRefreshParams(10.f, 0.5f);
+			Hash.Refresh(0.0);
+			Step(1.0);
+			Hash.Refresh(1.0);  // >= FullSweepSec — перечитываются все
+		}
+
+		void Step(double Sec)
+		{
+			for (FTestShip& S : Ships) S.Pos += S.Vel * Sec;
+		}
+
+		FVector RandomPoint(std::mt19937& Rng, double Spread) const
+		{
+			std::uniform_real_distribution<double> U(-Spread, Spread);
+			return FarOrigin + FVector(U(Rng), U(Rng), U(Rng));
+		}
+	};
+
+	/** Время входа в сферу радиуса R (double); < 0 — не войдёт (или уже внутри) */
+	double BruteEntryTime(const FVector& D, const FVector& V, double R)
+	{
+		const double C = D.SizeSquared() - R * R;
+		const double B = FVector::DotProduct(D, V);
+		const double A = V.SizeSquared();
+		if (C <= 0.0 || B >= 0.0 || A <= 0.0) return -1.0;
+		const double Disc = B * B - A * C;
+		if (Disc < 0.0) return -1.0;
+		return (-B - FMath::Sqrt(Disc)) / A;
+	}
+
+	/* ===================== Тесты ===================== */
+
+	void TestInsert()
+	{
+		TArray<FTestShip> Ships;
+		MakeFleet(Ships, 2000, FVector::ZeroVector, 50000.0, 1);
+
+		FTestFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		FTestHash Hash(Policy);
+		Hash.Init(5000.f);
+
+		for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i);
+		SRG_TEST_CHECK(Hash.Num() == Ships.Num());
+		for (int32 i = 0; i < Ships.Num(); ++i)
+		{
+			SRG_TEST_CHECK(Hash.Contains(i));
+			SRG_TEST_CHECK(Hash.GetCachedLocation(i) == Ships[i].Pos);
+		}
+
+		// Повторный Add — не дубль
+		Hash.Add(7);
+		SRG_TEST_CHECK(Hash.Num() == Ships.Num());
+
+		// Мёртвый хэндл не вставляется
+		Ships[11].bAlive = false;
+		Hash.Remove(11);
+		Hash.Add(11);
+		SRG_TEST_CHECK(!Hash.Contains(11));
+		SRG_TEST_CHECK(Hash.Num() == Ships.Num() - 1);
+
+		// Remove + сфера по всему флоту
+		for (int32 i = 0; i < Ships.Num(); i += 3)
+		{
+			Hash.Remove(i);
+			Ships[i].bAlive = false;
+		}
+		int32 Alive = 0;
+		for (const FTestShip& S : Ships) Alive += S.bAlive ? 1 : 0;
+		SRG_TEST_CHECK(Hash.Num() == Alive);
+
+		TArray<const FTestShip*> Out;
+		Hash.QuerySphere(FVector::ZeroVector, 1.0e6, Out);
+		SRG_TEST_CHECK(Out.Num() == Alive);
+	}
+
+	void TestUpdate()
+	{
+		TArray<FTestShip> Ships;
+		MakeFleet(Ships, 1000, FVector::ZeroVector, 30000.0, 2);
+
+		FTestFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		FTestHash Hash(Policy);
+		Hash.Init(4000.f);
+		for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i);
+
+		// Явный Update: корабль перелетает далеко — другая ячейка
+		const FVector Far(250000.0, -120000.0, 7000.0);
+		Ships[5].Pos = Far;
+		Hash.Update(5);
+		SRG_TEST_CHECK(Hash.GetCachedLocation(5) == Far);
+		TArray<const FTestShip*> Out;
+		Hash.QuerySphere(Far, 10.0, Out);
+		SRG_TEST_CHECK(Out.Num() == 1 && Out[0] == &Ships[5]);
+
+		// Update умершего — удаление
+		Ships[6].bAlive = false;
+		Hash.Update(6);
+		SRG_TEST_CHECK(!Hash.Contains(6));
+
+		// Refresh: полный проход после сдвига всего флота
+		std::mt19937 Rng(3);
+		std::uniform_real_distribution<double> U(-6000.0, 6000.0);
+		Hash.Refresh(0.0);
+		for (FTestShip& S : Ships)
+		{
+			S.Vel  = FVector(U(Rng), U(Rng), U(Rng));
+			S.Pos += S.Vel;  // шаг 1 с
+		}
+		Hash.SetRefreshParams(10.f, 0.5f);
+		Hash.Refresh(1.0);  // >= FullSweepSec — перечитываются все
+		for (int32 i = 0; i < Ships.Num(); ++i)
+		{
+			if (!Ships[i].bAlive) continue;
+			SRG_TEST_CHECK(Hash.Contains(i));
+			SRG_TEST_CHECK(Hash.GetCachedLocation(i) == Ships[i].Pos);
+		}
+		for (int32 q = 0; q < 50; ++q) CheckSphere(Hash, Ships, Ships[q * 17].Pos, 9000.0);
+
+		// Мёртвые уходят на Refresh
+		Ships[20].bAlive = false;
+		Ships[21].bAlive = false;
+		const int32 Before = Hash.Num();
+		Hash.Refresh(2.0);
+		SRG_TEST_CHECK(Hash.Num() == Before - 2);
+		SRG_TEST_CHECK(!Hash.Contains(20) && !Hash.Contains(21));
+
+		// Смена размера ячейки — полный ре-хеш без потерь
+		Hash.SetCellSize(1500.f);
+		SRG_TEST_CHECK(Hash.Num() == Before - 2);
+		for (int32 q = 0; q < 50; ++q) CheckSphere(Hash, Ships, Ships[q * 13 + 1].Pos, 5000.0);
+	}
+
+	void TestSphere()
+	{
+		// Плотный кластер у нуля и флот за ~1 а.е. (1.5e13 см): хэш обязан быть точным и там
+		const FVector Origins[] = { FVector::ZeroVector, FVector(1.5e13, -4.0e12, 2.0e11) };
+		for (const FVector& Origin : Origins)
+		{
+			TArray<FTestShip> Ships;
+			MakeFleet(Ships, 3000, Origin, 80000.0, 4);
+
+			FTestFleetPolicy Policy;
+			Policy.Ships = &Ships;
+			FTestHash Hash(Policy);
+			Hash.Init(5000.f);
+			for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i);
+
+			std::mt19937 Rng(5);
+			std::uniform_real_distribution<double> U(-90000.0, 90000.0);
+			std::uniform_real_distribution<double> Rad(100.0, 40000.0);
+			for (int32 q = 0; q < 100; ++q)
+			{
+				CheckSphere(Hash, Ships, Origin + FVector(U(Rng), U(Rng), U(Rng)), Rad(Rng));
+			}
+
+			// Рыхлая сетка расширяет обход, результат тот же
+			Hash.SetLooseMargin(1000.f);
+			for (int32 q = 0; q < 30; ++q)
+			{
+				CheckSphere(Hash, Ships, Origin + FVector(U(Rng), U(Rng), U(Rng)), Rad(Rng));
+			}
+
+			// Пустая сфера вдали от флота
+			TArray<const FTestShip*> Out;
+			Hash.QuerySphere(Origin + FVector(1.0e7, 0.0, 0.0), 1000.0, Out);
+			SRG_TEST_CHECK(Out.Num() == 0);
+		}
+	}
+
+	void TestKNearest()
+	{
+		const FVector Origin(-2.0e9, 3.0e9, 0.0);
+		TArray<FTestShip> Ships;
+		MakeFleet(Ships, 3000, Origin, 60000.0, 6);
+
+		FTestFleetPolicy Policy;
+		Policy.Ships = &Ships;
+		FTestHash Hash(Policy);
+		Hash.Init(4000.f);
+		for (int32 i = 0; i < Ships.Num(); ++i) Hash.Add(i);
+
+		std::mt19937 Rng(7);
+		std::uniform_real_distribution<double> U(-70000.0, 70000.0);
+		const int32 Ks[] = { 1, 8, 32, 200 };
+		for (int32 K : Ks)
+		{
+			for (int32 q = 0; q < 40; ++q)
+			{
+				CheckKNearest(Hash, Ships, Origin + FVector(U(Rng), U(Rng), U(Rng)), K, 50000.0);
+			}
+		}
+
+		// Радиус меньше расстояния до K-го: Out короче K
+		CheckKNearest(Hash, Ships, Ships[3].Pos, 500, 3000.0);
+
+		// K <= 0 и нулевой радиус — пусто
+		FSRGKnnScratch Scratch;
+		TArray<const FTestShip*> Out;
+		Hash.QueryKNearest(Ships[0].Pos, 0, 10000.0, Out, Scratch);
+		SRG_TEST_CHECK(Out.Num() == 0);
+		Hash.QueryKNearest(Ships[0].Pos, 5, 0.0, Out, Scratch);
+		SRG_TEST_CHECK(Out.Num() == 0);
+
+		// Сам корабль — ближайший к своей позиции
+		Hash.QueryKNearest(Ships[9].Pos, 1, 10000.0, Out, Scratch);
+		SRG_TEST_CHECK(Out.Num() == 1 && Out[0] == &Ships[9]);
+	}
+
+	void TestRebias()
+	{
+		constexpr double CellUU = 5000.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 8);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+
+		// Ре-хеша не было (Init при нулевом Bias): оба SetBias — только сдвиг
+		// CellOffset; дробная часть второго снэпнута к сетке
+		const FInt64Vector FarCells(int64(FarOrigin.X / CellUU), int64(FarOrigin.Y / CellUU), int64(FarOrigin.Z / CellUU));
+		SRG_TEST_CHECK(Hash.GetCellOffset() == FarCells + FInt64Vector(37, -13, 5));
+		const FVector Snapped = FarOrigin + FVector(37.0, -13.0, 5.0) * CellUU;
+		SRG_TEST_CHECK(FVector::Dist(Hash.GetBias(), Snapped) < 1.0);
+
+		std::mt19937 Rng(9);
+		std::uniform_real_distribution<double> Rad(100.0, 40000.0);
+		for (int32 q = 0; q < 60; ++q) CheckSphere(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), Rad(Rng));
+		for (int32 q = 0; q < 30; ++q) CheckKNearest(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), 16, 40000.0);
+
+		// Далёкий ребиас (миллион ячеек) и явные Update уже в сдвинутой сетке
+		Hash.SetBias(FarOrigin - FVector(1.0e6, 2.5e5, -7.0e5) * CellUU);
+		for (int32 i = 0; i < Fleet.Ships.Num(); i += 7)
+		{
+			Fleet.Ships[i].Pos += FVector(12000.0, -3000.0, 800.0);
+			Hash.Update(i);
+		}
+		for (int32 q = 0; q < 60; ++q) CheckSphere(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), Rad(Rng));
+		for (int32 q = 0; q < 30; ++q) CheckKNearest(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), 16, 40000.0);
+
+		// Назад к FarOrigin; ре-хеш (смена ячейки) обнуляет CellOffset
+		Hash.SetBias(FarOrigin);
+		SRG_TEST_CHECK(Hash.GetCellOffset() == FarCells);
+		for (int32 q = 0; q < 30; ++q) CheckSphere(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), Rad(Rng));
+
+		Hash.SetBias(FarOrigin + FVector(3.0, 3.0, 3.0) * CellUU);
+		Hash.SetCellSize(float(CellUU * 0.5));
+		SRG_TEST_CHECK(Hash.GetCellOffset() == FInt64Vector::ZeroValue);
+		SRG_TEST_CHECK(Hash.Num() == Fleet.Ships.Num());
+		for (int32 q = 0; q < 30; ++q) CheckSphere(Hash, Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), Rad(Rng));
+	}
+
+	void TestBatch()
+	{
+		constexpr double CellUU = 5000.0;
+		constexpr double Eps    = 1.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 10);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+
+		// Зрители: часть на кораблях (плотные группы в одной ячейке), часть случайно
+		std::mt19937 Rng(11);
+		TArray<FVector> Centers;
+		for (int32 v = 0; v < 48; ++v) Centers.Add(Ships[v * 5].Pos);
+		for (int32 v = 0; v < 48; ++v) Centers.Add(Fleet.RandomPoint(Rng, 90000.0));
+
+		FSRGBatchQueryScratch Scratch;
+		TArray<TArray<const FTestShip*>> Out;
+		Out.SetNum(Centers.Num());
+
+		const double Radii[] = { 800.0, 6000.0, 25000.0 };
+		for (double R : Radii)
+		{
+			Hash.QuerySpheresBatch(Centers, R, Out, Scratch);
+			for (int32 v = 0; v < Centers.Num(); ++v)
+			{
+				const FVector C = Centers[v];
+				CheckFound(Ships, ToIndices(Ships, Out[v]),
+					[&](int32 i){ return FVector::Dist(Ships[i].Pos, C) < R - Eps; },
+					[&](int32 i){ return FVector::Dist(Ships[i].Pos, C) <= R + Eps; });
+			}
+		}
+
+		// Пакет по категориям: 1 выключена, у остальных свои радиусы
+		FSRGCategoryRadii Cat;
+		Cat.Set(0, 15000.0).Set(2, 4000.0).Set(3, 30000.0);
+		Hash.QuerySpheresBatch(Centers, Cat, Out, Scratch);
+		for (int32 v = 0; v < Centers.Num(); ++v)
+		{
+			const FVector C = Centers[v];
+			auto RadiusOf = [&](int32 i){ return Cat.RadiusUU[Fleet.Categories[i]]; };
+			auto InMask   = [&](int32 i){ return (Cat.Mask & (1u << Fleet.Categories[i])) != 0; };
+			CheckFound(Ships, ToIndices(Ships, Out[v]),
+				[&](int32 i){ return InMask(i) && FVector::Dist(Ships[i].Pos, C) < RadiusOf(i) - Eps; },
+				[&](int32 i){ return InMask(i) && FVector::Dist(Ships[i].Pos, C) <= RadiusOf(i) + Eps; });
+		}
+	}
+
+	void TestCategories()
+	{
+		constexpr double CellUU = 5000.0;
+		constexpr double Eps    = 1.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 12);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+
+		// Смена категории на живой записи видна следующему запросу
+		for (int32 i = 0; i < Ships.Num(); i += 11)
+		{
+			Fleet.Categories[i] = uint8(5);
+			Hash.SetCategory(i, 5);
+		}
+
+		FSRGCategoryRadii Cat;
+		Cat.Set(0, 2000.0).Set(1, 12000.0).Set(3, 35000.0).Set(5, 20000.0);
+		SRG_TEST_CHECK(Cat.GetMaxRadius() == 35000.0 && Cat.GetMinRadius() == 2000.0);
+
+		std::mt19937 Rng(13);
+		TArray<const FTestShip*> Out;
+		for (int32 q = 0; q < 80; ++q)
+		{
+			const FVector C = Fleet.RandomPoint(Rng, 90000.0);
+			Hash.QuerySphere(C, Cat, Out);
+			auto RadiusOf = [&](int32 i){ return Cat.RadiusUU[Fleet.Categories[i]]; };
+			auto InMask   = [&](int32 i){ return (Cat.Mask & (1u << Fleet.Categories[i])) != 0; };
+			CheckFound(Ships, ToIndices(Ships, Out),
+				[&](int32 i){ return InMask(i) && FVector::Dist(Ships[i].Pos, C) < RadiusOf(i) - Eps; },
+				[&](int32 i){ return InMask(i) && FVector::Dist(Ships[i].Pos, C) <= RadiusOf(i) + Eps; });
+		}
+
+		// Пустая маска — пусто
+		Hash.QuerySphere(FarOrigin, FSRGCategoryRadii(), Out);
+		SRG_TEST_CHECK(Out.Num() == 0);
+	}
+
+	void TestCone()
+	{
+		constexpr double CellUU = 5000.0;
+		constexpr double Eps    = 1.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 14);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+
+		std::mt19937 Rng(15);
+		std::uniform_real_distribution<double> U(-1.0, 1.0);
+		std::uniform_real_distribution<double> Half(0.05, 2.0);
+
+		FSRGCategoryRadii Cat;
+		Cat.Set(0, 60000.0).Set(1, 20000.0).Set(2, 45000.0);
+
+		TArray<typename FTestHash::FViewHit> Hits;
+		int32 NumHits = 0;
+		for (int32 q = 0; q < 60; ++q)
+		{
+			const FVector Origin  = (q % 2) ? Ships[q].Pos : Fleet.RandomPoint(Rng, 60000.0);
+			const FVector Axis    = FVector(U(Rng), U(Rng), U(Rng)).GetSafeNormal();
+			const double  HalfRad = Half(Rng);
+			const double  NearUU  = (q % 3) ? 5000.0 : 0.0;
+			const double  CosHalf = FMath::Cos(HalfRad);
+			Hash.QueryCone(Origin, Axis, float(HalfRad), Cat, Hits, NearUU);
+
+			NumHits += Hits.Num();
+			TArray<int32> Found;
+			for (const auto& Hit : Hits)
+			{
+				const int32   i     = ToIndex(Ships, Hit.Object);
+				const FVector D     = Ships[i].Pos - Origin;
+				const double  Dist  = D.Size();
+				Found.Add(i);
+				SRG_TEST_CHECK(FMath::Abs(Hit.DistUU - Dist) <= Eps);
+				if (Dist > 100.0)
+				{
+					const double Angle = FMath::Acos(FMath::Clamp(FVector::DotProduct(D, Axis) / Dist, -1.0, 1.0));
+					SRG_TEST_CHECK(FMath::Abs(Hit.AngleRad - Angle) <= 2e-3);
+				}
+			}
+
+			// Внутри конуса — запас Eps по «Along - cos * Dist», рядом — по дистанции
+			auto Test = [&](int32 i, double Slack)
+			{
+				const uint8 c = Fleet.Categories[i];
+				if (!(Cat.Mask & (1u << c))) return false;
+				const FVector D    = Ships[i].Pos - Origin;
+				const double  Dist = D.Size();
+				if (Dist > Cat.RadiusUU[c] + Slack) return false;
+				const double Along = FVector::DotProduct(D, Axis);
+				return Along - CosHalf * Dist >= -Slack || Dist <= NearUU + Slack;
+			};
+			CheckFound(Ships, Found, [&](int32 i){ return Test(i, -Eps); }, [&](int32 i){ return Test(i, Eps); });
+		}
+		SRG_TEST_CHECK(NumHits > 0);  // иначе сверка пустая
+	}
+
+	void TestFrustum()
+	{
+		constexpr double CellUU = 5000.0;
+		constexpr double Eps    = 1.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 16);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+
+		std::mt19937 Rng(17);
+		std::uniform_real_distribution<double> U(-1.0, 1.0);
+		std::uniform_real_distribution<double> Half(0.1, 1.4);
+		std::uniform_real_distribution<double> Range(5000.0, 120000.0);
+
+		TArray<typename FTestHash::FViewHit> Hits;
+		int32 NumHits = 0;
+		for (int32 q = 0; q < 60; ++q)
+		{
+			const FVector Origin  = (q % 2) ? Ships[q].Pos : Fleet.RandomPoint(Rng, 60000.0);
+			const FVector Forward = FVector(U(Rng), U(Rng), U(Rng));
+			const FSRGViewFrustum F = FSRGViewFrustum::Make(Origin, Forward, FVector::UpVector, Half(Rng), Half(Rng), Range(Rng));
+			const uint8 Mask = (q % 4) ? uint8(0xFF) : uint8(0b0101);
+			Hash.QueryFrustum(F, Hits, Mask);
+
+			NumHits += Hits.Num();
+			TArray<int32> Found;
+			for (const auto& Hit : Hits)
+			{
+				const int32 i = ToIndex(Ships, Hit.Object);
+				Found.Add(i);
+				SRG_TEST_CHECK(FMath::Abs(Hit.DistUU - FVector::Dist(Ships[i].Pos, Origin)) <= Eps);
+			}
+
+			// Все плоскости с запасом Slack (нормали единичные — запас в см)
+			auto Test = [&](int32 i, double Slack)
+			{
+				if (!(Mask & (1u << Fleet.Categories[i]))) return false;
+				const FVector D = Ships[i].Pos - Origin;
+				for (int32 p = 0; p < F.NumPlanes; ++p)
+				{
+					if (FVector::DotProduct(F.Normal[p], D) - F.Dist[p] > Slack) return false;
+				}
+				return true;
+			};
+			CheckFound(Ships, Found, [&](int32 i){ return Test(i, -Eps); }, [&](int32 i){ return Test(i, Eps); });
+		}
+		SRG_TEST_CHECK(NumHits > 0);  // иначе сверка пустая
+	}
+
+	void TestApproaching()
+	{
+		constexpr double CellUU  = 5000.0;
+		constexpr double Eps     = 1.0;
+		constexpr double TimeEps = 1e-3;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 18);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+
+		FSRGCategoryRadii Cat;
+		Cat.Set(0, 20000.0).Set(1, 8000.0).Set(3, 14000.0);
+		const float HorizonSec = 2.f;
+
+		std::mt19937 Rng(19);
+		std::uniform_real_distribution<double> U(-1500.0, 1500.0);
+		TArray<typename FTestHash::FApproachHit> Hits;
+		int32 NumHits = 0;
+		for (int32 q = 0; q < 60; ++q)
+		{
+			const FVector Center    = (q % 2) ? Ships[q].Pos : Fleet.RandomPoint(Rng, 60000.0);
+			const FVector ViewerVel = FVector(U(Rng), U(Rng), U(Rng));
+			const bool    bByCat    = (q % 3) == 0;
+			if (bByCat) Hash.QueryApproaching(Center, ViewerVel, Cat, HorizonSec, Hits);
+			else        Hash.QueryApproaching(Center, ViewerVel, 12000.0, HorizonSec, Hits);
+
+			auto RadiusOf = [&](int32 i) -> double
+			{
+				const uint8 c = Fleet.Categories[i];
+				if (!bByCat) return 12000.0;
+				return (Cat.Mask & (1u << c)) ? Cat.RadiusUU[c] : -1.0;
+			};
+
+			NumHits += Hits.Num();
+			TArray<int32> Found;
+			float Prev = 0.f;
+			for (const auto& Hit : Hits)
+			{
+				const int32 i = ToIndex(Ships, Hit.Object);
+				Found.Add(i);
+				SRG_TEST_CHECK(Hit.EntryTimeSec >= Prev);
+				Prev = Hit.EntryTimeSec;
+
+				// Время входа — между входом в сферу R + Eps и в R - Eps
+				const double R = RadiusOf(i);
+				if (R <= 0.0) continue;
+				const FVector D = Ships[i].Pos - Center;
+				const FVector V = Ships[i].Vel - ViewerVel;
+				const double  TOuter = BruteEntryTime(D, V, R + Eps);
+				const double  TInner = BruteEntryTime(D, V, R - Eps);
+				SRG_TEST_CHECK(Hit.EntryTimeSec >= FMath::Max(0.0, TOuter) - TimeEps);
+				if (TInner >= 0.0) SRG_TEST_CHECK(Hit.EntryTimeSec <= TInner + TimeEps);
+			}
+
+			// Обязан: снаружи R + Eps и входит в R - Eps до горизонта; может: снаружи R - Eps и входит в R + Eps
+			auto Must = [&](int32 i)
+			{
+				const double R = RadiusOf(i);
+				if (R <= 0.0) return false;
+				const FVector D = Ships[i].Pos - Center;
+				if (D.Size() <= R + Eps) return false;
+				const double T = BruteEntryTime(D, Ships[i].Vel - ViewerVel, R - Eps);
+				return T >= 0.0 && T <= HorizonSec - TimeEps;
+			};
+			auto May = [&](int32 i)
+			{
+				const double R = RadiusOf(i);
+				if (R <= 0.0) return false;
+				const FVector D = Ships[i].Pos - Center;
+				if (D.Size() < R - Eps) return false;
+				const double T = BruteEntryTime(D, Ships[i].Vel - ViewerVel, R + Eps);
+				return D.Size() <= R + Eps || (T >= 0.0 && T <= HorizonSec + TimeEps);
+			};
+			CheckFound(Ships, Found, Must, May);
+		}
+		SRG_TEST_CHECK(NumHits > 0);  // иначе сверка пустая
+	}
+
+	/** Ключ неупорядоченной пары для сверки множеств */
+	uint64 PairKey(int32 A, int32 B)
+	{
+		return (uint64(uint32(FMath::Min(A, B))) << 32) | uint64(uint32(FMath::Max(A, B)));
+	}
+
+	void TestPairs()
+	{
+		constexpr double CellUU = 5000.0;
+		constexpr double Eps    = 1.0;
+		FFarFleet Fleet(1500, 30000.0, 3000.0, 20);
+		FTestHash Hash(Fleet.Policy);
+		Hash.Init(float(CellUU));
+		Fleet.Populate(Hash, CellUU);
+		const TArray<FTestShip>& Ships = Fleet.Ships;
+		const TArray<uint8>&     Cats  = Fleet.Categories;
+
+		struct FPairCase { double RadiusUU; uint8 MaskA; uint8 MaskB; };
+		const FPairCase Cases[] =
+		{
+			{ 2000.0,  0xFF,   0xFF   },  // меньше ячейки — 13 соседей
+			{ 9000.0,  0xFF,   0xFF   },  // больше ячейки — широкий трафарет
+			{ 6000.0,  0b0001, 0b0110 },  // A — категория 0, B — 1 или 2
+			{ 4000.0,  0b0010, 0b0010 },  // внутри одной категории
+		};
+
+		FSRGPairScratch Scratch;
+		for (const FPairCase& Case : Cases)
+		{
+			auto InA = [&](int32 i){ return (Case.MaskA & (1u << Cats[i])) != 0; };
+			auto InB = [&](int32 i){ return (Case.MaskB & (1u << Cats[i])) != 0; };
+
+			TArray<uint64> Serial;
+			Hash.ForEachPairWithin(Case.RadiusUU, [&](int32 A, int32 B, float DistSq)
+			{
+				SRG_TEST_CHECK(A != B && InA(A) && InB(B));
+				SRG_TEST_CHECK(FMath::Abs(FMath::Sqrt(double(DistSq)) - FVector::Dist(Ships[A].Pos, Ships[B].Pos)) <= Eps);
+				Serial.Add(PairKey(A, B));
+			}, Scratch, Case.MaskA, Case.MaskB);
+
+			const int32 NumTasks = 5;
+			TArray<TArray<uint64>> PerTask;
+			PerTask.SetNum(NumTasks);
+			Hash.ParallelForEachPairWithin(Case.RadiusUU, [&](int32 Task, int32 A, int32 B, float /*DistSq*/)
+			{
+				PerTask[Task].Add(PairKey(A, B));
+			}, Scratch, Case.MaskA, Case.MaskB, NumTasks);
+			TArray<uint64> Parallel;
+			for (const TArray<uint64>& T : PerTask) Parallel.Append(T);
+
+			Serial.Sort();
+			Parallel.Sort();
+			SRG_TEST_CHECK(Serial == Parallel);
+			for (int32 k = 1; k < Serial.Num(); ++k) SRG_TEST_CHECK(Serial[k] != Serial[k - 1]);  // каждая пара — один раз
+
+			// Перебор O(N^2): обязательные пары — найдены, найденные — допустимы
+			int32 NumMust = 0;
+			for (int32 i = 0; i < Ships.Num(); ++i)
+			{
+				for (int32 j = i + 1; j < Ships.Num(); ++j)
+				{
+					if (!((InA(i) && InB(j)) || (InA(j) && InB(i)))) continue;
+					if (FVector::Dist(Ships[i].Pos, Ships[j].Pos) >= Case.RadiusUU - Eps) continue;
+					++NumMust;
+					SRG_TEST_CHECK(Algo::BinarySearch(Serial, PairKey(i, j)) != INDEX_NONE);
+				}
+			}
+			for (uint64 Key : Serial)
+			{
+				const int32 i = int32(Key >> 32);
+				const int32 j = int32(Key & 0xFFFFFFFFu);
+				SRG_TEST_CHECK(FVector::Dist(Ships[i].Pos, Ships[j].Pos) <= Case.RadiusUU + Eps);
+			}
+			SRG_TEST_CHECK(NumMust > 0);  // иначе сверка пустая
+		}
+	}
+
+	void TestLevels()
+	{
+		constexpr double BaseCellUU = 40000.0;
+		FFarFleet Fleet(3000, 80000.0, 3000.0, 22);
+		TSRGSpatialLevels<int32, FTestFleetPolicy> Levels(Fleet.Policy);
+		Levels.Init(float(BaseCellUU));
+		Levels.SetLevels(3, 4);  // 40000, 10000, 2500
+		Levels.SetCellPerRadius(0.5f);
+		Fleet.Populate(Levels, BaseCellUU);
+		SRG_TEST_CHECK(Levels.NumLevels() == 3);
+
+		// Мелкий радиус — мелкая ячейка, крупный — базовая
+		SRG_TEST_CHECK(Levels.ForRadius(4000.0).GetCellSize() == 2500.0);
+		SRG_TEST_CHECK(Levels.ForRadius(20000.0).GetCellSize() == 10000.0);
+		SRG_TEST_CHECK(Levels.ForRadius(90000.0).GetCellSize() == BaseCellUU);
+
+		std::mt19937 Rng(23);
+		const double Radii[] = { 600.0, 4000.0, 20000.0, 90000.0 };
+		auto CheckAll = [&]()
+		{
+			for (double R : Radii)
+			{
+				for (int32 q = 0; q < 15; ++q)
+				{
+					const FVector C = Fleet.RandomPoint(Rng, 90000.0);
+					CheckSphere(Levels.ForRadius(R), Fleet.Ships, C, R);
+					CheckKNearest(Levels.ForRadius(R), Fleet.Ships, C, 8, R);
+				}
+			}
+			// Каждый уровень сам по себе — полный и точный хэш
+			for (int32 l = 0; l < Levels.NumLevels(); ++l)
+			{
+				SRG_TEST_CHECK(Levels.GetLevel(l).Num() == Levels.GetBase().Num());
+				CheckSphere(Levels.GetLevel(l), Fleet.Ships, Fleet.RandomPoint(Rng, 90000.0), 15000.0);
+			}
+		};
+		CheckAll();
+
+		// Перестройка уровней на живом флоте, затем ребиас, удаления и шаг
+		Levels.SetLevels(2, 8);  // 40000, 5000
+		SRG_TEST_CHECK(Levels.NumLevels() == 2);
+		Levels.SetBias(FarOrigin - FVector(1234.6, 77.2, -9.9) * BaseCellUU);
+		for (int32 i = 0; i < Fleet.Ships.Num(); i += 9)
+		{
+			Fleet.Ships[i].bAlive = false;
+			Levels.Remove(i);
+		}
+		Fleet.Step(1.0);
+		Levels.Refresh(2.0);
+		CheckAll();
+	}
+
+	struct FTestCase
+	{
+		const char* Name;
+		void (*Fn)();
+	};
+}
+
+int main()
+{
+	const FTestCase Cases[] =
+	{
+		{ "Insert",      &TestInsert },
+		{ "Update",      &TestUpdate },
+		{ "Sphere",      &TestSphere },
+		{ "KNearest",    &TestKNearest },
+		{ "Rebias",      &TestRebias },
+		{ "Batch",       &TestBatch },
+		{ "Categories",  &TestCategories },
+		{ "Cone",        &TestCone },
+		{ "Frustum",     &TestFrustum },
+		{ "Approaching", &TestApproaching },
+		{ "Pairs",       &TestPairs },
+		{ "Levels",      &TestLevels },
+	};
+
+	int32 NumCasesFailed = 0;
+	for (const FTestCase& Case : Cases)
+	{
+		const int32 Before = NumFailed;
+		Case.Fn();
+		const bool bOk = NumFailed == Before;
+		NumCasesFailed += bOk ? 0 : 1;
+		std::printf("[%s] SpatialHashCore.%s\n", bOk ? "  OK  " : " FAIL ", Case.Name);
+	}
+	return NumCasesFailed == 0 ? 0 : 1;
+}